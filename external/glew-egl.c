@@ -0,0 +1,23 @@
+/*
+ * GLEW 1.13 only knows GLX on Linux. For EGL contexts (LIGHTPROBE_EGL) the
+ * vendored glew.c is built from here, unmodified : its GLX loader is redirected
+ * to eglGetProcAddress, and glewInit stops after the core and extension entry
+ * points since there is no GLX display to query.
+ */
+
+#include <EGL/egl.h>
+
+#define glXGetProcAddressARB glewEGLGetProcAddress
+#define glewInit glewInitGLX
+#include "glew-1.13.0/src/glew.c"
+#undef glewInit
+
+void (*glewEGLGetProcAddress (const GLubyte *procName)) (void)
+{
+  return eglGetProcAddress((const char*)procName);
+}
+
+GLenum GLEWAPIENTRY glewInit (void)
+{
+  return glewContextInit();
+}
@@ -0,0 +1,38 @@
+//------------------------------------------------------------------------------
+// Depth pre-pass of the opaque meshes (see RenderQueue::setDepthPrepass)
+//
+// Same position as IblMesh and IblMeshTex, the shading passes test GL_EQUAL
+// against it : the transform must stay the same expression, and invariant.
+
+-- Vertex
+
+#include "DrawData.glsli"
+
+// IN
+layout(location = 0) in vec4 inPosition;
+
+// UNIFORM
+uniform mat4 uModelViewProjMatrix;
+
+invariant gl_Position;
+
+void main()
+{
+  vec4 position = getPosition(inPosition);
+  mat4 model = getModelMatrix();
+
+  // Clip Space position
+  gl_Position = uModelViewProjMatrix * model * position;
+}
+
+
+--
+
+//------------------------------------------------------------------------------
+
+
+-- Fragment
+
+void main()
+{
+}
@@ -0,0 +1,103 @@
+//------------------------------------------------------------------------------
+
+-- Compute
+
+// One invocation per arena object (see GeometryArena::cullObjects) : a visible
+// object picks its level, then appends its index to the instance list of that
+// level's command. The lists are compacted, a command without instance costs
+// nothing to the multi-draw.
+layout(local_size_x = 64) in;
+
+struct ObjectData
+{
+    mat4 model;
+    vec4 positionScale;
+    vec4 positionBias;
+    vec4 material;
+};
+
+struct CullMesh
+{
+    vec4 sphere;        // object space center, radius
+    vec4 lodErrors;     // in object units
+    uint lodCount;
+    uint firstCommand;  // one per level
+    uint pad0;
+    uint pad1;
+};
+
+struct DrawCommand
+{
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+layout(std430, binding = 0) readonly buffer Objects { ObjectData objects[]; };
+layout(std430, binding = 1) readonly buffer ObjectMeshes { uint objectMeshes[]; };
+layout(std430, binding = 2) readonly buffer CullMeshes { CullMesh cullMeshes[]; };
+layout(std430, binding = 3) buffer DrawCommands { DrawCommand commands[]; };
+layout(std430, binding = 4) writeonly buffer DrawIndices { uint drawIndices[]; };
+layout(std430, binding = 5) buffer VisibleCount { uint visibleCount; };
+
+uniform int uObjectCount;
+uniform bool ubFrustum;
+uniform vec4 uFrustumPlanes[6];     // world space, normalized
+uniform vec3 uEyePosWS;
+uniform float uPixelsPerUnit;       // at distance 1
+uniform float uLodThreshold;        // in pixels
+
+bool isVisible(vec3 center, float radius)
+{
+    for (int i = 0; i < 6; ++i)
+    {
+        if (dot(uFrustumPlanes[i].xyz, center) + uFrustumPlanes[i].w < -radius)
+            return false;
+    }
+    return true;
+}
+
+// same selection as LodSelector::select
+uint selectLod(CullMesh mesh, vec3 center, float radius, float scale)
+{
+    float distance = length(center - uEyePosWS) - radius;
+    if (mesh.lodCount < 2u || distance <= 0.0)
+        return 0u;
+
+    float pixelsPerError = scale * uPixelsPerUnit / distance;
+
+    uint lod = 0u;
+    while (lod + 1u < mesh.lodCount && mesh.lodErrors[lod + 1u] * pixelsPerError <= uLodThreshold)
+        ++lod;
+    return lod;
+}
+
+void main()
+{
+    uint objectId = gl_GlobalInvocationID.x;
+    if (objectId >= uint(uObjectCount))
+        return;
+
+    // the mesh of the object was removed from the arena
+    uint meshId = objectMeshes[objectId];
+    if (meshId == 0xFFFFFFFFu)
+        return;
+
+    CullMesh mesh = cullMeshes[meshId];
+    mat4 model = objects[objectId].model;
+
+    // the radius grows with the largest scale of the model matrix
+    float scale = sqrt(max(max(dot(model[0].xyz, model[0].xyz), dot(model[1].xyz, model[1].xyz)), dot(model[2].xyz, model[2].xyz)));
+    vec3 center = (model * vec4(mesh.sphere.xyz, 1.0)).xyz;
+    float radius = mesh.sphere.w * scale;
+
+    if (ubFrustum && !isVisible(center, radius))
+        return;
+
+    uint command = mesh.firstCommand + selectLod(mesh, center, radius, scale);
+    uint slot = atomicAdd(commands[command].instanceCount, 1u);
+    drawIndices[commands[command].baseInstance + slot] = objectId;
+    atomicAdd(visibleCount, 1u);
+}
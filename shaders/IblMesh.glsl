@@ -1,5 +1,7 @@
 -- Vertex
 
+#include "DrawData.glsli"
+
 // IN
 layout(location = 0) in vec4 inPosition;
 layout(location = 1) in vec3 inNormal;
@@ -10,25 +12,36 @@ out vec3 vNormalWS;
 out vec3 vViewDirWS;
 out vec3 vWorldPosWS;
 out vec2 vTexcoords;
+flat out vec2 vMaterial;
 
 // UNIFORM
-uniform mat4 uMtxSrt;
 uniform mat4 uModelViewProjMatrix;
 uniform vec3 uEyePosWS;
+uniform float uGlossiness;
+uniform float uReflectivity;
+
+// the depth pre-pass computes the same position (DepthOnly.glsl)
+invariant gl_Position;
 
 void main()
 {
+  vec4 position = getPosition(inPosition);
+  mat4 model = getModelMatrix();
+
   // Clip Space position
-  gl_Position = uModelViewProjMatrix * uMtxSrt * inPosition;
+  gl_Position = uModelViewProjMatrix * model * position;
 
   // World Space normal
-  vec3 normal = mat3(uMtxSrt) * inNormal;
+  vec3 normal = mat3(model) * decodeNormal(inNormal);
   vNormalWS = normalize(normal);
 
   vTexcoords = inTexcoords;
+
+  // glossiness & reflectivity, per draw in a multi-draw
+  vMaterial = ubDrawData ? drawData[inDrawIndex].material.xy : vec2(uGlossiness, uReflectivity);
   
   // World Space view direction from world space position
-  vec3 posWS = vec3((uMtxSrt * inPosition).xyz);
+  vec3 posWS = vec3((model * position).xyz);
   vViewDirWS = normalize(uEyePosWS - posWS);
   vWorldPosWS = posWS;
 }
@@ -42,12 +55,14 @@ void main()
 -- Fragment
 
 #include "ToneMappingUtility.glsli"
+#include "ClusteredLights.glsli"
 
 // IN
 in vec3 vNormalWS;
 in vec3 vViewDirWS;
 in vec3 vWorldPosWS;
 in vec2 vTexcoords;
+flat in vec2 vMaterial;
 
 // OUT
 layout(location = 0) out vec4 fragColor;
@@ -62,14 +77,10 @@ uniform float ubDiffuse;
 uniform float ubSpecular;
 uniform float ubDiffuseIbl;
 uniform float ubSpecularIbl;
-uniform float uGlossiness;
-uniform float uReflectivity;
 uniform float uExposure;
 uniform vec3 uLightDir;
 uniform vec3 uLightCol;
 uniform vec3 uRgbDiff;
-uniform vec3 uLightPositions[4];
-uniform vec3 uLightColors[4];
 
 const float pi = 3.14159265359;
 
@@ -143,19 +154,6 @@ float geometrySmith(float _ndotv, float _ndotl, float roughness)
 	return ggx1 * ggx2;
 }
 
-mat3 calcTbn(vec3 _normal, vec3 _worldPos, vec2 _texCoords)
-{
-    vec3 Q1  = dFdx(_worldPos);
-    vec3 Q2  = dFdy(_worldPos);
-    vec2 st1 = dFdx(_texCoords);
-    vec2 st2 = dFdy(_texCoords);
-
-    vec3 N   = _normal;
-    vec3 T  = normalize(Q1*st2.t - Q2*st1.t);
-    vec3 B  = -normalize(cross(N, T));
-    return mat3(T, B, N);
-}
-
 // Moving frostbite to pbr
 vec3 getSpecularDomninantDir(vec3 N, vec3 R, float roughness)
 {
@@ -169,8 +167,8 @@ void main()
 {  
   // Material params. uMetallicMap
   vec3  inAlbedo = uRgbDiff;
-  float inMetallic = uReflectivity;
-  float inRoughness = uGlossiness;
+  float inMetallic = vMaterial.y;
+  float inRoughness = vMaterial.x;
 
   // calculate reflectance at normal incidence; if dia-electric (like plastic) use F0 
   // of 0.04 and if it's a metal, use the albedo color as F0 (metallic workflow)    
@@ -185,16 +183,20 @@ void main()
   vec3 nn = normalize(vNormalWS);
   vec3 vv = normalize(vViewDirWS);
 
-  // reflectance equation
+  // reflectance equation, over the lights of the cluster only
   vec3 direct = vec3(0.0);
-  for (int i = 0; i < 4; ++i)
+  uint cluster = getCluster(vWorldPosWS);
+  uint lightCount = getClusterLightCount(cluster);
+  for (uint i = 0u; i < lightCount; ++i)
   {
+	  PointLight light = getClusterLight(cluster, i);
+
 	  // calculate per-light radiance
-	  vec3 ld = normalize(uLightPositions[i] - vWorldPosWS);
+	  vec3 ld = normalize(light.position - vWorldPosWS);
 	  vec3 hh = normalize(vv + ld);
-	  float distance = length(uLightPositions[i] - vWorldPosWS);
-	  float attenuation = 1.0 / (distance*distance);
-	  vec3 radiance = uLightColors[i] * attenuation;
+	  float distance = length(light.position - vWorldPosWS);
+	  float attenuation = getAttenuation(light, distance);
+	  vec3 radiance = light.color * attenuation;
 
 	  float ndotv = clamp(dot(nn, vv), 0.0, 1.0);
 	  float ndotl = clamp(dot(nn, ld), 0.0, 1.0);
@@ -1,34 +1,47 @@
 -- Vertex
 
+#include "DrawData.glsli"
+
 // IN
 layout(location = 0) in vec4 inPosition;
 layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec2 inTexcoords;
+layout(location = 3) in vec4 inTangent;
 
 // OUT
 out vec3 vNormalWS;
+out vec4 vTangentWS;
 out vec3 vViewDirWS;
 out vec3 vWorldPosWS;
 out vec2 vTexcoords;
 
 // UNIFORM
-uniform mat4 uMtxSrt;
 uniform mat4 uModelViewProjMatrix;
 uniform vec3 uEyePosWS;
 
+// the depth pre-pass computes the same position (DepthOnly.glsl)
+invariant gl_Position;
+
 void main()
 {
+  vec4 position = getPosition(inPosition);
+  mat4 model = getModelMatrix();
+
   // Clip Space position
-  gl_Position = uModelViewProjMatrix * uMtxSrt * inPosition;
+  gl_Position = uModelViewProjMatrix * model * position;
 
   // World Space normal
-  vec3 normal = mat3(uMtxSrt) * inNormal;
+  vec3 normal = mat3(model) * decodeNormal(inNormal);
   vNormalWS = normalize(normal);
 
+  // World Space tangent, w keeps the handedness of the bitangent
+  vec3 tangent = mat3(model) * inTangent.xyz;
+  vTangentWS = vec4(normalize(tangent), inTangent.w < 0.0 ? -1.0 : 1.0);
+
   vTexcoords = inTexcoords;
   
   // World Space view direction from world space position
-  vec3 posWS = vec3((uMtxSrt * inPosition).xyz);
+  vec3 posWS = vec3((model * position).xyz);
   vViewDirWS = normalize(uEyePosWS - posWS);
   vWorldPosWS = posWS;
 }
@@ -42,9 +55,11 @@ void main()
 -- Fragment
 
 #include "ToneMappingUtility.glsli"
+#include "ClusteredLights.glsli"
 
 // IN
 in vec3 vNormalWS;
+in vec4 vTangentWS;
 in vec3 vViewDirWS;
 in vec3 vWorldPosWS;
 in vec2 vTexcoords;
@@ -67,8 +82,6 @@ uniform float ubSpecular;
 uniform float ubDiffuseIbl;
 uniform float ubSpecularIbl;
 uniform float uExposure;
-uniform vec3 uLightPositions[4];
-uniform vec3 uLightColors[4];
 
 const float pi = 3.14159265359;
 
@@ -142,16 +155,12 @@ float geometrySmith(float _ndotv, float _ndotl, float roughness)
 	return ggx1 * ggx2;
 }
 
-mat3 calcTbn(vec3 _normal, vec3 _worldPos, vec2 _texCoords)
+// The normal maps store their green channel flipped (-Y)
+mat3 calcTbn(vec3 _normal, vec4 _tangent)
 {
-    vec3 Q1  = dFdx(_worldPos);
-    vec3 Q2  = dFdy(_worldPos);
-    vec2 st1 = dFdx(_texCoords);
-    vec2 st2 = dFdy(_texCoords);
-
-    vec3 N   = _normal;
-    vec3 T  = normalize(Q1*st2.t - Q2*st1.t);
-    vec3 B  = -normalize(cross(N, T));
+    vec3 N = _normal;
+    vec3 T = normalize(_tangent.xyz - N * dot(N, _tangent.xyz));
+    vec3 B = -_tangent.w * cross(N, T);
     return mat3(T, B, N);
 }
 
@@ -175,20 +184,24 @@ void main()
   vec3 nn = normalize(vNormalWS);
   vec3 vv = normalize(vViewDirWS);
 
-  mat3 tbn = calcTbn(nn, vWorldPosWS, vTexcoords);
+  mat3 tbn = calcTbn(nn, vTangentWS);
   vec3 tangentNormal = texture(uNormalMap, vTexcoords).xyz * 2.0 - 1.0;
   nn = normalize(tbn * tangentNormal);
 
-  // reflectance equation
+  // reflectance equation, over the lights of the cluster only
   vec3 direct = vec3(0.0);
-  for (int i = 0; i < 4; ++i)
+  uint cluster = getCluster(vWorldPosWS);
+  uint lightCount = getClusterLightCount(cluster);
+  for (uint i = 0u; i < lightCount; ++i)
   {
+	  PointLight light = getClusterLight(cluster, i);
+
 	  // calculate per-light radiance
-	  vec3 ld = normalize(uLightPositions[i] - vWorldPosWS);
+	  vec3 ld = normalize(light.position - vWorldPosWS);
 	  vec3 hh = normalize(vv + ld);
-	  float distance = length(uLightPositions[i] - vWorldPosWS);
-	  float attenuation = 1.0 / (distance*distance);
-	  vec3 radiance = uLightColors[i] * attenuation;
+	  float distance = length(light.position - vWorldPosWS);
+	  float attenuation = getAttenuation(light, distance);
+	  vec3 radiance = light.color * attenuation;
 
 	  float ndotv = clamp(dot(nn, vv), 0.0, 1.0);
 	  float ndotl = clamp(dot(nn, ld), 0.0, 1.0);
@@ -6,33 +6,7 @@
 //------------------------------------------------------------------------------
 
 
--- Vertex
-
-// IN
-layout(location = 0) in vec4 inPosition;
-layout(location = 1) in vec3 inNormal;
-
-// OUT
-out vec3 vDirection;
-
-// UNIFORM
-uniform mat4 uViewMatrix;
-uniform mat4 uProjMatrix;
-
-void main()
-{
-  mat4 rotView = mat4(mat3(uViewMatrix));
-  vec4 clipPos = uProjMatrix * rotView * inPosition;
-  gl_Position = clipPos.xyww;
-
-  vDirection = inPosition.xyz;
-}
-
-
---
-
-//------------------------------------------------------------------------------
-
+// The vertex shader is SkyTriangle.Vertex
 
 -- Fragment
 
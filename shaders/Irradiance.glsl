@@ -8,7 +8,11 @@
 layout(local_size_x = 16, local_size_y = 16, local_size_z = 1) in;
 layout(rgba16f, binding=0) uniform writeonly imageCube uCube;
 
-const uint sampleCount = 96u;
+// SAMPLE_COUNT may be set by a directive, see the bake quality
+#ifndef SAMPLE_COUNT
+#define SAMPLE_COUNT 96u
+#endif
+const uint sampleCount = SAMPLE_COUNT;
 
 shared vec3 vSampleDirections[sampleCount];
 
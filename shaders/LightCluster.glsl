@@ -0,0 +1,74 @@
+//------------------------------------------------------------------------------
+
+-- Compute
+
+// One invocation per cluster (see ClusteredLights::update) : the view space
+// box of the cluster is tested against the sphere of every light, the ones
+// touching it are listed.
+layout(local_size_x = 64) in;
+
+#include "ClusterLayout.glsli"
+
+layout(std430, binding = POINT_LIGHTS_BINDING) readonly buffer PointLights { PointLight pointLights[]; };
+layout(std430, binding = CLUSTER_COUNTS_BINDING) writeonly buffer ClusterCounts { uint clusterCounts[]; };
+layout(std430, binding = CLUSTER_LIGHTS_BINDING) writeonly buffer ClusterLights { uint clusterLights[]; };
+
+uniform mat4 uViewMatrix;
+uniform mat4 uInvProjMatrix;
+uniform float uZNear;
+uniform float uZFar;
+uniform int uLightCount;
+
+// view space point of the near plane at 'ndc'
+vec3 unproject(vec2 ndc)
+{
+  vec4 p = uInvProjMatrix * vec4(ndc, -1.0, 1.0);
+  return p.xyz / p.w;
+}
+
+// point of the eye ray through 'p' at the view depth 'z'
+vec3 atDepth(vec3 p, float z)
+{
+  return p * (z / -p.z);
+}
+
+void main()
+{
+  uint cluster = gl_GlobalInvocationID.x;
+  if (cluster >= CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+    return;
+
+  uint x = cluster % CLUSTER_X;
+  uint y = (cluster / CLUSTER_X) % CLUSTER_Y;
+  uint z = cluster / (CLUSTER_X * CLUSTER_Y);
+
+  // exponential slices, as ClusteredLights.glsli reads them
+  float sliceNear = uZNear * pow(uZFar / uZNear, float(z) / float(CLUSTER_Z));
+  float sliceFar = uZNear * pow(uZFar / uZNear, float(z + 1u) / float(CLUSTER_Z));
+
+  vec2 ndcMin = vec2(x, y) / vec2(CLUSTER_X, CLUSTER_Y) * 2.0 - 1.0;
+  vec2 ndcMax = vec2(x + 1u, y + 1u) / vec2(CLUSTER_X, CLUSTER_Y) * 2.0 - 1.0;
+  vec3 pMin = unproject(ndcMin);
+  vec3 pMax = unproject(ndcMax);
+
+  // the tile edges are straight lines from the eye, their ends bound the slice
+  vec3 a = atDepth(pMin, sliceNear);
+  vec3 b = atDepth(pMin, sliceFar);
+  vec3 c = atDepth(pMax, sliceNear);
+  vec3 d = atDepth(pMax, sliceFar);
+  vec3 boxMin = min(min(a, b), min(c, d));
+  vec3 boxMax = max(max(a, b), max(c, d));
+
+  uint count = 0u;
+  uint first = cluster * MAX_LIGHTS_PER_CLUSTER;
+  for (int i = 0; i < uLightCount && count < MAX_LIGHTS_PER_CLUSTER; ++i)
+  {
+    PointLight light = pointLights[i];
+    vec3 center = (uViewMatrix * vec4(light.position, 1.0)).xyz;
+    vec3 closest = clamp(center, boxMin, boxMax);
+    vec3 delta = center - closest;
+    if (dot(delta, delta) <= light.radius * light.radius)
+      clusterLights[first + count++] = uint(i);
+  }
+  clusterCounts[cluster] = count;
+}
@@ -0,0 +1,84 @@
+//------------------------------------------------------------------------------
+
+-- Compute
+
+// One work group per meshlet : the first invocation tests it, then the whole
+// group copies the indices of a visible meshlet to the compacted buffer.
+layout(local_size_x = 64) in;
+
+struct Meshlet
+{
+    vec4 sphere;        // object space center, radius
+    vec4 cone;          // axis, cutoff
+    uint indexOffset;   // in bytes, inside SourceIndices
+    uint indexCount;
+    uint vertexBase;
+    uint shortIndex;    // 16-bit source indices
+};
+
+layout(std430, binding = 0) readonly buffer Meshlets { Meshlet meshlets[]; };
+layout(std430, binding = 1) readonly buffer SourceIndices { uint sourceIndices[]; };
+layout(std430, binding = 2) writeonly buffer CulledIndices { uint culledIndices[]; };
+layout(std430, binding = 3) buffer DrawCommand
+{
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+} drawCommand;
+
+uniform int uMeshletCount;
+uniform vec4 uFrustumPlanes[6];     // object space, normalized
+uniform vec3 uEyePosOS;
+
+shared bool bVisible;
+shared uint uFirstCulledIndex;
+
+bool isVisible(Meshlet m)
+{
+    for (int i = 0; i < 6; ++i)
+    {
+        if (dot(uFrustumPlanes[i].xyz, m.sphere.xyz) + uFrustumPlanes[i].w < -m.sphere.w)
+            return false;
+    }
+
+    // every triangle faces away from the eye
+    vec3 toCenter = m.sphere.xyz - uEyePosOS;
+    return dot(toCenter, m.cone.xyz) < m.cone.w * length(toCenter) + m.sphere.w;
+}
+
+uint readIndex(Meshlet m, uint i)
+{
+    if (m.shortIndex != 0u)
+    {
+        uint byteOffset = m.indexOffset + 2u * i;
+        uint word = sourceIndices[byteOffset >> 2u];
+        return ((byteOffset & 2u) != 0u) ? (word >> 16u) : (word & 0xFFFFu);
+    }
+    return sourceIndices[(m.indexOffset >> 2u) + i];
+}
+
+void main()
+{
+    uint meshletId = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+    if (meshletId >= uint(uMeshletCount))
+        return;
+
+    Meshlet m = meshlets[meshletId];
+
+    if (gl_LocalInvocationIndex == 0u)
+    {
+        bVisible = isVisible(m);
+        if (bVisible)
+            uFirstCulledIndex = atomicAdd(drawCommand.count, m.indexCount);
+    }
+    barrier();
+
+    if (!bVisible)
+        return;
+
+    // the base vertex is applied here, the draw uses a single one
+    for (uint i = gl_LocalInvocationIndex; i < m.indexCount; i += gl_WorkGroupSize.x)
+        culledIndices[uFirstCulledIndex + i] = m.vertexBase + readIndex(m, i);
+}
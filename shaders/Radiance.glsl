@@ -5,7 +5,11 @@
 layout(local_size_x = 16, local_size_y = 16, local_size_z = 1) in;
 layout(rgba16f, binding=0) uniform writeonly imageCube uCube;
 
-const uint sampleCount = 32u;
+// SAMPLE_COUNT may be set by a directive, see the bake quality
+#ifndef SAMPLE_COUNT
+#define SAMPLE_COUNT 32u
+#endif
+const uint sampleCount = SAMPLE_COUNT;
 
 shared float fInvTotalWeight;
 shared vec3 vSampleDirections[sampleCount];
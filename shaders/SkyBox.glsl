@@ -6,36 +6,12 @@
 //------------------------------------------------------------------------------
 
 
--- Vertex
-
-// IN
-layout(location = 0) in vec4 inPosition;
-layout(location = 1) in vec3 inNormal;
-
-// OUT
-out vec3 vTexCoord;
-
-// UNIFORM
-uniform mat4 uModelViewProjMatrix;
-
-
-void main()
-{
-  gl_Position = uModelViewProjMatrix * inPosition;
-
-  vTexCoord = inPosition.xyz;
-}
-
-
---
-
-//------------------------------------------------------------------------------
-
+// The vertex shader is SkyTriangle.Vertex
 
 -- Fragment
 
 // IN
-in vec3 vTexCoord;
+in vec3 vDirection;
 
 // OUT
 layout(location = 0) out vec4 fragColor;
@@ -45,6 +21,6 @@ uniform samplerCube uCubemap;
 
 void main()
 {  
-  fragColor = texture( uCubemap, vTexCoord);
+  fragColor = texture( uCubemap, vDirection);
 }
 
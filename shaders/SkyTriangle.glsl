@@ -0,0 +1,31 @@
+/*
+ *          SkyTriangle.glsl
+ *
+ *  Background of the IblSkyBox, SkyBox and Skydome programs : a fullscreen
+ *  triangle (FullscreenTriangleMesh) at the far plane, drawn after the opaque
+ *  meshes with GL_LEQUAL so the covered pixels are never shaded.
+ */
+
+//------------------------------------------------------------------------------
+
+
+-- Vertex
+
+// IN
+layout(location = 0) in vec4 inPosition;
+
+// OUT
+out vec3 vDirection;
+
+// UNIFORM
+uniform mat4 uInvViewProjMatrix;  // without the translation, see TCamera::getSkyMatrix
+
+void main()
+{
+  // depth 1.0
+  gl_Position = vec4(inPosition.xy, 1.0, 1.0);
+
+  // direction of the far plane point
+  vec4 farPos = uInvViewProjMatrix * vec4(inPosition.xy, 1.0, 1.0);
+  vDirection = farPos.xyz / farPos.w;
+}
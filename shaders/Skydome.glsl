@@ -6,36 +6,12 @@
 //------------------------------------------------------------------------------
 
 
--- Vertex
-
-// IN
-layout(location = 0) in vec4 inPosition;
-layout(location = 1) in vec3 inNormal;
-layout(location = 2) in vec2 inTexCoord;
-
-// OUT
-out vec2 vTexCoord;
-
-// UNIFORM
-uniform mat4 uModelViewProjMatrix;
-
-
-void main()
-{
-  gl_Position = uModelViewProjMatrix * inPosition;
-  vTexCoord = inTexCoord;
-}
-
-
---
-
-//------------------------------------------------------------------------------
-
+// The vertex shader is SkyTriangle.Vertex
 
 -- Fragment
 
 // IN
-in vec2 vTexCoord;
+in vec3 vDirection;
 
 // OUT
 layout(location = 0) out vec4 fragColor;
@@ -43,8 +19,17 @@ layout(location = 0) out vec4 fragColor;
 // UNIFORM
 uniform sampler2D tex;
 
+const float pi = 3.14159265359;
+
+// same mapping as the texture coordinates of SphereMesh
+vec2 getSphereTexCoord(vec3 dir)
+{
+  dir = normalize(dir);
+  return vec2(fract(atan(dir.z, dir.x) / (2.0 * pi)), asin(clamp(dir.y, -1.0, 1.0)) / pi + 0.5);
+}
+
 void main()
 {  
-  fragColor = texture(tex, vTexCoord);
+  fragColor = texture(tex, getSphereTexCoord(vDirection));
 }
 
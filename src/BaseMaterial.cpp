@@ -1,7 +1,56 @@
 #include "BaseMaterial.h"
 #include <tools/gltools.hpp>
+#include <GLType/BaseTexture.h>
+#include <GLType/ProgramShader.h>
 
 void BaseMaterial::destroy()
 {
+	m_Textures.clear();
+	m_Uniforms.clear();
+	m_Locations.clear();
+	m_LocationProgram = nullptr;
+}
+
+void BaseMaterial::setTexture(GLuint unit, const BaseTexture* texture)
+{
+	for (auto& binding : m_Textures)
+	{
+		if (binding.first == unit)
+		{
+			binding.second = texture;
+			return;
+		}
+	}
+	m_Textures.emplace_back(unit, texture);
+}
+
+void BaseMaterial::setUniform(const std::string& name, float value)
+{
+	for (auto& uniform : m_Uniforms)
+	{
+		if (uniform.first == name)
+		{
+			uniform.second = value;
+			return;
+		}
+	}
+	m_Uniforms.emplace_back(name, value);
+}
+
+void BaseMaterial::bind(const ProgramShader& program) const
+{
+	for (auto& binding : m_Textures)
+		binding.second->bind(binding.first);
+	// resolved again when the material meets another program, or the same one relinked
+	if (&program != m_LocationProgram || program.getId() != m_LocationProgramId || m_Locations.size() != m_Uniforms.size())
+	{
+		m_LocationProgram = &program;
+		m_LocationProgramId = program.getId();
+		m_Locations.clear();
+		for (auto& uniform : m_Uniforms)
+			m_Locations.push_back(program.getUniformLocation(uniform.first));
+	}
+	for (size_t i = 0; i < m_Uniforms.size(); ++i)
+		program.setUniform(m_Locations[i], m_Uniforms[i].second);
 }
 
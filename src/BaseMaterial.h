@@ -1,6 +1,17 @@
 #pragma once
 #include <Types.h>
+#include <GL/glew.h>
+#include <string>
+#include <utility>
+#include <vector>
 
+class BaseTexture;
+class ProgramShader;
+
+/**
+ * Textures bound to fixed units and float uniforms, applied together by
+ * bind(). The RenderQueue sorts its draws by material to bind each one once.
+ */
 class BaseMaterial
 {
 public:
@@ -15,5 +26,20 @@ public:
 
 	void initialize();
 	void destroy();
+
+	/** 'texture' is not owned and must outlive the material */
+	void setTexture(GLuint unit, const BaseTexture* texture);
+	void setUniform(const std::string& name, float value);
+
+	void bind(const ProgramShader& program) const;
+
+private:
+	std::vector<std::pair<GLuint, const BaseTexture*>> m_Textures;
+	std::vector<std::pair<std::string, float>> m_Uniforms;
+
+	// m_Uniforms locations in the last program bound
+	mutable std::vector<GLint> m_Locations;
+	mutable const ProgramShader* m_LocationProgram = nullptr;
+	mutable GLuint m_LocationProgramId = 0;
 };
 
@@ -10,17 +10,26 @@ void BaseMesh::destroy()
 	m_Material = nullptr;
 }
 
-void BaseMesh::render()
+void BaseMesh::render(size_t lod)
 {
 	if (m_Material)
 	{
 	}
 
+	size_t offset = m_IndexOffset;
+	unsigned int count = m_IndexCount;
+	if (lod < m_Lods.size())
+	{
+		const size_t indexSize = (m_IndexType == GL_UNSIGNED_SHORT) ? sizeof(uint16_t) : sizeof(uint32_t);
+		offset += m_Lods[lod].firstIndex * indexSize;
+		count = m_Lods[lod].indexCount;
+	}
+
 	GL_ASSERT(glDrawElementsBaseVertex(
 				GL_TRIANGLES,
-				m_IndexCount, 
-				GL_UNSIGNED_INT,
-				(void*)(sizeof(unsigned int)*m_IndexBase), 
+				count, 
+				m_IndexType,
+				(void*)(offset), 
 				m_VertexBase));
 
 	CHECKGLERROR();
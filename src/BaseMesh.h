@@ -1,6 +1,9 @@
 #pragma once
 
 #include <Types.h>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <MeshLod.h>
 
 class BaseMesh
 {
@@ -16,11 +19,16 @@ public:
 
 	void initialize();
 	void destroy();
-	void render();
+	/** Draw a level of detail, the full submesh by default */
+	void render(size_t lod = 0);
 
 	int32_t m_MaterialIndex = -1;
-	unsigned int m_IndexBase = 0;
+	size_t m_IndexOffset = 0;	// in bytes
 	unsigned int m_IndexCount = 0;
+	GLenum m_IndexType = GL_UNSIGNED_INT;
 	unsigned int m_VertexBase = 0;
+	std::vector<MeshLod> m_Lods;
+	glm::vec4 m_BoundingSphere = glm::vec4(0.f);
+	uint32_t m_ArenaMesh = ~0u;		// GeometryArena mesh, when shared
 	BaseMaterialPtr m_Material;
 };
@@ -0,0 +1,106 @@
+#include "ClusteredLights.h"
+#include <GLType/GraphicsBuffer.h>
+#include <GLType/ProgramShader.h>
+#include <tools/gltools.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+
+namespace
+{
+    // binding points of ClusterLayout.glsli, after the arena ones
+    const GLuint kLightBinding = 6;
+    const GLuint kClusterCountBinding = 7;
+    const GLuint kClusterLightBinding = 8;
+}
+
+PointLight::PointLight(const glm::vec3& position, const glm::vec3& color, float threshold) :
+    position(position),
+    color(color),
+    pad(0.f)
+{
+    // inverse square falloff of the brightest channel down to 'threshold'
+    const float intensity = std::max(color.r, std::max(color.g, color.b));
+    radius = std::sqrt(std::max(intensity, 0.f) / threshold);
+}
+
+bool ClusteredLights::initialize()
+{
+    m_ClusterCountBuffer = GraphicsBuffer::Create(GL_SHADER_STORAGE_BUFFER, kClusterCount * sizeof(uint32_t), 0);
+    m_ClusterLightBuffer = GraphicsBuffer::Create(GL_SHADER_STORAGE_BUFFER, kClusterCount * kMaxLightsPerCluster * sizeof(uint32_t), 0);
+    if (!m_ClusterCountBuffer || !m_ClusterLightBuffer)
+    {
+        fprintf(stderr, "ClusteredLights : failed to create the cluster buffers\n");
+        return false;
+    }
+    return true;
+}
+
+void ClusteredLights::destroy()
+{
+    m_LightBuffer.reset();
+    m_ClusterCountBuffer.reset();
+    m_ClusterLightBuffer.reset();
+    m_LightCount = 0;
+}
+
+void ClusteredLights::setLights(const std::vector<PointLight>& lights)
+{
+    m_LightCount = uint32_t(lights.size());
+    if (lights.empty())
+        return;
+
+    const GLsizeiptr size = GLsizeiptr(lights.size() * sizeof(PointLight));
+    if (!m_LightBuffer || m_LightBuffer->getSize() < size)
+    {
+        // room for twice as many, a growing list is not reallocated every frame
+        m_LightBuffer = GraphicsBuffer::Create(GL_SHADER_STORAGE_BUFFER, size * 2, GL_DYNAMIC_STORAGE_BIT);
+        assert(m_LightBuffer != nullptr);
+    }
+    m_LightBuffer->update(0, size, lights.data());
+}
+
+void ClusteredLights::update(ProgramShader& clusterProgram, const glm::mat4& view, const glm::mat4& projection,
+    float zNear, float zFar, uint32_t width, uint32_t height)
+{
+    assert(m_ClusterCountBuffer && m_ClusterLightBuffer);
+    assert(zNear > 0.f && zFar > zNear);
+
+    // slice = log(z) * scale + bias, kClusterZ slices from zNear to zFar
+    const float logRatio = std::log(zFar / zNear);
+    m_SliceScale = float(kClusterZ) / logRatio;
+    m_SliceBias = -float(kClusterZ) * std::log(zNear) / logRatio;
+    m_TileSize = glm::vec2(float(std::max(width, 1u)) / kClusterX, float(std::max(height, 1u)) / kClusterY);
+    m_View = view;
+
+    clusterProgram.bind();
+    clusterProgram.setUniform("uViewMatrix", view);
+    clusterProgram.setUniform("uInvProjMatrix", glm::inverse(projection));
+    clusterProgram.setUniform("uZNear", zNear);
+    clusterProgram.setUniform("uZFar", zFar);
+    clusterProgram.setUniform("uLightCount", GLint(m_LightCount));
+
+    // an empty list still clears the clusters
+    if (m_LightBuffer)
+        m_LightBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, kLightBinding);
+    m_ClusterCountBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, kClusterCountBinding);
+    m_ClusterLightBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, kClusterLightBinding);
+
+    // one thread per cluster, the group size comes from LightCluster.Compute
+    clusterProgram.DispatchThreads(kClusterCount);
+
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    CHECKGLERROR();
+}
+
+void ClusteredLights::bind(const ProgramShader& program) const
+{
+    if (m_LightBuffer)
+        m_LightBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, kLightBinding);
+    m_ClusterCountBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, kClusterCountBinding);
+    m_ClusterLightBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, kClusterLightBinding);
+
+    program.setUniform("uClusterViewMatrix", m_View);
+    program.setUniform("uClusterParams", glm::vec4(m_TileSize, m_SliceScale, m_SliceBias));
+}
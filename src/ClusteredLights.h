@@ -0,0 +1,67 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+#include <GraphicsTypes.h>
+
+class ProgramShader;
+
+/** std430 layout of PointLight in ClusterLayout.glsli */
+struct PointLight
+{
+    glm::vec3 position;     // world space
+    float radius;           // the attenuation reaches zero there
+    glm::vec3 color;
+    float pad;
+
+    PointLight() = default;
+    PointLight(const glm::vec3& position, const glm::vec3& color, float threshold = 0.01f);
+};
+static_assert(sizeof(PointLight) == 32, "PointLight must match the std430 layout of ClusterLayout.glsli");
+
+/**
+ * Clustered forward lighting : the view frustum is split in screen tiles and
+ * exponential depth slices, a compute pass ("LightCluster.Compute") lists the
+ * lights touching each cluster, and the shading only loops over the lights
+ * of the fragment's cluster.
+ *
+ * A cluster keeps up to kMaxLightsPerCluster lights, the others are dropped.
+ */
+class ClusteredLights
+{
+public:
+
+    /** Same grid as ClusterLayout.glsli */
+    static const uint32_t kClusterX = 16;
+    static const uint32_t kClusterY = 9;
+    static const uint32_t kClusterZ = 24;
+    static const uint32_t kClusterCount = kClusterX * kClusterY * kClusterZ;
+    static const uint32_t kMaxLightsPerCluster = 64;
+
+    bool initialize();
+    void destroy();
+
+    /** Upload the lights, the buffer grows as needed */
+    void setLights(const std::vector<PointLight>& lights);
+    uint32_t getLightCount() const noexcept { return m_LightCount; }
+
+    /** Assign the lights to the clusters of the view, before the shading */
+    void update(ProgramShader& clusterProgram, const glm::mat4& view, const glm::mat4& projection,
+        float zNear, float zFar, uint32_t width, uint32_t height);
+
+    /** Bind the buffers and set the cluster uniforms of a shading program */
+    void bind(const ProgramShader& program) const;
+
+private:
+
+    GraphicsBufferPtr m_LightBuffer;
+    GraphicsBufferPtr m_ClusterCountBuffer;
+    GraphicsBufferPtr m_ClusterLightBuffer;
+    uint32_t m_LightCount = 0;
+
+    glm::mat4 m_View = glm::mat4(1.f);
+    glm::vec2 m_TileSize = glm::vec2(1.f);
+    float m_SliceScale = 0.f;
+    float m_SliceBias = 0.f;
+};
@@ -0,0 +1,127 @@
+#include "FrustumCuller.h"
+
+#include <tools/misc.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define FRUSTUM_CULLER_SSE 1
+#include <xmmintrin.h>
+#endif
+
+void SphereBatch::clear()
+{
+	m_X.clear();
+	m_Y.clear();
+	m_Z.clear();
+	m_Radius.clear();
+	m_Count = 0;
+}
+
+void SphereBatch::add(const glm::vec4& sphere)
+{
+	// grow by 4 lanes, the padding ones are skipped by FrustumCuller::cull
+	if ((m_Count & 3u) == 0u)
+	{
+		m_X.insert(m_X.end(), 4, 0.0f);
+		m_Y.insert(m_Y.end(), 4, 0.0f);
+		m_Z.insert(m_Z.end(), 4, 0.0f);
+		m_Radius.insert(m_Radius.end(), 4, 0.0f);
+	}
+
+	m_X[m_Count] = sphere.x;
+	m_Y[m_Count] = sphere.y;
+	m_Z[m_Count] = sphere.z;
+	m_Radius[m_Count] = sphere.w;
+	m_Count++;
+}
+
+glm::vec4 transformSphere(const glm::vec4& sphere, const glm::mat4& model)
+{
+	const float scale = std::sqrt(std::max(std::max(
+		glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+		glm::dot(glm::vec3(model[1]), glm::vec3(model[1]))),
+		glm::dot(glm::vec3(model[2]), glm::vec3(model[2]))));
+
+	return glm::vec4(glm::vec3(model * glm::vec4(glm::vec3(sphere), 1.0f)), sphere.w * scale);
+}
+
+glm::vec4 mergeSpheres(const glm::vec4& a, const glm::vec4& b)
+{
+	if (a.w <= 0.0f)
+		return b;
+	if (b.w <= 0.0f)
+		return a;
+
+	const glm::vec3 delta = glm::vec3(b) - glm::vec3(a);
+	const float distance = glm::length(delta);
+	if (distance + b.w <= a.w)
+		return a;
+	if (distance + a.w <= b.w)
+		return b;
+
+	const float radius = 0.5f * (distance + a.w + b.w);
+	const glm::vec3 center = glm::vec3(a) + delta * ((radius - a.w) / distance);
+	return glm::vec4(center, radius);
+}
+
+FrustumCuller::FrustumCuller(const glm::mat4& viewProj)
+{
+	nv_helpers::Frustum::init(m_Planes, glm::value_ptr(viewProj));
+}
+
+bool FrustumCuller::isVisible(const glm::vec4& sphere) const
+{
+	for (int i = 0; i < nv_helpers::Frustum::NUM_PLANES; i++)
+	{
+		const float* plane = m_Planes[i];
+		if (plane[0] * sphere.x + plane[1] * sphere.y + plane[2] * sphere.z + plane[3] < -sphere.w)
+			return false;
+	}
+	return true;
+}
+
+size_t FrustumCuller::cull(const SphereBatch& spheres, std::vector<uint32_t>& visible) const
+{
+	const size_t first = visible.size();
+	const size_t count = spheres.size();
+
+#if FRUSTUM_CULLER_SSE
+	for (size_t i = 0; i < count; i += 4)
+	{
+		const __m128 x = _mm_loadu_ps(&spheres.m_X[i]);
+		const __m128 y = _mm_loadu_ps(&spheres.m_Y[i]);
+		const __m128 z = _mm_loadu_ps(&spheres.m_Z[i]);
+		const __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&spheres.m_Radius[i]));
+
+		// a sphere is out as soon as it is behind one plane
+		__m128 outside = _mm_setzero_ps();
+		for (int p = 0; p < nv_helpers::Frustum::NUM_PLANES; p++)
+		{
+			const float* plane = m_Planes[p];
+			__m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane[0])), _mm_mul_ps(y, _mm_set1_ps(plane[1]))),
+				_mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane[2])), _mm_set1_ps(plane[3])));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negRadius));
+		}
+
+		const int inside = ~_mm_movemask_ps(outside) & 0xF;
+		for (int lane = 0; lane < 4; lane++)
+		{
+			if ((inside & (1 << lane)) && i + lane < count)
+				visible.push_back(uint32_t(i + lane));
+		}
+	}
+#else
+	for (size_t i = 0; i < count; i++)
+	{
+		const glm::vec4 sphere(spheres.m_X[i], spheres.m_Y[i], spheres.m_Z[i], spheres.m_Radius[i]);
+		if (isVisible(sphere))
+			visible.push_back(uint32_t(i));
+	}
+#endif
+
+	return visible.size() - first;
+}
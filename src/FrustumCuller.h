@@ -0,0 +1,47 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+/** World space bounding spheres in SoA, the arrays are padded to a multiple of 4 */
+class SphereBatch
+{
+public:
+	void clear();
+	void add(const glm::vec4& sphere);
+
+	size_t size() const { return m_Count; }
+
+	std::vector<float> m_X;
+	std::vector<float> m_Y;
+	std::vector<float> m_Z;
+	std::vector<float> m_Radius;
+
+private:
+	size_t m_Count = 0;
+};
+
+/** Sphere of an object space sphere, the radius grows with the largest scale of 'model' */
+glm::vec4 transformSphere(const glm::vec4& sphere, const glm::mat4& model);
+
+/** Smallest sphere around both, a zero radius sphere is treated as empty */
+glm::vec4 mergeSpheres(const glm::vec4& a, const glm::vec4& b);
+
+/**
+ * Test bounding spheres against the normalized planes of nv_helpers::Frustum.
+ * Batches are tested 4 spheres per instruction with SSE, one by one otherwise.
+ */
+class FrustumCuller
+{
+public:
+	explicit FrustumCuller(const glm::mat4& viewProj);
+
+	bool isVisible(const glm::vec4& sphere) const;
+
+	/** Append the indices of the visible spheres to 'visible', return their count */
+	size_t cull(const SphereBatch& spheres, std::vector<uint32_t>& visible) const;
+
+private:
+	float m_Planes[6][4];
+};
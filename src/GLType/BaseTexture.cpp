@@ -1,6 +1,8 @@
 #include <gli/gli.hpp>
 #include <tools/stb_image.h>
+#include <cstdio>
 #include "BaseTexture.h"
+#include <GLType/RenderStateCache.h>
 
 namespace {
     std::string GetFileExtension(const std::string& filename)
@@ -264,7 +266,6 @@ bool BaseTexture::createFromFileSTB(const std::string& filename)
 {
     stbi_set_flip_vertically_on_load(true);
 
-	GLenum Target = GL_TEXTURE_2D;
     GLenum Type = GL_UNSIGNED_BYTE;
     int Width = 0, Height = 0, nrComponents = 0;
     void* Data = nullptr;
@@ -280,29 +281,114 @@ bool BaseTexture::createFromFileSTB(const std::string& filename)
     }
     if (!Data) return false;
 
-    GLenum Format = GetComponent(nrComponents);
-    GLenum InternalFormat = GetInternalComponent(nrComponents, Type == GL_FLOAT);
+    bool bCreated = createFromMemory(Width, Height, nrComponents, Type, Data);
+    stbi_image_free(Data);
+    return bCreated;
+}
+
+bool BaseTexture::createFromMemory(GLint width, GLint height, int components, GLenum type, const void* data)
+{
+    assert(type == GL_FLOAT || type == GL_UNSIGNED_BYTE);
+
+    GLint MaxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &MaxSize);
+    if (!data || components < 1 || components > 4 || width <= 0 || height <= 0 || width > MaxSize || height > MaxSize)
+    {
+        fprintf(stderr, "Cannot upload a %dx%d image with %d components\n", width, height, components);
+        return false;
+    }
+
+	GLenum Target = GL_TEXTURE_2D;
+    GLenum Format = GetComponent(components);
+    GLenum InternalFormat = GetInternalComponent(components, type == GL_FLOAT);
 
 	GLuint TextureID = 0;
 	glCreateTextures(Target, 1, &TextureID);
+	if (!TextureID)
+		return false;
 
 	// Use fixed storage
-    glTextureStorage2D(TextureID, 1, InternalFormat, Width, Height);
-    glTextureSubImage2D(TextureID, 0, 0, 0, Width, Height, Format, Type, Data);
-
-    stbi_image_free(Data);
+    glTextureStorage2D(TextureID, 1, InternalFormat, width, height);
+    glTextureSubImage2D(TextureID, 0, 0, 0, width, height, Format, type, data);
 
 	m_Target = Target;
 	m_TextureID = TextureID;
-	m_Format = Type;
-	m_Width = Width;
-	m_Height = Height;
+	m_Format = type;
+	m_Width = width;
+	m_Height = height;
 	m_Depth = 1;
 	m_MipCount = 1;
 
 	return true;
 }
 
+bool BaseTexture::readPixels(gli::texture& image, GLuint packBuffer) const
+{
+	if (!m_TextureID)
+		return false;
+
+	const bool bCube = (m_Target == GL_TEXTURE_CUBE_MAP);
+	if (!bCube && m_Target != GL_TEXTURE_2D)
+		return false;
+
+	image = gli::texture(
+		bCube ? gli::TARGET_CUBE : gli::TARGET_2D,
+		gli::FORMAT_RGBA16_SFLOAT_PACK16,
+		gli::texture::extent_type(m_Width, m_Height, 1),
+		1, bCube ? 6 : 1, m_MipCount);
+
+	// with a pack buffer bound, the destination pointer is an offset into it
+	assert(!packBuffer || image.size() == getReadbackSize());
+	uint8_t* const Base = packBuffer ? static_cast<uint8_t*>(image.data()) : nullptr;
+	if (packBuffer)
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffer);
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	for (std::size_t Level = 0; Level < image.levels(); ++Level)
+	{
+		glm::tvec3<GLsizei> const Extent(image.extent(Level));
+		for (std::size_t Face = 0; Face < image.faces(); ++Face)
+		{
+			uint8_t* const Data = static_cast<uint8_t*>(image.data(0, Face, Level));
+			glGetTextureSubImage(
+				m_TextureID, static_cast<GLint>(Level),
+				0, 0, static_cast<GLint>(Face),
+				Extent.x, Extent.y, 1,
+				GL_RGBA, GL_HALF_FLOAT,
+				static_cast<GLsizei>(image.size(Level)),
+				Base ? reinterpret_cast<void*>(Data - Base) : Data);
+		}
+	}
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+	if (packBuffer)
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	return true;
+}
+
+size_t BaseTexture::getReadbackSize() const
+{
+	// RGBA16F texels, every level of every face back to back like the gli storage
+	size_t Size = 0;
+	for (GLint Level = 0; Level < m_MipCount; ++Level)
+		Size += size_t(std::max(m_Width >> Level, 1)) * size_t(std::max(m_Height >> Level, 1)) * 8u;
+	return Size * (m_Target == GL_TEXTURE_CUBE_MAP ? 6u : 1u);
+}
+
+bool BaseTexture::save(const std::string& filename) const
+{
+	gli::texture Texture;
+	if (!readPixels(Texture))
+		return false;
+
+	if (!gli::save(Texture, filename))
+	{
+		fprintf(stderr, "Failed to write %s\n", filename.c_str());
+		return false;
+	}
+	return true;
+}
+
 GLuint BaseTexture::getTextureID() const noexcept
 {
     return m_TextureID;
@@ -310,8 +396,9 @@ GLuint BaseTexture::getTextureID() const noexcept
 
 void BaseTexture::destroy()
 {
-	if (!m_TextureID)
+	if (m_TextureID)
 	{
+		RenderStateCache::getInstance().onTextureDeleted(m_TextureID);
 		glDeleteTextures(1, &m_TextureID);
 		m_TextureID = 0;
 
@@ -325,14 +412,21 @@ void BaseTexture::destroy()
 }
 
 void BaseTexture::bind(GLuint unit) const
+{
+	bind(unit, m_Sampler);
+}
+
+void BaseTexture::bind(GLuint unit, const SamplerDesc& sampler) const
 {
 	assert( 0u != m_TextureID );  
-    glBindTextureUnit(unit, m_TextureID);
+    RenderStateCache::getInstance().bindTexture(unit, m_TextureID);
+    SamplerCache::getInstance().bind(unit, sampler);
 }
 
 void BaseTexture::unbind(GLuint unit) const
 {
-    glBindTextureUnit(unit, 0);
+    RenderStateCache::getInstance().bindTexture(unit, 0);
+    RenderStateCache::getInstance().bindSampler(unit, 0);
 }
 
 void BaseTexture::generateMipmap()
@@ -343,10 +437,3 @@ void BaseTexture::generateMipmap()
 	glGenerateTextureMipmap(m_TextureID);
 }
 
-void BaseTexture::parameter(GLenum pname, GLint param)
-{
-	assert(m_Target != GL_INVALID_ENUM);
-	assert(m_TextureID != 0);
-
-    glTextureParameteri(m_TextureID, pname, param);
-}
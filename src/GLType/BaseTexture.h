@@ -3,6 +3,9 @@
 #include <GL/glew.h>
 #include <string>
 #include <GraphicsTypes.h>
+#include <GLType/SamplerCache.h>
+
+namespace gli { class texture; }
 
 class BaseTexture
 {
@@ -17,14 +20,33 @@ public:
 	bool create(const std::string& filename);
 	bool create(GLint width, GLint height, GLenum target, GLenum format, GLuint levels);
 	void destroy();
+	/** Bind with the sampler of the texture, or with 'sampler' for this draw only */
 	void bind(GLuint unit) const;
+	void bind(GLuint unit, const SamplerDesc& sampler) const;
 	void unbind(GLuint unit) const;
 	void generateMipmap();
-	void parameter(GLenum pname, GLint param);
+
+	/** Sampling state used by bind(), the texture object itself is not changed */
+	void setSampler(const SamplerDesc& sampler) noexcept { m_Sampler = sampler; }
+	const SamplerDesc& getSampler() const noexcept { return m_Sampler; }
 
     bool createFromFileGLI(const std::string& filename);
     bool createFromFileSTB(const std::string& filename);
 
+    /** 2D texture of decoded pixels, 'type' is GL_FLOAT (16F storage) or GL_UNSIGNED_BYTE.
+        False when the image is larger than GL_MAX_TEXTURE_SIZE or has no usable format */
+    bool createFromMemory(GLint width, GLint height, int components, GLenum type, const void* data);
+
+    /** Read back every face and level as RGBA16F, filename can be KTX or DDS files */
+    bool save(const std::string& filename) const;
+
+    /** Allocate 'image' as RGBA16F faces and levels and read the texture back into it.
+        With a 'packBuffer' the copy lands in that buffer, at the offsets of 'image'
+        (at least image.size() bytes), and returns without waiting for the GPU */
+    bool readPixels(gli::texture& image, GLuint packBuffer = 0) const;
+    /** Bytes of the image readPixels() fills, the size of its pack buffer */
+    size_t getReadbackSize() const;
+
     GLuint getTextureID() const noexcept;
 
 	GLuint m_TextureID;
@@ -34,5 +56,6 @@ public:
 	GLint m_Height;
 	GLint m_Depth;
 	GLint m_MipCount;
+	SamplerDesc m_Sampler;
 };
 
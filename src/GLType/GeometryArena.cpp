@@ -0,0 +1,567 @@
+#include "GeometryArena.h"
+#include <GLType/ProgramShader.h>
+#include <GLType/RenderStateCache.h>
+#include <MeshLod.h>
+#include <tools/gltools.hpp>
+#include <tools/misc.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <string>
+
+namespace
+{
+    // std430 layout of the mesh records read by DrawCull.glsl
+    struct ArenaCullMesh
+    {
+        glm::vec4 boundingSphere;
+        glm::vec4 lodErrors;
+        uint32_t lodCount;
+        uint32_t firstCommand;
+        uint32_t pad[2];
+    };
+
+    // binding points of DrawCull.glsl, the objects are read at kDrawDataBinding
+    const GLuint kObjectMeshBinding = 1;
+    const GLuint kCullMeshBinding = 2;
+    const GLuint kObjectCommandBinding = 3;
+    const GLuint kObjectIndexBinding = 4;
+    const GLuint kObjectCountBinding = 5;
+}
+
+GeometryArena::GeometryArena() noexcept :
+    m_VAO(0),
+    m_DrawCapacity(0),
+    m_ObjectVAO(0),
+    m_bObjectsDirty(false),
+    m_ObjectCommandCount(0),
+    m_VisibleObjectCount(0),
+    m_ObjectCountFrame(0)
+{
+    for (uint32_t i = 0; i < kObjectCountLatency; i++)
+        m_ObjectCountFences[i] = nullptr;
+}
+
+GeometryArena::~GeometryArena() noexcept
+{
+    destroy();
+}
+
+bool GeometryArena::create(const VertexLayout& layout, uint32_t vertexCapacity, uint32_t indexCapacity, uint32_t drawCapacity) noexcept
+{
+    assert(m_VAO == 0);
+    assert(vertexCapacity > 0 && indexCapacity > 0 && drawCapacity > 0);
+
+    m_Layout = layout;
+
+    m_VertexBuffer = GraphicsBuffer::Create(GL_ARRAY_BUFFER, GLsizeiptr(vertexCapacity) * layout.stride, GL_DYNAMIC_STORAGE_BIT);
+    m_IndexBuffer = GraphicsBuffer::Create(GL_ELEMENT_ARRAY_BUFFER, GLsizeiptr(indexCapacity) * sizeof(uint32_t), GL_DYNAMIC_STORAGE_BIT);
+    if (!m_VertexBuffer || !m_IndexBuffer)
+    {
+        destroy();
+        return false;
+    }
+
+    // Attribute arrays are enabled once, draws only bind the VAO. The object
+    // VAO differs by its draw index attribute, set when the objects are uploaded
+    glGenVertexArrays(1, &m_VAO);
+    glGenVertexArrays(1, &m_ObjectVAO);
+    for (GLuint vao : { m_VAO, m_ObjectVAO })
+    {
+        RenderStateCache::getInstance().bindVertexArray(vao);
+
+        m_VertexBuffer->bind();
+        m_Layout.setAttribPointers();
+        m_Layout.enable();
+
+        m_IndexBuffer->bind();
+    }
+
+    RenderStateCache::getInstance().bindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (!reserveDraws(drawCapacity))
+    {
+        destroy();
+        return false;
+    }
+
+    m_FreeVertices.assign(1, Range{ 0u, vertexCapacity });
+    m_FreeIndices.assign(1, Range{ 0u, indexCapacity });
+
+    CHECKGLERROR();
+    return true;
+}
+
+void GeometryArena::destroy() noexcept
+{
+    if (m_VAO)
+    {
+        RenderStateCache::getInstance().onVertexArrayDeleted(m_VAO);
+        glDeleteVertexArrays(1, &m_VAO);
+        m_VAO = 0;
+    }
+    if (m_ObjectVAO)
+    {
+        RenderStateCache::getInstance().onVertexArrayDeleted(m_ObjectVAO);
+        glDeleteVertexArrays(1, &m_ObjectVAO);
+        m_ObjectVAO = 0;
+    }
+
+    m_VertexBuffer = nullptr;
+    m_IndexBuffer = nullptr;
+    m_DrawIndexBuffer = nullptr;
+    m_CommandBuffer = nullptr;
+    m_DrawDataBuffer = nullptr;
+    m_ObjectDataBuffer = nullptr;
+    m_ObjectMeshBuffer = nullptr;
+    m_CullMeshBuffer = nullptr;
+    m_ObjectCommandTemplate = nullptr;
+    m_ObjectCommandBuffer = nullptr;
+    m_ObjectIndexBuffer = nullptr;
+    releaseCountFences();
+    for (uint32_t i = 0; i < kObjectCountLatency; i++)
+        m_ObjectCountBuffers[i] = nullptr;
+
+    m_FreeVertices.clear();
+    m_FreeIndices.clear();
+    m_Meshes.clear();
+    m_FreeMeshes.clear();
+    m_Commands.clear();
+    m_DrawData.clear();
+    m_DrawCapacity = 0;
+    m_Objects.clear();
+    m_ObjectMeshes.clear();
+    m_bObjectsDirty = false;
+    m_ObjectCommandCount = 0;
+    m_VisibleObjectCount = 0;
+}
+
+bool GeometryArena::isCompatible(const VertexLayout& layout) const noexcept
+{
+    return layout.stride == m_Layout.stride
+        && layout.format.position == m_Layout.format.position
+        && layout.format.normal == m_Layout.format.normal
+        && layout.format.texcoord == m_Layout.format.texcoord
+        && layout.format.tangent == m_Layout.format.tangent
+        && layout.positionOffset == m_Layout.positionOffset
+        && layout.normalOffset == m_Layout.normalOffset
+        && layout.texcoordOffset == m_Layout.texcoordOffset
+        && layout.tangentOffset == m_Layout.tangentOffset;
+}
+
+uint32_t GeometryArena::addMesh(
+    const VertexLayout& layout,
+    const void* vertices,
+    uint32_t vertexCount,
+    const uint32_t* indices,
+    uint32_t indexCount,
+    const std::vector<MeshLod>& lods,
+    const glm::vec4& boundingSphere) noexcept
+{
+    if (!m_VAO || !isCompatible(layout) || vertexCount == 0 || indexCount == 0)
+        return kInvalidMesh;
+
+    ArenaMesh mesh;
+    if (!allocate(m_FreeVertices, vertexCount, mesh.baseVertex))
+        return kInvalidMesh;
+    if (!allocate(m_FreeIndices, indexCount, mesh.firstIndex))
+    {
+        release(m_FreeVertices, mesh.baseVertex, vertexCount);
+        return kInvalidMesh;
+    }
+
+    mesh.vertexCount = vertexCount;
+    mesh.indexCount = indexCount;
+    mesh.positionScale = layout.positionScale;
+    mesh.positionBias = layout.positionBias;
+    mesh.lods = lods;
+    mesh.boundingSphere = boundingSphere;
+    if (mesh.lods.empty())
+        mesh.lods.push_back(MeshLod{ 0u, indexCount, 0.0f });
+
+    m_VertexBuffer->update(GLintptr(mesh.baseVertex) * m_Layout.stride, GLsizeiptr(vertexCount) * m_Layout.stride, vertices);
+    m_IndexBuffer->update(GLintptr(mesh.firstIndex) * sizeof(uint32_t), GLsizeiptr(indexCount) * sizeof(uint32_t), indices);
+
+    uint32_t id = uint32_t(m_Meshes.size());
+    if (!m_FreeMeshes.empty())
+    {
+        id = m_FreeMeshes.back();
+        m_FreeMeshes.pop_back();
+        m_Meshes[id] = std::move(mesh);
+    }
+    else
+        m_Meshes.push_back(std::move(mesh));
+    return id;
+}
+
+void GeometryArena::removeMesh(uint32_t id) noexcept
+{
+    if (id >= m_Meshes.size() || m_Meshes[id].vertexCount == 0)
+        return;
+
+    ArenaMesh& mesh = m_Meshes[id];
+    release(m_FreeVertices, mesh.baseVertex, mesh.vertexCount);
+    release(m_FreeIndices, mesh.firstIndex, mesh.indexCount);
+    mesh.vertexCount = 0;
+    mesh.indexCount = 0;
+    mesh.lods.clear();
+    m_FreeMeshes.push_back(id);
+
+    // the objects of the mesh are skipped from the next cull
+    if (!m_Objects.empty())
+        m_bObjectsDirty = true;
+}
+
+void GeometryArena::draw(uint32_t id, const glm::mat4& model, const glm::vec4& material, size_t lod) noexcept
+{
+    drawInstanced(id, &model, &material, 1u, lod);
+}
+
+void GeometryArena::drawInstanced(uint32_t id, const glm::mat4* models, const glm::vec4* materials, uint32_t count, size_t lod) noexcept
+{
+    assert(id < m_Meshes.size() && m_Meshes[id].vertexCount > 0);
+    if (count == 0)
+        return;
+
+    const ArenaMesh& mesh = m_Meshes[id];
+    const MeshLod& level = mesh.lods[std::min(lod, mesh.lods.size() - 1)];
+
+    DrawElementsIndirectCommand command;
+    command.count = level.indexCount;
+    command.instanceCount = count;
+    command.firstIndex = mesh.firstIndex + level.firstIndex;
+    command.baseVertex = GLint(mesh.baseVertex);
+    command.baseInstance = GLuint(m_DrawData.size());
+    m_Commands.push_back(command);
+
+    ArenaDrawData data;
+    data.positionScale = glm::vec4(mesh.positionScale, 0.f);
+    data.positionBias = glm::vec4(mesh.positionBias, 0.f);
+    data.material = glm::vec4(0.f);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        data.model = models[i];
+        if (materials)
+            data.material = materials[i];
+        m_DrawData.push_back(data);
+    }
+}
+
+void GeometryArena::flush() noexcept
+{
+    if (m_Commands.empty())
+        return;
+
+    if (!reserveDraws(uint32_t(m_DrawData.size())))
+    {
+        m_Commands.clear();
+        m_DrawData.clear();
+        return;
+    }
+
+    m_CommandBuffer->update(0, m_Commands.size() * sizeof(DrawElementsIndirectCommand), m_Commands.data());
+    m_DrawDataBuffer->update(0, m_DrawData.size() * sizeof(ArenaDrawData), m_DrawData.data());
+    m_DrawDataBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, kDrawDataBinding);
+
+    RenderStateCache::getInstance().bindVertexArray(m_VAO);
+    m_CommandBuffer->bind();
+    GL_ASSERT(glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, GLsizei(m_Commands.size()), 0));
+    m_CommandBuffer->unbind();
+
+    m_Commands.clear();
+    m_DrawData.clear();
+}
+
+uint32_t GeometryArena::addObject(uint32_t id, const glm::mat4& model, const glm::vec4& material) noexcept
+{
+    assert(id < m_Meshes.size() && m_Meshes[id].vertexCount > 0);
+
+    const ArenaMesh& mesh = m_Meshes[id];
+
+    ArenaDrawData data;
+    data.model = model;
+    data.positionScale = glm::vec4(mesh.positionScale, 0.f);
+    data.positionBias = glm::vec4(mesh.positionBias, 0.f);
+    data.material = material;
+    m_Objects.push_back(data);
+    m_ObjectMeshes.push_back(id);
+
+    m_bObjectsDirty = true;
+    return uint32_t(m_Objects.size() - 1);
+}
+
+void GeometryArena::clearObjects() noexcept
+{
+    m_Objects.clear();
+    m_ObjectMeshes.clear();
+    m_bObjectsDirty = true;
+}
+
+void GeometryArena::cullObjects(ProgramShader& cullProgram, const glm::mat4& viewProj, const LodSelector& selector, bool frustum) noexcept
+{
+    if (m_bObjectsDirty && !uploadObjects())
+        m_ObjectCommandCount = 0;
+
+    if (m_ObjectCommandCount == 0)
+    {
+        m_VisibleObjectCount = 0;
+        return;
+    }
+
+    // the count written kObjectCountLatency culls ago, read only when the GPU
+    // is done with it. A count still in flight is dropped, the last one stays
+    const uint32_t slot = m_ObjectCountFrame % kObjectCountLatency;
+    const GraphicsBufferPtr& countBuffer = m_ObjectCountBuffers[slot];
+    GLsync& fence = m_ObjectCountFences[slot];
+    if (fence)
+    {
+        const GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+            countBuffer->read(0, sizeof(uint32_t), &m_VisibleObjectCount);
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    const uint32_t zero = 0u;
+    countBuffer->update(0, sizeof(uint32_t), &zero);
+
+    // empty instance lists
+    m_ObjectCommandBuffer->copy(*m_ObjectCommandTemplate, 0, 0, m_ObjectCommandTemplate->getSize());
+
+    const nv_helpers::Frustum frustumPlanes(glm::value_ptr(viewProj));
+
+    cullProgram.bind();
+    cullProgram.setUniform("uObjectCount", GLint(m_Objects.size()));
+    cullProgram.setUniform("ubFrustum", GLint(frustum));
+    for (int i = 0; i < nv_helpers::Frustum::NUM_PLANES; i++)
+    {
+        const float* plane = frustumPlanes.m_planes[i];
+        cullProgram.setUniform("uFrustumPlanes[" + std::to_string(i) + "]", glm::vec4(plane[0], plane[1], plane[2], plane[3]));
+    }
+    cullProgram.setUniform("uEyePosWS", selector.getEye());
+    cullProgram.setUniform("uPixelsPerUnit", selector.getPixelsPerUnit());
+    cullProgram.setUniform("uLodThreshold", selector.getThreshold());
+
+    m_ObjectDataBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, kDrawDataBinding);
+    m_ObjectMeshBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, kObjectMeshBinding);
+    m_CullMeshBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, kCullMeshBinding);
+    m_ObjectCommandBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, kObjectCommandBinding);
+    m_ObjectIndexBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, kObjectIndexBinding);
+    countBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, kObjectCountBinding);
+
+    cullProgram.Dispatch1D(GLuint(m_Objects.size()), kObjectCullGroupSize);
+    cullProgram.unbind();
+
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_ObjectCountFrame++;
+
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    CHECKGLERROR();
+}
+
+void GeometryArena::drawObjects() const noexcept
+{
+    // nothing was culled since the objects changed
+    if (m_bObjectsDirty || m_ObjectCommandCount == 0)
+        return;
+
+    m_ObjectDataBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, kDrawDataBinding);
+
+    RenderStateCache::getInstance().bindVertexArray(m_ObjectVAO);
+    m_ObjectCommandBuffer->bind();
+    GL_ASSERT(glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, GLsizei(m_ObjectCommandCount), 0));
+    m_ObjectCommandBuffer->unbind();
+}
+
+void GeometryArena::drawImmediate(uint32_t id, size_t lod) const noexcept
+{
+    assert(id < m_Meshes.size() && m_Meshes[id].vertexCount > 0);
+
+    const ArenaMesh& mesh = m_Meshes[id];
+    const MeshLod& level = mesh.lods[std::min(lod, mesh.lods.size() - 1)];
+
+    RenderStateCache::getInstance().bindVertexArray(m_VAO);
+    GL_ASSERT(glDrawElementsBaseVertex(
+        GL_TRIANGLES,
+        level.indexCount,
+        GL_UNSIGNED_INT,
+        (void*)(size_t(mesh.firstIndex + level.firstIndex) * sizeof(uint32_t)),
+        GLint(mesh.baseVertex)));
+}
+
+bool GeometryArena::reserveDraws(uint32_t count) noexcept
+{
+    if (count <= m_DrawCapacity)
+        return true;
+
+    uint32_t capacity = std::max(m_DrawCapacity, 64u);
+    while (capacity < count)
+        capacity *= 2u;
+
+    // the instanced attribute returns baseInstance + instance : the draw index
+    std::vector<uint32_t> drawIndices(capacity);
+    for (uint32_t i = 0; i < capacity; i++)
+        drawIndices[i] = i;
+
+    m_DrawIndexBuffer = GraphicsBuffer::Create(GL_ARRAY_BUFFER, capacity * sizeof(uint32_t), 0, drawIndices.data());
+    m_CommandBuffer = GraphicsBuffer::Create(GL_DRAW_INDIRECT_BUFFER, capacity * sizeof(DrawElementsIndirectCommand), GL_DYNAMIC_STORAGE_BIT);
+    m_DrawDataBuffer = GraphicsBuffer::Create(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(ArenaDrawData), GL_DYNAMIC_STORAGE_BIT);
+    if (!m_DrawIndexBuffer || !m_CommandBuffer || !m_DrawDataBuffer)
+    {
+        fprintf(stderr, "GeometryArena : unable to allocate %u draws.\n", capacity);
+        m_DrawCapacity = 0;
+        return false;
+    }
+
+    RenderStateCache::getInstance().bindVertexArray(m_VAO);
+    m_DrawIndexBuffer->bind();
+    glVertexAttribIPointer(VATTRIB_DRAWINDEX, 1, GL_UNSIGNED_INT, sizeof(uint32_t), nullptr);
+    glVertexAttribDivisor(VATTRIB_DRAWINDEX, 1);
+    glEnableVertexAttribArray(VATTRIB_DRAWINDEX);
+    RenderStateCache::getInstance().bindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    m_DrawCapacity = capacity;
+    return true;
+}
+
+void GeometryArena::releaseCountFences() noexcept
+{
+    for (uint32_t i = 0; i < kObjectCountLatency; i++)
+    {
+        if (m_ObjectCountFences[i])
+            glDeleteSync(m_ObjectCountFences[i]);
+        m_ObjectCountFences[i] = nullptr;
+    }
+    m_ObjectCountFrame = 0;
+}
+
+bool GeometryArena::uploadObjects() noexcept
+{
+    m_bObjectsDirty = false;
+    m_ObjectCommandCount = 0;
+    m_VisibleObjectCount = 0;
+    releaseCountFences();
+    if (m_Objects.empty())
+        return true;
+
+    std::vector<uint32_t> objectCounts(m_Meshes.size(), 0u);
+    for (uint32_t id : m_ObjectMeshes)
+        objectCounts[id]++;
+
+    // One record per mesh in use, each of its levels has room for all its objects
+    std::vector<uint32_t> cullMeshIds(m_Meshes.size(), kInvalidMesh);
+    std::vector<ArenaCullMesh> cullMeshes;
+    std::vector<DrawElementsIndirectCommand> commands;
+    uint32_t instanceCount = 0;
+    for (uint32_t id = 0; id < uint32_t(m_Meshes.size()); id++)
+    {
+        const ArenaMesh& mesh = m_Meshes[id];
+        if (objectCounts[id] == 0 || mesh.vertexCount == 0)
+            continue;
+
+        ArenaCullMesh record = {};
+        record.boundingSphere = mesh.boundingSphere;
+        record.lodCount = uint32_t(std::min(mesh.lods.size(), kMaxMeshLods));
+        record.firstCommand = uint32_t(commands.size());
+        for (uint32_t lod = 0; lod < record.lodCount; lod++)
+        {
+            record.lodErrors[lod] = mesh.lods[lod].error;
+
+            DrawElementsIndirectCommand command;
+            command.count = mesh.lods[lod].indexCount;
+            command.instanceCount = 0;
+            command.firstIndex = mesh.firstIndex + mesh.lods[lod].firstIndex;
+            command.baseVertex = GLint(mesh.baseVertex);
+            command.baseInstance = instanceCount;
+            commands.push_back(command);
+            instanceCount += objectCounts[id];
+        }
+
+        cullMeshIds[id] = uint32_t(cullMeshes.size());
+        cullMeshes.push_back(record);
+    }
+
+    if (commands.empty())
+        return true;
+
+    std::vector<uint32_t> objectMeshes(m_ObjectMeshes.size());
+    for (size_t i = 0; i < m_ObjectMeshes.size(); i++)
+        objectMeshes[i] = cullMeshIds[m_ObjectMeshes[i]];
+
+    const uint32_t zero = 0u;
+    m_ObjectDataBuffer = GraphicsBuffer::Create(GL_SHADER_STORAGE_BUFFER, m_Objects.size() * sizeof(ArenaDrawData), 0, m_Objects.data());
+    m_ObjectMeshBuffer = GraphicsBuffer::Create(GL_SHADER_STORAGE_BUFFER, objectMeshes.size() * sizeof(uint32_t), 0, objectMeshes.data());
+    m_CullMeshBuffer = GraphicsBuffer::Create(GL_SHADER_STORAGE_BUFFER, cullMeshes.size() * sizeof(ArenaCullMesh), 0, cullMeshes.data());
+    m_ObjectCommandTemplate = GraphicsBuffer::Create(GL_COPY_READ_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), 0, commands.data());
+    m_ObjectCommandBuffer = GraphicsBuffer::Create(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), 0);
+    m_ObjectIndexBuffer = GraphicsBuffer::Create(GL_ARRAY_BUFFER, instanceCount * sizeof(uint32_t), 0);
+    bool bCountBuffers = true;
+    for (uint32_t i = 0; i < kObjectCountLatency; i++)
+    {
+        m_ObjectCountBuffers[i] = GraphicsBuffer::Create(GL_SHADER_STORAGE_BUFFER, sizeof(uint32_t), GL_DYNAMIC_STORAGE_BIT, &zero);
+        bCountBuffers = bCountBuffers && m_ObjectCountBuffers[i];
+    }
+    if (!m_ObjectDataBuffer || !m_ObjectMeshBuffer || !m_CullMeshBuffer || !m_ObjectCommandTemplate
+        || !m_ObjectCommandBuffer || !m_ObjectIndexBuffer || !bCountBuffers)
+    {
+        fprintf(stderr, "GeometryArena : unable to allocate %zu objects.\n", m_Objects.size());
+        return false;
+    }
+
+    // the cull writes the object index of each instance
+    RenderStateCache::getInstance().bindVertexArray(m_ObjectVAO);
+    m_ObjectIndexBuffer->bind();
+    glVertexAttribIPointer(VATTRIB_DRAWINDEX, 1, GL_UNSIGNED_INT, sizeof(uint32_t), nullptr);
+    glVertexAttribDivisor(VATTRIB_DRAWINDEX, 1);
+    glEnableVertexAttribArray(VATTRIB_DRAWINDEX);
+    RenderStateCache::getInstance().bindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    m_ObjectCommandCount = uint32_t(commands.size());
+    CHECKGLERROR();
+    return true;
+}
+
+bool GeometryArena::allocate(std::vector<Range>& freeList, uint32_t count, uint32_t& offset) noexcept
+{
+    for (auto it = freeList.begin(); it != freeList.end(); ++it)
+    {
+        if (it->count < count)
+            continue;
+
+        offset = it->offset;
+        it->offset += count;
+        it->count -= count;
+        if (it->count == 0)
+            freeList.erase(it);
+        return true;
+    }
+    return false;
+}
+
+void GeometryArena::release(std::vector<Range>& freeList, uint32_t offset, uint32_t count) noexcept
+{
+    auto next = std::lower_bound(freeList.begin(), freeList.end(), offset,
+        [](const Range& range, uint32_t value) { return range.offset < value; });
+    auto it = freeList.insert(next, Range{ offset, count });
+
+    // merge with the following then the previous range
+    auto following = it + 1;
+    if (following != freeList.end() && it->offset + it->count == following->offset)
+    {
+        it->count += following->count;
+        it = freeList.erase(following) - 1;
+    }
+    if (it != freeList.begin())
+    {
+        auto previous = it - 1;
+        if (previous->offset + previous->count == it->offset)
+        {
+            previous->count += it->count;
+            freeList.erase(it);
+        }
+    }
+}
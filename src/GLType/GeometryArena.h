@@ -0,0 +1,174 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <GraphicsTypes.h>
+#include <GLType/GraphicsBuffer.h>
+#include <GLType/VertexBuffer.h>
+#include <MeshLod.h>
+#include <cstdint>
+#include <vector>
+
+class LodSelector;
+class ProgramShader;
+
+/** std430 layout of the per-draw data read by DrawData.glsli */
+struct ArenaDrawData
+{
+    glm::mat4 model;
+    glm::vec4 positionScale;
+    glm::vec4 positionBias;
+    glm::vec4 material;         // glossiness, reflectivity
+};
+
+/** Ranges of one mesh inside the arena buffers */
+struct ArenaMesh
+{
+    uint32_t baseVertex;
+    uint32_t vertexCount;       // 0 once removed
+    uint32_t firstIndex;
+    uint32_t indexCount;        // of all the levels
+    glm::vec3 positionScale;
+    glm::vec3 positionBias;
+    std::vector<MeshLod> lods;  // relative to firstIndex
+    glm::vec4 boundingSphere;
+};
+
+/**
+ * Vertices and 32-bit indices of many meshes suballocated in two shared
+ * buffers, behind a single VAO. The meshes share the attributes of the arena
+ * layout, only their quantization bounds may differ.
+ *
+ * Draws queued with draw() are submitted by flush() in one
+ * glMultiDrawElementsIndirect. Each command starts at its own baseInstance,
+ * so the instanced VATTRIB_DRAWINDEX attribute gives the shader the index of
+ * its ArenaDrawData. Instanced commands read consecutive records, one per
+ * instance. The per-draw buffers grow with the queue.
+ *
+ * Objects added with addObject() stay in GPU buffers across frames instead :
+ * cullObjects() tests them in a compute pass (frustum and level of detail),
+ * which appends the visible ones to the instance list of their mesh level,
+ * and drawObjects() submits those commands without any per-object CPU work.
+ */
+class GeometryArena final
+{
+public:
+
+    static const uint32_t kInvalidMesh = ~0u;
+    static const GLuint kDrawDataBinding = 0;
+
+    GeometryArena() noexcept;
+    ~GeometryArena() noexcept;
+
+    bool create(const VertexLayout& layout, uint32_t vertexCapacity, uint32_t indexCapacity, uint32_t drawCapacity = 4096) noexcept;
+    void destroy() noexcept;
+
+    /** Same attributes and storage as the arena, whatever the position bounds */
+    bool isCompatible(const VertexLayout& layout) const noexcept;
+
+    /** Copy packed vertices and their indices, kInvalidMesh when full or incompatible */
+    uint32_t addMesh(
+        const VertexLayout& layout,
+        const void* vertices,
+        uint32_t vertexCount,
+        const uint32_t* indices,
+        uint32_t indexCount,
+        const std::vector<MeshLod>& lods,
+        const glm::vec4& boundingSphere) noexcept;
+    void removeMesh(uint32_t mesh) noexcept;
+
+    const ArenaMesh& getMesh(uint32_t mesh) const noexcept { return m_Meshes[mesh]; }
+
+    /** Queue a draw of one level for the next flush */
+    void draw(uint32_t mesh, const glm::mat4& model, const glm::vec4& material = glm::vec4(0.f), size_t lod = 0) noexcept;
+
+    /** Queue 'count' instances of one level as a single command, 'materials' may be null */
+    void drawInstanced(uint32_t mesh, const glm::mat4* models, const glm::vec4* materials, uint32_t count, size_t lod = 0) noexcept;
+
+    /** Upload the queued draws and submit them at once */
+    void flush() noexcept;
+
+    /** Keep an object drawn by drawObjects(), its buffers are uploaded by the next cull */
+    uint32_t addObject(uint32_t mesh, const glm::mat4& model, const glm::vec4& material = glm::vec4(0.f)) noexcept;
+    void clearObjects() noexcept;
+    uint32_t getObjectCount() const noexcept { return uint32_t(m_Objects.size()); }
+
+    /**
+     * Select the visible objects and their level on the GPU, with 'cullProgram'
+     * built from "DrawCull.Compute". Without 'frustum' only the levels are picked.
+     */
+    void cullObjects(ProgramShader& cullProgram, const glm::mat4& viewProj, const LodSelector& selector, bool frustum = true) noexcept;
+
+    /** Submit the objects kept by the last cull, one command per mesh level */
+    void drawObjects() const noexcept;
+
+    /** Objects kept by a recent cull, read back once its fence has signaled */
+    uint32_t getVisibleObjectCount() const noexcept { return m_VisibleObjectCount; }
+
+    /** Draw one level now, with the uniforms of the bound program */
+    void drawImmediate(uint32_t mesh, size_t lod = 0) const noexcept;
+
+    const VertexLayout& getLayout() const noexcept { return m_Layout; }
+    GLuint getVAO() const noexcept { return m_VAO; }
+
+    static const GLuint kObjectCullGroupSize = 64;
+
+    /** Culls in flight before their visible count is read back */
+    static const uint32_t kObjectCountLatency = 3;
+
+private:
+
+    struct Range
+    {
+        uint32_t offset;
+        uint32_t count;
+    };
+
+    /** First fit in a free list sorted by offset */
+    static bool allocate(std::vector<Range>& freeList, uint32_t count, uint32_t& offset) noexcept;
+    static void release(std::vector<Range>& freeList, uint32_t offset, uint32_t count) noexcept;
+
+    /** Room for 'count' draw records (and as many commands) */
+    bool reserveDraws(uint32_t count) noexcept;
+
+    /** Upload the objects, their mesh records and the command templates */
+    bool uploadObjects() noexcept;
+
+    /** Forget the counts in flight, their buffers are going away */
+    void releaseCountFences() noexcept;
+
+    VertexLayout m_Layout;
+    GLuint m_VAO;
+    uint32_t m_DrawCapacity;
+
+    GraphicsBufferPtr m_VertexBuffer;
+    GraphicsBufferPtr m_IndexBuffer;
+    GraphicsBufferPtr m_DrawIndexBuffer;
+    GraphicsBufferPtr m_CommandBuffer;
+    GraphicsBufferPtr m_DrawDataBuffer;
+
+    std::vector<Range> m_FreeVertices;
+    std::vector<Range> m_FreeIndices;
+    std::vector<ArenaMesh> m_Meshes;
+    std::vector<uint32_t> m_FreeMeshes;
+
+    std::vector<DrawElementsIndirectCommand> m_Commands;
+    std::vector<ArenaDrawData> m_DrawData;
+
+    // Objects : the instance lists are written by the cull, the VAO reads them
+    GLuint m_ObjectVAO;
+    bool m_bObjectsDirty;
+    uint32_t m_ObjectCommandCount;
+    uint32_t m_VisibleObjectCount;
+    std::vector<ArenaDrawData> m_Objects;
+    std::vector<uint32_t> m_ObjectMeshes;
+    GraphicsBufferPtr m_ObjectDataBuffer;
+    GraphicsBufferPtr m_ObjectMeshBuffer;
+    GraphicsBufferPtr m_CullMeshBuffer;
+    GraphicsBufferPtr m_ObjectCommandTemplate;
+    GraphicsBufferPtr m_ObjectCommandBuffer;
+    GraphicsBufferPtr m_ObjectIndexBuffer;
+    GraphicsBufferPtr m_ObjectCountBuffers[kObjectCountLatency];
+    GLsync m_ObjectCountFences[kObjectCountLatency];
+    uint32_t m_ObjectCountFrame;
+};
@@ -0,0 +1,86 @@
+#include "GraphicsBuffer.h"
+#include <cassert>
+#include <memory>
+
+GraphicsBufferPtr GraphicsBuffer::Create(GLenum target, GLsizeiptr size, GLbitfield flags, const void* data) noexcept
+{
+    auto buffer = std::make_shared<GraphicsBuffer>();
+    if (buffer->create(target, size, flags, data))
+        return buffer;
+    return nullptr;
+}
+
+GraphicsBuffer::GraphicsBuffer() noexcept :
+    m_BufferID(GL_NONE),
+    m_Target(GL_INVALID_ENUM),
+    m_Size(0)
+{
+}
+
+GraphicsBuffer::~GraphicsBuffer() noexcept
+{
+    destroy();
+}
+
+bool GraphicsBuffer::create(GLenum target, GLsizeiptr size, GLbitfield flags, const void* data) noexcept
+{
+    assert(m_BufferID == GL_NONE);
+    assert(size > 0);
+
+    glCreateBuffers(1, &m_BufferID);
+    glNamedBufferStorage(m_BufferID, size, data, flags);
+
+    m_Target = target;
+    m_Size = size;
+
+    return true;
+}
+
+void GraphicsBuffer::destroy() noexcept
+{
+    if (m_BufferID != GL_NONE)
+    {
+        glDeleteBuffers(1, &m_BufferID);
+        m_BufferID = GL_NONE;
+    }
+    m_Target = GL_INVALID_ENUM;
+    m_Size = 0;
+}
+
+void GraphicsBuffer::bind() const noexcept
+{
+    assert(m_BufferID != GL_NONE);
+    glBindBuffer(m_Target, m_BufferID);
+}
+
+void GraphicsBuffer::unbind() const noexcept
+{
+    glBindBuffer(m_Target, GL_NONE);
+}
+
+void GraphicsBuffer::bindBase(GLenum target, GLuint index) const noexcept
+{
+    assert(m_BufferID != GL_NONE);
+    glBindBufferBase(target, index, m_BufferID);
+}
+
+void GraphicsBuffer::update(GLintptr offset, GLsizeiptr size, const void* data) noexcept
+{
+    assert(m_BufferID != GL_NONE);
+    assert(offset + size <= m_Size);
+    glNamedBufferSubData(m_BufferID, offset, size, data);
+}
+
+void GraphicsBuffer::copy(const GraphicsBuffer& source, GLintptr sourceOffset, GLintptr offset, GLsizeiptr size) noexcept
+{
+    assert(m_BufferID != GL_NONE && source.m_BufferID != GL_NONE);
+    assert(sourceOffset + size <= source.m_Size && offset + size <= m_Size);
+    glCopyNamedBufferSubData(source.m_BufferID, m_BufferID, sourceOffset, offset, size);
+}
+
+void GraphicsBuffer::read(GLintptr offset, GLsizeiptr size, void* data) const noexcept
+{
+    assert(m_BufferID != GL_NONE);
+    assert(offset + size <= m_Size);
+    glGetNamedBufferSubData(m_BufferID, offset, size, data);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <GraphicsTypes.h>
+
+/** Layout of glDrawElementsIndirect arguments */
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+class GraphicsBuffer final
+{
+public:
+
+    static GraphicsBufferPtr Create(GLenum target, GLsizeiptr size, GLbitfield flags, const void* data = nullptr) noexcept;
+
+    GraphicsBuffer() noexcept;
+    ~GraphicsBuffer() noexcept;
+
+    bool create(GLenum target, GLsizeiptr size, GLbitfield flags, const void* data = nullptr) noexcept;
+    void destroy() noexcept;
+
+    /** Bind to the buffer's own target */
+    void bind() const noexcept;
+    void unbind() const noexcept;
+
+    /** Bind to an indexed target (GL_SHADER_STORAGE_BUFFER, GL_UNIFORM_BUFFER, ...) */
+    void bindBase(GLenum target, GLuint index) const noexcept;
+
+    /** Upload 'size' bytes at 'offset', requires GL_DYNAMIC_STORAGE_BIT */
+    void update(GLintptr offset, GLsizeiptr size, const void* data) noexcept;
+
+    /** Copy 'size' bytes of 'source' from 'sourceOffset' to 'offset', on the GPU */
+    void copy(const GraphicsBuffer& source, GLintptr sourceOffset, GLintptr offset, GLsizeiptr size) noexcept;
+
+    /** Read back 'size' bytes at 'offset', waits for the commands writing them */
+    void read(GLintptr offset, GLsizeiptr size, void* data) const noexcept;
+
+    GLuint getBufferID() const noexcept { return m_BufferID; }
+    GLenum getTarget() const noexcept { return m_Target; }
+    GLsizeiptr getSize() const noexcept { return m_Size; }
+
+private:
+
+    GLuint m_BufferID;
+    GLenum m_Target;
+    GLsizeiptr m_Size;
+};
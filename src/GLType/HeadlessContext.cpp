@@ -0,0 +1,210 @@
+#include "HeadlessContext.h"
+#include <cstdio>
+#include <cstring>
+
+#ifdef LIGHTPROBE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#else
+#include <glfw3.h>
+#endif
+
+#ifdef LIGHTPROBE_EGL
+
+namespace
+{
+    bool hasExtension(const char* extensions, const char* name)
+    {
+        if (!extensions)
+            return false;
+
+        const size_t length = strlen(name);
+        for (const char* it = strstr(extensions, name); it; it = strstr(it + length, name))
+        {
+            if ((it == extensions || it[-1] == ' ') && (it[length] == ' ' || it[length] == '\0'))
+                return true;
+        }
+        return false;
+    }
+
+    EGLDisplay getHeadlessDisplay()
+    {
+        const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (!getPlatformDisplay)
+            return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+        if (hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless"))
+        {
+            EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+            if (display != EGL_NO_DISPLAY)
+                return display;
+        }
+
+        if (hasExtension(clientExtensions, "EGL_EXT_platform_device"))
+        {
+            auto queryDevices = (PFNEGLQUERYDEVICESEXTPROC)eglGetProcAddress("eglQueryDevicesEXT");
+            EGLDeviceEXT device;
+            EGLint count = 0;
+            if (queryDevices && queryDevices(1, &device, &count) && count > 0)
+            {
+                EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_DEVICE_EXT, device, nullptr);
+                if (display != EGL_NO_DISPLAY)
+                    return display;
+            }
+        }
+
+        return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+}
+#endif
+
+HeadlessContext::HeadlessContext() noexcept :
+    m_Display(nullptr),
+    m_Surface(nullptr),
+    m_Context(nullptr)
+{
+}
+
+HeadlessContext::~HeadlessContext() noexcept
+{
+    destroy();
+}
+
+#ifdef LIGHTPROBE_EGL
+
+bool HeadlessContext::create(int32_t major, int32_t minor, bool debug) noexcept
+{
+    EGLDisplay display = getHeadlessDisplay();
+    EGLint eglMajor = 0, eglMinor = 0;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &eglMajor, &eglMinor))
+    {
+        fprintf(stderr, "HeadlessContext : no EGL display (0x%x).\n", eglGetError());
+        return false;
+    }
+    m_Display = display;
+
+    const bool surfaceless = hasExtension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context");
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglBindAPI(EGL_OPENGL_API) || !eglChooseConfig(display, configAttribs, &config, 1, &configCount) || configCount == 0)
+    {
+        fprintf(stderr, "HeadlessContext : no OpenGL config on EGL %d.%d (0x%x).\n", eglMajor, eglMinor, eglGetError());
+        destroy();
+        return false;
+    }
+
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION_KHR, major,
+        EGL_CONTEXT_MINOR_VERSION_KHR, minor,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+        EGL_CONTEXT_FLAGS_KHR, debug ? EGL_CONTEXT_OPENGL_DEBUG_BIT_KHR : 0,
+        EGL_NONE
+    };
+    m_Context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (m_Context == EGL_NO_CONTEXT)
+    {
+        fprintf(stderr, "HeadlessContext : unable to create an OpenGL %d.%d core context (0x%x).\n", major, minor, eglGetError());
+        destroy();
+        return false;
+    }
+
+    // the bakes render to framebuffer objects, the surface is only there to make the context current
+    if (!surfaceless)
+    {
+        const EGLint pbufferAttribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+        m_Surface = eglCreatePbufferSurface(display, config, pbufferAttribs);
+        if (m_Surface == EGL_NO_SURFACE)
+        {
+            fprintf(stderr, "HeadlessContext : unable to create a pbuffer (0x%x).\n", eglGetError());
+            destroy();
+            return false;
+        }
+    }
+
+    if (!eglMakeCurrent(display, m_Surface, m_Surface, m_Context))
+    {
+        fprintf(stderr, "HeadlessContext : unable to make the context current (0x%x).\n", eglGetError());
+        destroy();
+        return false;
+    }
+    return true;
+}
+
+void HeadlessContext::destroy() noexcept
+{
+    if (!m_Display)
+        return;
+
+    eglMakeCurrent(m_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (m_Context)
+        eglDestroyContext(m_Display, m_Context);
+    if (m_Surface)
+        eglDestroySurface(m_Display, m_Surface);
+    eglTerminate(m_Display);
+
+    m_Display = nullptr;
+    m_Surface = nullptr;
+    m_Context = nullptr;
+}
+
+bool HeadlessContext::isCurrent() const noexcept
+{
+    return m_Context && eglGetCurrentContext() == m_Context;
+}
+
+#else
+
+bool HeadlessContext::create(int32_t major, int32_t minor, bool debug) noexcept
+{
+    // the context still needs a display, its window just stays hidden
+    if (!glfwInit())
+    {
+        fprintf(stderr, "HeadlessContext : failed to initialize GLFW.\n");
+        return false;
+    }
+
+    glfwDefaultWindowHints();
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, debug ? GLFW_TRUE : GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, major);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, minor);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GLFW_TRUE);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+    GLFWwindow* window = glfwCreateWindow(1, 1, "", nullptr, nullptr);
+    if (!window)
+    {
+        fprintf(stderr, "HeadlessContext : unable to create an OpenGL %d.%d core context.\n", major, minor);
+        glfwTerminate();
+        return false;
+    }
+    glfwMakeContextCurrent(window);
+    m_Context = window;
+    return true;
+}
+
+void HeadlessContext::destroy() noexcept
+{
+    if (!m_Context)
+        return;
+
+    glfwDestroyWindow(static_cast<GLFWwindow*>(m_Context));
+    glfwTerminate();
+    m_Context = nullptr;
+}
+
+bool HeadlessContext::isCurrent() const noexcept
+{
+    return m_Context && glfwGetCurrentContext() == m_Context;
+}
+
+#endif
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * OpenGL core context without window nor display server, for the offline
+ * bakes. EGL picks the Mesa surfaceless platform first (hardware drivers and
+ * llvmpipe), then the first EGL device, then the default display with a 1x1
+ * pbuffer when surfaceless contexts are not supported.
+ *
+ * Builds without LIGHTPROBE_EGL fall back to a hidden GLFW window, which
+ * still needs a display.
+ */
+class HeadlessContext final
+{
+public:
+
+    HeadlessContext() noexcept;
+    ~HeadlessContext() noexcept;
+
+    bool create(int32_t major, int32_t minor, bool debug = false) noexcept;
+    void destroy() noexcept;
+
+    bool isCurrent() const noexcept;
+
+private:
+
+    void* m_Display;
+    void* m_Surface;
+    void* m_Context;
+};
@@ -32,6 +32,7 @@
 #include <GLType/ProgramManager.h>
 #include <tools/misc.hpp>
 #include <cstdarg>
+#include <cstring>
 
 namespace nv_helpers_gl
 {
@@ -92,24 +93,138 @@ namespace nv_helpers_gl
         }
     }
 
-    std::string getContent(std::string const & name, const std::vector<std::string>& directories, 
+    const std::string& IncludeCache::getContent(std::string const & name,
+        const std::vector<std::string>& directories,
         const IncludeRegistry &includes,
         std::string & filename)
     {
         // check registered includes first
-        for(std::size_t i = 0; i < includes.size(); ++i)
+        IncludeRegistry::const_iterator registered = includes.find(name);
+        const bool bRegistered = (registered != includes.end());
+
+        // only probe the directories the first time a name is seen
+        auto resolved = m_resolved.find(name);
+        if (resolved == m_resolved.end())
+        {
+            std::string path = nv_helpers::findFile(bRegistered ? registered->second.filename : name, directories);
+            resolved = m_resolved.emplace(name, path).first;
+        }
+        filename = resolved->second;
+
+        // reload only when the file changed since the last time it was read
+        const nv_helpers::FileStamp stamp = nv_helpers::fileStamp(filename);
+        auto cached = m_files.find(filename);
+        if (cached != m_files.end() && cached->second.stamp == stamp)
+            return cached->second.content;
+
+        CachedFile file;
+        file.stamp = stamp;
+        file.content = nv_helpers::loadFile(filename, !bRegistered || registered->second.content.empty());
+        if (file.content.empty() && bRegistered)
+            file.content = registered->second.content;
+
+        CachedFile& entry = m_files[filename];
+        entry = std::move(file);
+        return entry.content;
+    }
+
+    void IncludeCache::addDependency(std::string const & tag, std::string const & filename)
+    {
+        m_dependencies[tag].insert(filename);
+    }
+
+    void IncludeCache::clearDependencies(std::string const & tag)
+    {
+        m_dependencies.erase(tag);
+    }
+
+    const IncludeCache::FileSet& IncludeCache::getDependencies(std::string const & tag) const
+    {
+        static const FileSet empty;
+        auto it = m_dependencies.find(tag);
+        return (it != m_dependencies.end()) ? it->second : empty;
+    }
+
+    std::vector<std::string> IncludeCache::getDependents(std::string const & filename) const
+    {
+        std::vector<std::string> tags;
+        for (auto& it : m_dependencies)
         {
-            if(includes[i].name != name) continue;
+            if (it.second.count(filename) > 0)
+                tags.push_back(it.first);
+        }
+        return tags;
+    }
+
+    bool IncludeCache::isOutdated(std::string const & filename) const
+    {
+        auto cached = m_files.find(filename);
+        if (cached == m_files.end()) return true;
+        return cached->second.stamp != nv_helpers::fileStamp(filename);
+    }
+
+    void IncludeCache::invalidate(std::string const & filename)
+    {
+        m_files.erase(filename);
+    }
+
+    void IncludeCache::clear()
+    {
+        m_resolved.clear();
+        m_files.clear();
+        m_dependencies.clear();
+    }
 
-            filename = nv_helpers::findFile(includes[i].filename, directories);
-            std::string content = nv_helpers::loadFile(filename, includes[i].content.empty());
-            if(content.empty()) return includes[i].content;
-            return content;
+    // Paste an include, expanding the ones it includes itself. Every file ends in the tag's dependencies
+    static void appendInclude(
+        std::string & text,
+        std::string const & tag,
+        std::string const & name,
+        int depth,
+        const std::vector<std::string>& directories,
+        const IncludeRegistry &includes,
+        IncludeCache &cache)
+    {
+        std::string PathName;
+        // copied, the nested includes may reload the cache entry
+        const std::string Source = cache.getContent(name, directories, includes, PathName);
+        cache.addDependency(tag, PathName);
+
+        assert(!Source.empty());
+        if(Source.empty())
+            return;
+
+        if(depth > 16)
+        {
+            fprintf(stderr, "%s : includes nested too deep at \"%s\"\n", tag.c_str(), name.c_str());
+            return;
         }
 
-        // fall back
-        filename = nv_helpers::findFile(name, directories);
-        return nv_helpers::loadFile(filename);
+    #if NV_LINE_MARKERS
+        text += markerString(1, PathName, 1);
+    #endif
+        std::string line;
+        int lineCount = 0;
+        for(std::size_t begin = 0; begin < Source.size(); )
+        {
+            std::size_t eol = Source.find('\n', begin);
+            line.assign(Source, begin, eol == std::string::npos ? std::string::npos : eol - begin);
+            begin = (eol == std::string::npos) ? Source.size() : eol + 1;
+            lineCount++;
+
+            std::size_t Offset = line.find("#include");
+            std::size_t CommentOffset = line.find("//");
+            if(Offset != std::string::npos && (CommentOffset == std::string::npos || CommentOffset > Offset))
+            {
+                appendInclude(text, tag, parseInclude(line, Offset), depth + 1, directories, includes, cache);
+            #if NV_LINE_MARKERS
+                text += std::string("\n") + markerString(lineCount + 1, PathName, 1);
+            #endif
+                continue;
+            }
+
+            text += line + "\n";
+        }
     }
 
     std::string manualInclude (
@@ -117,27 +232,48 @@ namespace nv_helpers_gl
         std::string const & source,
         std::string const & prepend,
         const std::vector<std::string>& directories,
-        const IncludeRegistry &includes)
+        const IncludeRegistry &includes,
+        IncludeCache &cache)
+    {
+        return manualInclude(filenameorig, source.data(), source.size(), 1, prepend, directories, includes, cache);
+    }
+
+    std::string manualInclude (
+        std::string const & filenameorig,
+        const char* source,
+        std::size_t length,
+        int firstLine,
+        std::string const & prepend,
+        const std::vector<std::string>& directories,
+        const IncludeRegistry &includes,
+        IncludeCache &cache)
     {
         std::string filename = filenameorig;
         // std::string source = getContent(filenameorig, directories, includes, filename);
 
-        if(source.empty()){
+        if(length == 0){
             return std::string();
         }
 
-        std::stringstream stream;
-        stream << source;
+        // the includes are collected again below
+        cache.clearDependencies(filenameorig);
+
         std::string line, text;
+        text.reserve(length + prepend.size());
 
         // Handle command line defines
         text += prepend;
     #if NV_LINE_MARKERS
-        text += markerString(1, filename, 0);
+        text += markerString(firstLine, filename, 0);
     #endif
-        int lineCount = 0;
-        while(std::getline(stream, line))
+        int lineCount = firstLine - 1;
+        const char* end = source + length;
+        for(const char* begin = source; begin < end; )
         {
+            const char* eol = static_cast<const char*>(memchr(begin, '\n', end - begin));
+            line.assign(begin, eol ? eol : end);
+            begin = eol ? eol + 1 : end;
+
             std::size_t Offset = 0;
             lineCount++;
 
@@ -162,25 +298,10 @@ namespace nv_helpers_gl
                 if(CommentOffset != std::string::npos && CommentOffset < Offset)
                     continue;
 
-                std::string Include = parseInclude(line, Offset);
-
-                {
-                    std::string PathName;
-                    std::string Source = getContent(Include, directories, includes, PathName);
-
-                    assert(!Source.empty());
-
-                    if(!Source.empty())
-                    {
-                    #if NV_LINE_MARKERS
-                        text += markerString(1, PathName, 1);
-                    #endif
-                        text += Source;
-                    #if NV_LINE_MARKERS
-                        text += std::string("\n") + markerString(lineCount + 1, filename, 0);
-                    #endif
-                    }
-                }
+                appendInclude(text, filenameorig, parseInclude(line, Offset), 1, directories, includes, cache);
+            #if NV_LINE_MARKERS
+                text += std::string("\n") + markerString(lineCount + 1, filename, 0);
+            #endif
 
                 continue;
             }
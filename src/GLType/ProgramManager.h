@@ -1,5 +1,10 @@
+#pragma once
+
 #include <string>
 #include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <tools/misc.hpp>
 
 namespace nv_helpers_gl
 {
@@ -9,12 +14,73 @@ namespace nv_helpers_gl
       std::string   content;
     };
 
-    typedef std::vector<IncludeEntry> IncludeRegistry;
+    typedef std::unordered_map<std::string, IncludeEntry> IncludeRegistry;
+
+    /**
+     * Keeps the content of included files in memory, keyed by their resolved path.
+     * A file is only read again when its modification time changed, and every
+     * shader tag remembers which files it pulled in so that a change can be
+     * traced back to the shaders which need a rebuild.
+     */
+    class IncludeCache
+    {
+    public:
+        typedef std::unordered_set<std::string> FileSet;
+
+        /** Return the content of an include, resolving and loading it on first use */
+        const std::string& getContent(
+            std::string const & name,
+            const std::vector<std::string>& directories,
+            const IncludeRegistry &includes,
+            std::string & filename);
+
+        /** Record that the shader 'tag' includes 'filename' */
+        void addDependency(std::string const & tag, std::string const & filename);
+
+        /** Forget the includes of 'tag' (before preprocessing it again) */
+        void clearDependencies(std::string const & tag);
+
+        /** Files included by the shader 'tag' */
+        const FileSet& getDependencies(std::string const & tag) const;
+
+        /** Shader tags including 'filename' */
+        std::vector<std::string> getDependents(std::string const & filename) const;
+
+        /** True when 'filename' changed on disk since it was cached */
+        bool isOutdated(std::string const & filename) const;
+
+        /** Drop the content of 'filename', it will be read on next use */
+        void invalidate(std::string const & filename);
+
+        void clear();
+
+    private:
+        struct CachedFile {
+          std::string   content;
+          nv_helpers::FileStamp stamp;
+        };
+
+        std::unordered_map<std::string, std::string> m_resolved;   // include name -> path
+        std::unordered_map<std::string, CachedFile> m_files;       // path -> content
+        std::unordered_map<std::string, FileSet> m_dependencies;   // shader tag -> paths
+    };
 
     std::string manualInclude (
         std::string const & filenameorig,
         std::string const & source,
         std::string const & prepend,
         const std::vector<std::string>& directories,
-        const IncludeRegistry &includes);
+        const IncludeRegistry &includes,
+        IncludeCache &cache);
+
+    /** Same, reading 'length' bytes of 'source' which starts at line 'firstLine' */
+    std::string manualInclude (
+        std::string const & filenameorig,
+        const char* source,
+        std::size_t length,
+        int firstLine,
+        std::string const & prepend,
+        const std::vector<std::string>& directories,
+        const IncludeRegistry &includes,
+        IncludeCache &cache);
 }
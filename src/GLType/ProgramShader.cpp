@@ -7,19 +7,55 @@
 
 #include <cstdio>
 #include <cassert>
+#include <algorithm>
 
 #include <GL/glew.h>
 #include <glm/gtc/type_ptr.hpp>
-#include <glsw/glsw.h>
 
 #include <tools/gltools.hpp>
 #include <tools/Logger.hpp>
 #include <GLType/BaseTexture.h>
+#include <GLType/GraphicsBuffer.h>
 #include <GLType/ProgramManager.h>
+#include <GLType/VertexBuffer.h>
+#include <tools/misc.hpp>
 
 #include "ProgramShader.h"
 
-static std::vector<std::string> directory = { ".", "./shaders" };
+std::vector<std::string> ProgramShader::directory = { ".", "./shaders" };
+nv_helpers_gl::IncludeRegistry ProgramShader::s_includes;
+nv_helpers_gl::IncludeCache ProgramShader::s_includeCache;
+ShaderLibrary ProgramShader::s_library;
+
+namespace {
+    // Programs alive, never freed so that static ProgramShader can unregister at exit
+    std::vector<ProgramShader*>& livePrograms()
+    {
+        static std::vector<ProgramShader*>* programs = new std::vector<ProgramShader*>();
+        return *programs;
+    }
+
+    void setProgramParameters(GLuint program)
+    {
+#ifdef GL_ARB_separate_shader_objects
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_FALSE);
+        glProgramParameteri(program, GL_PROGRAM_SEPARABLE, GL_FALSE);
+#endif
+    }
+
+    // "IblMesh.Fragment" -> "IblMesh"
+    std::string effectName(const std::string &tag)
+    {
+        return tag.substr(0, tag.find('.'));
+    }
+
+    // "./shaders/IblMesh.glsl" -> "IblMesh"
+    std::string fileStem(const std::string &filename)
+    {
+        std::string name = nv_helpers::getFileName(filename);
+        return name.substr(0, name.find_last_of('.'));
+    }
+}
 
 void ProgramShader::initalize()
 {
@@ -27,45 +63,40 @@ void ProgramShader::initalize()
         m_id = glCreateProgram();
     }
 
-#ifdef GL_ARB_separate_shader_objects
-    glProgramParameteri(m_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_FALSE);
-    glProgramParameteri(m_id, GL_PROGRAM_SEPARABLE, GL_FALSE);
-#endif
+    setProgramParameters(m_id);
+
+    auto& programs = livePrograms();
+    if (std::find(programs.begin(), programs.end(), this) == programs.end())
+        programs.push_back(this);
 }
 
 void ProgramShader::destroy()
 {
     if(m_id) {
+        RenderStateCache::getInstance().onProgramDeleted(m_id);
         glDeleteProgram(m_id);
         m_id = 0;
     }
+    m_stages.clear();
+    m_uniformLocations.clear();
+    m_vertexLayoutLocations = VertexLayoutLocations();
+    auto& programs = livePrograms();
+    programs.erase(std::remove(programs.begin(), programs.end(), this), programs.end());
 }
 
-void ProgramShader::addShader(GLenum shaderType, const std::string &tag)
+GLuint ProgramShader::compileShader(GLenum shaderType, const std::string &tag)
 {
-    // require initialization
-    assert(m_id > 0);
-
-    if (glswGetError() != 0) {
-        fprintf(stderr, "GLSW : %s", glswGetError());
-    }
-    assert(glswGetError() == 0);
-
     const char* cTag = tag.c_str();
-    const GLchar *source = glswGetShader(cTag);
 
-    if (0 == source)
+    ShaderSource source;
+    if (!s_library.getShader(tag, source))
     {
         fprintf(stderr, "Error : shader \"%s\" not found, check your directory.\n", cTag);
-        fprintf(stderr, "Execution terminated.\n");
-        exit(EXIT_FAILURE);
+        return 0;
     }
 
-    // HACK
-    static nv_helpers_gl::IncludeRegistry m_includes;
-    static std::vector<std::string> directory = { ".", "./shaders" };
-    const std::string content(source);
-    const std::string preprocessed = nv_helpers_gl::manualInclude(tag, content, "", directory, m_includes);
+    const std::string preprocessed = nv_helpers_gl::manualInclude(tag, source.data, source.length, source.line,
+        source.directives, directory, s_includes, s_includeCache);
     char const* sourcePointer = preprocessed.c_str();
     GLuint shader = glCreateShader(shaderType);
     glShaderSource(shader, 1, &sourcePointer, 0);
@@ -79,17 +110,112 @@ void ProgramShader::addShader(GLenum shaderType, const std::string &tag)
         //Logger::getInstance().write( "shader \"%s\" compilation failed.\n", cTag);
         fprintf(stderr, "%s compilation failed.\n", cTag);
         gltools::printShaderLog(shader);
-        exit(EXIT_FAILURE);
+        glDeleteShader(shader);
+        return 0;
     }
 
     //Logger::getInstance().write( "%s compiled.\n", cTag);
     fprintf(stderr, "%s compiled.\n", cTag);
 
+    return shader;
+}
+
+void ProgramShader::addShader(GLenum shaderType, const std::string &tag)
+{
+    // require initialization
+    assert(m_id > 0);
+
+    GLuint shader = compileShader(shaderType, tag);
+    if (0 == shader)
+    {
+        fprintf(stderr, "Execution terminated.\n");
+        exit(EXIT_FAILURE);
+    }
+
     glAttachShader(m_id, shader);
     glDeleteShader(shader);     //flag for deletion
+
+    m_stages.push_back({ shaderType, tag });
+}
+
+bool ProgramShader::reload()
+{
+    assert(m_id > 0);
+
+    // Build a new program aside, the current one stays in use until it links
+    GLuint program = glCreateProgram();
+    setProgramParameters(program);
+
+    for (auto& stage : m_stages)
+    {
+        GLuint shader = compileShader(stage.type, stage.tag);
+        if (0 == shader)
+        {
+            glDeleteProgram(program);
+            return false;
+        }
+        glAttachShader(program, shader);
+        glDeleteShader(shader);
+    }
+
+    glLinkProgram(program);
+
+    GLint status = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE)
+    {
+        fprintf(stderr, "program linking failed.\n");
+        gltools::printProgramLog(program);
+        glDeleteProgram(program);
+        return false;
+    }
+
+    RenderStateCache::getInstance().onProgramDeleted(m_id);
+    glDeleteProgram(m_id);
+    m_id = program;
+    resetUniformLocations();
+    queryWorkGroupSize();
+    return true;
 }
 
+bool ProgramShader::dependsOn(const std::string &filename) const
+{
+    const std::string stem = fileStem(filename);
+    for (auto& stage : m_stages)
+    {
+        if (effectName(stage.tag) == stem)
+            return true;
+        if (s_includeCache.getDependencies(stage.tag).count(filename) > 0)
+            return true;
+    }
+    return false;
+}
 
+std::vector<ProgramShader*> ProgramShader::reloadModified(const std::vector<std::string> &filenames)
+{
+    std::vector<ProgramShader*> affected;
+    for (auto& filename : filenames)
+    {
+        // drop the cached sources so that they are read again
+        s_includeCache.invalidate(filename);
+        s_library.reloadEffect(filename);
+
+        for (auto program : livePrograms())
+        {
+            if (!program->dependsOn(filename)) continue;
+            if (std::find(affected.begin(), affected.end(), program) == affected.end())
+                affected.push_back(program);
+        }
+    }
+
+    std::vector<ProgramShader*> reloaded;
+    for (auto program : affected)
+    {
+        if (program->reload())
+            reloaded.push_back(program);
+    }
+    return reloaded;
+}
 
 bool ProgramShader::link()
 {
@@ -105,14 +231,62 @@ bool ProgramShader::link()
         return false;
     }
 
+    resetUniformLocations();
+    queryWorkGroupSize();
+
     return true;
 }
 
+void ProgramShader::resetUniformLocations()
+{
+    m_uniformLocations.clear();
+
+    m_vertexLayoutLocations.positionScale = getUniformLocation("uPositionScale");
+    m_vertexLayoutLocations.positionBias = getUniformLocation("uPositionBias");
+    m_vertexLayoutLocations.octNormal = getUniformLocation("ubOctNormal");
+}
+
+void ProgramShader::queryWorkGroupSize()
+{
+    m_workGroupSize = glm::uvec3(0u);
+
+    // only valid on programs with a compute shader
+    for (auto& stage : m_stages)
+    {
+        if (stage.type != GL_COMPUTE_SHADER) continue;
+
+        GLint size[3] = { 0, 0, 0 };
+        glGetProgramiv(m_id, GL_COMPUTE_WORK_GROUP_SIZE, size);
+        m_workGroupSize = glm::uvec3(size[0], size[1], size[2]);
+        break;
+    }
+}
+
+void ProgramShader::DispatchIndirect( const GraphicsBufferPtr& buffer, GLintptr offset )
+{
+    assert(buffer != nullptr);
+    assert(offset + GLintptr(sizeof(DispatchIndirectCommand)) <= buffer->getSize());
+
+    // make the arguments written by a previous pass visible to the command processor
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, buffer->getBufferID());
+    glDispatchComputeIndirect(offset);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+}
+
+
 
+GLint ProgramShader::getUniformLocation(const std::string &name) const
+{
+    auto it = m_uniformLocations.find(name);
+    if (it == m_uniformLocations.end())
+        it = m_uniformLocations.emplace(name, glGetUniformLocation(m_id, name.c_str())).first;
+    return it->second;
+}
 
 bool ProgramShader::setUniform(const std::string &name, GLint v) const
 {
-    GLint loc = glGetUniformLocation(m_id, name.c_str());
+    GLint loc = getUniformLocation(name);
 
     if(-1 == loc)
     {
@@ -120,14 +294,14 @@ bool ProgramShader::setUniform(const std::string &name, GLint v) const
         return false;
     }
 
-    glUniform1i(loc, v);
+    setUniform(loc, v);
     return true;
 }
 
 
 bool ProgramShader::setUniform(const std::string &name, GLfloat v) const
 {
-    GLint loc = glGetUniformLocation(m_id, name.c_str());
+    GLint loc = getUniformLocation(name);
 
     if(-1 == loc)
     {
@@ -135,13 +309,13 @@ bool ProgramShader::setUniform(const std::string &name, GLfloat v) const
         return false;
     }
 
-    glUniform1f(loc, v);
+    setUniform(loc, v);
     return true;
 }
 
 bool ProgramShader::setUniform(const std::string &name, const glm::vec3 &v) const
 {
-    GLint loc = glGetUniformLocation(m_id, name.c_str());
+    GLint loc = getUniformLocation(name);
 
     if(-1 == loc)
     {
@@ -149,13 +323,13 @@ bool ProgramShader::setUniform(const std::string &name, const glm::vec3 &v) cons
         return false;
     }
 
-    glUniform3fv(loc, 1, glm::value_ptr(v));
+    setUniform(loc, v);
     return true;
 }
 
 bool ProgramShader::setUniform(const std::string &name, const glm::vec4 &v) const
 {
-    GLint loc = glGetUniformLocation(m_id, name.c_str());
+    GLint loc = getUniformLocation(name);
 
     if(-1 == loc)
     {
@@ -163,13 +337,13 @@ bool ProgramShader::setUniform(const std::string &name, const glm::vec4 &v) cons
         return false;
     }
 
-    glUniform4fv(loc, 1, glm::value_ptr(v));
+    setUniform(loc, v);
     return true;
 }
 
 bool ProgramShader::setUniform(const std::string &name, const glm::mat3 &v) const
 {
-    GLint loc = glGetUniformLocation(m_id, name.c_str());
+    GLint loc = getUniformLocation(name);
 
     if(-1 == loc)
     {
@@ -177,13 +351,13 @@ bool ProgramShader::setUniform(const std::string &name, const glm::mat3 &v) cons
         return false;
     }
 
-    glUniformMatrix3fv(loc, 1, GL_FALSE, glm::value_ptr(v));
+    setUniform(loc, v);
     return true;
 }
 
 bool ProgramShader::setUniform(const std::string &name, const glm::mat4 &v) const
 {
-    GLint loc = glGetUniformLocation(m_id, name.c_str());
+    GLint loc = getUniformLocation(name);
 
     if(-1 == loc)
     {
@@ -191,13 +365,13 @@ bool ProgramShader::setUniform(const std::string &name, const glm::mat4 &v) cons
         return false;
     }
 
-    glUniformMatrix4fv(loc, 1, GL_FALSE, glm::value_ptr(v));
+    setUniform(loc, v);
     return true;
 }
 
 bool ProgramShader::bindTexture(const std::string &name, const BaseTexturePtr& texture, GLint unit)
 {
-    GLint loc = glGetUniformLocation(m_id, name.c_str());
+    GLint loc = getUniformLocation(name);
 
     if (-1 == loc)
     {
@@ -211,10 +385,19 @@ bool ProgramShader::bindTexture(const std::string &name, const BaseTexturePtr& t
     return true;
 }
 
+void ProgramShader::setVertexLayout(const VertexLayout &layout) const
+{
+    // the depth only programs read no normal, their location stays -1
+    setUniform(m_vertexLayoutLocations.positionScale, layout.positionScale);
+    setUniform(m_vertexLayoutLocations.positionBias, layout.positionBias);
+    if (-1 != m_vertexLayoutLocations.octNormal)
+        setUniform(m_vertexLayoutLocations.octNormal, GLint(layout.format.normal == VertexFormat::NORMAL_OCT16));
+}
+
 bool ProgramShader::bindImage(const std::string &name, const BaseTexturePtr &texture,
     GLint unit, GLint level, GLboolean layered, GLint layer, GLenum access)
 {
-    GLint loc = glGetUniformLocation(m_id, name.c_str());
+    GLint loc = getUniformLocation(name);
 
     if(-1 == loc)
     {
@@ -228,6 +411,16 @@ bool ProgramShader::bindImage(const std::string &name, const BaseTexturePtr &tex
     return true;
 }
 
+ShaderLibrary& ProgramShader::getShaderLibrary()
+{
+    return s_library;
+}
+
+nv_helpers_gl::IncludeCache& ProgramShader::getIncludeCache()
+{
+    return s_includeCache;
+}
+
 bool ProgramShader::setIncludeFromFile(const std::string &includeName, const std::string &filename)
 {
     auto incStr = readTextFile(filename);
@@ -242,12 +435,12 @@ std::vector<char> ProgramShader::readTextFile(const std::string &filename)
     if (filename.empty()) 
         return std::vector<char>();
 
-	FILE *fp = 0;
-	if (!(fp = fopen(filename.c_str(), "r")))
-	{
-		printf("Cannot open \"%s\" for read!\n", filename.c_str());
-		return std::vector<char>();
-	}
+    FILE *fp = 0;
+    if (!(fp = fopen(filename.c_str(), "r")))
+    {
+        printf("Cannot open \"%s\" for read!\n", filename.c_str());
+        return std::vector<char>();
+    }
 
     fseek(fp, 0L, SEEK_END);     // seek to end of file
     long size = ftell(fp);       // get file length
@@ -255,9 +448,10 @@ std::vector<char> ProgramShader::readTextFile(const std::string &filename)
 
     std::vector<char> buffer(size);
 
-	size_t bytes;
-	bytes = fread(buffer.data(), 1, size, fp);
+    size_t bytes;
+    bytes = fread(buffer.data(), 1, size, fp);
+    buffer.resize(bytes);
 
-	fclose(fp);
-	return buffer;
-}
\ No newline at end of file
+    fclose(fp);
+    return buffer;
+}
@@ -1,16 +1,31 @@
 #pragma once
 
 #include <GL/glew.h>
+#include <cassert>
 #include <glm/glm.hpp>
 #include <Math/Common.h>
 #include <string>
 #include <GraphicsTypes.h>
+#include <unordered_map>
 #include <vector>
+#include <GLType/ProgramManager.h>
+#include <GLType/RenderStateCache.h>
+#include <GLType/ShaderLibrary.h>
+
+struct VertexLayout;
+
+/** Layout of glDispatchComputeIndirect arguments */
+struct DispatchIndirectCommand
+{
+    GLuint numGroupsX;
+    GLuint numGroupsY;
+    GLuint numGroupsZ;
+};
 
 class ProgramShader
 {
 public:
-    ProgramShader() : m_id(0u) {}
+    ProgramShader() : m_id(0u), m_workGroupSize(0u) {}
     virtual ~ProgramShader() {destroy();}
     
     /** Generate the program id */
@@ -21,29 +36,60 @@ public:
     
     /** Add a shader and compile it */
     void addShader(GLenum shaderType, const std::string &tag);
+
+    /** Compile & link the shaders again, keep the current program on failure */
+    bool reload();
+
+    /** True when one of the shaders comes from, or includes, 'filename' */
+    bool dependsOn(const std::string &filename) const;
     
     //bool compile(); //static (with param)?
     
     bool link(); //static (with param)?
     
-    void bind() const { glUseProgram( m_id ); }
-    void unbind() const { glUseProgram( 0u ); }
+    void bind() const { RenderStateCache::getInstance().useProgram( m_id ); }
+    /** The program stays current until another one is bound, see RenderStateCache */
+    void unbind() const {}
     
     /** Return the program id */
     GLuint getId() const { return m_id; }
     
+    /** Uniform location, -1 when unused. Asked to GL once per name until the program links again */
+    GLint getUniformLocation(const std::string &name) const;
+
+    /** False when the uniform is unused, setUniform would complain */
+    bool hasUniform(const std::string &name) const { return -1 != getUniformLocation(name); }
+
     bool setUniform(const std::string &name, GLint v) const;
     bool setUniform(const std::string &name, GLfloat v) const;
     bool setUniform(const std::string &name, const glm::vec3 &v) const;
     bool setUniform(const std::string &name, const glm::vec4 &v) const;
     bool setUniform(const std::string &name, const glm::mat3 &v) const;
     bool setUniform(const std::string &name, const glm::mat4 &v) const;
+
+    /** Per draw uniforms, with a location from getUniformLocation. -1 is ignored like in GL */
+    void setUniform(GLint location, GLint v) const { glUniform1i(location, v); }
+    void setUniform(GLint location, GLfloat v) const { glUniform1f(location, v); }
+    void setUniform(GLint location, const glm::vec3 &v) const { glUniform3fv(location, 1, &v[0]); }
+    void setUniform(GLint location, const glm::vec4 &v) const { glUniform4fv(location, 1, &v[0]); }
+    void setUniform(GLint location, const glm::mat3 &v) const { glUniformMatrix3fv(location, 1, GL_FALSE, &v[0][0]); }
+    void setUniform(GLint location, const glm::mat4 &v) const { glUniformMatrix4fv(location, 1, GL_FALSE, &v[0][0]); }
     bool bindTexture(const std::string &name, const BaseTexturePtr& texture, GLint unit);
 
+    /** Dequantization uniforms of compact vertices, see VertexFormat.glsli */
+    void setVertexLayout(const VertexLayout &layout) const;
+
     // Compute
     bool bindImage(const std::string &name, const BaseTexturePtr &texture, GLint unit, GLint level, GLboolean layered, GLint layer, GLenum access);
 
+    /** local_size_x/y/z of the compute shader, queried after link */
+    const glm::uvec3& getWorkGroupSize() const { return m_workGroupSize; }
+
     void Dispatch( GLuint GroupCountX = 1, GLuint GroupCountY = 1, GLuint GroupCountZ = 1 );
+    /** Enough groups to cover the threads, using the shader's own work group size */
+    void DispatchThreads( GLuint ThreadCountX, GLuint ThreadCountY = 1, GLuint ThreadCountZ = 1 );
+    /** Group counts read from a DispatchIndirectCommand, possibly written by the GPU */
+    void DispatchIndirect( const GraphicsBufferPtr& buffer, GLintptr offset = 0 );
     void Dispatch1D( GLuint ThreadCountX, GLuint GroupSizeX = 64);
     void Dispatch2D( GLuint ThreadCountX, GLuint ThreadCountY, GLuint GroupSizeX = 8, GLuint GroupSizeY = 8);
     void Dispatch3D( GLuint ThreadCountX, GLuint ThreadCountY, GLuint ThreadCountZ, GLuint GroupSizeX = 4, GLuint GroupSizeY = 4, GLuint GroupSizeZ = 4 );
@@ -51,11 +97,47 @@ public:
     static bool setIncludeFromFile(const std::string &includeName, const std::string &filename);
     static std::vector<char> readTextFile(const std::string &filename);
 
+    /** Effect files the shader tags are read from */
+    static ShaderLibrary& getShaderLibrary();
+
+    /** Include files shared by every program, with the shader tag -> include graph */
+    static nv_helpers_gl::IncludeCache& getIncludeCache();
+
+    /** Reload the programs depending on the modified files, return the ones rebuilt */
+    static std::vector<ProgramShader*> reloadModified(const std::vector<std::string> &filenames);
+
 protected:
 
+    struct ShaderStage
+    {
+        GLenum type;
+        std::string tag;        // GLSW effect key
+    };
+
+    /** Return the compiled shader, 0 on failure */
+    static GLuint compileShader(GLenum shaderType, const std::string &tag);
+
     static std::vector<std::string> directory;
+    static nv_helpers_gl::IncludeRegistry s_includes;
+    static nv_helpers_gl::IncludeCache s_includeCache;
+    static ShaderLibrary s_library;
+
+    void queryWorkGroupSize();
+    void resetUniformLocations();
 
     GLuint m_id;
+    glm::uvec3 m_workGroupSize;
+    std::vector<ShaderStage> m_stages;
+    mutable std::unordered_map<std::string, GLint> m_uniformLocations;  // of m_id, cleared when it changes
+
+    // setVertexLayout runs for every mesh, its uniforms are resolved at link
+    struct VertexLayoutLocations
+    {
+        GLint positionScale = -1;
+        GLint positionBias = -1;
+        GLint octNormal = -1;
+    };
+    VertexLayoutLocations m_vertexLayoutLocations;
 };
 
 inline void ProgramShader::Dispatch( GLuint GroupCountX, GLuint GroupCountY, GLuint GroupCountZ )
@@ -63,6 +145,15 @@ inline void ProgramShader::Dispatch( GLuint GroupCountX, GLuint GroupCountY, GLu
     glDispatchCompute(GroupCountX, GroupCountY, GroupCountZ);
 }
 
+inline void ProgramShader::DispatchThreads( GLuint ThreadCountX, GLuint ThreadCountY, GLuint ThreadCountZ )
+{
+    assert(m_workGroupSize.x > 0);
+    Dispatch(
+        Math::DivideByMultiple(ThreadCountX, m_workGroupSize.x),
+        Math::DivideByMultiple(ThreadCountY, m_workGroupSize.y),
+        Math::DivideByMultiple(ThreadCountZ, m_workGroupSize.z));
+}
+
 inline void ProgramShader::Dispatch1D( GLuint ThreadCountX, GLuint GroupSizeX )
 {
     Dispatch( Math::DivideByMultiple(ThreadCountX, GroupSizeX), 1, 1 );
@@ -0,0 +1,193 @@
+#include "RenderStateCache.h"
+
+namespace
+{
+    // the enable bits toggled by the passes, in m_Enabled order
+    const GLenum kCapabilities[] = {
+        GL_DEPTH_TEST,
+        GL_CULL_FACE,
+        GL_BLEND,
+        GL_STENCIL_TEST,
+        GL_SCISSOR_TEST,
+        GL_TEXTURE_CUBE_MAP_SEAMLESS,
+        GL_MULTISAMPLE,
+        GL_POLYGON_OFFSET_FILL,
+    };
+
+    int findCapability(GLenum capability)
+    {
+        for (int i = 0; i < int(sizeof(kCapabilities) / sizeof(kCapabilities[0])); i++)
+        {
+            if (kCapabilities[i] == capability)
+                return i;
+        }
+        return -1;
+    }
+}
+
+RenderStateCache::RenderStateCache() noexcept
+{
+    static_assert(sizeof(kCapabilities) / sizeof(kCapabilities[0]) == kCapabilityCount, "one enable bit per capability");
+    invalidate();
+}
+
+void RenderStateCache::invalidate() noexcept
+{
+    m_Program = kUnknown;
+    m_VertexArray = kUnknown;
+    for (GLuint unit = 0; unit < kTextureUnitCount; unit++)
+    {
+        m_Textures[unit] = kUnknown;
+        m_Samplers[unit] = kUnknown;
+    }
+    for (int i = 0; i < kCapabilityCount; i++)
+        m_Enabled[i] = kUnknown;
+    m_DepthMask = kUnknown;
+    m_DepthFunc = kUnknown;
+    m_ColorMask = kUnknown;
+    m_CullFace = kUnknown;
+    m_BlendSrc = kUnknown;
+    m_BlendDst = kUnknown;
+    m_BlendEquation = kUnknown;
+}
+
+bool RenderStateCache::changes(GLuint& current, GLuint value) noexcept
+{
+    if (current == value)
+    {
+        m_Frame.skipped++;
+        return false;
+    }
+    current = value;
+    m_Frame.issued++;
+    return true;
+}
+
+void RenderStateCache::useProgram(GLuint program) noexcept
+{
+    if (changes(m_Program, program))
+        glUseProgram(program);
+}
+
+void RenderStateCache::bindVertexArray(GLuint vertexArray) noexcept
+{
+    if (changes(m_VertexArray, vertexArray))
+        glBindVertexArray(vertexArray);
+}
+
+void RenderStateCache::bindTexture(GLuint unit, GLuint texture) noexcept
+{
+    if (unit >= kTextureUnitCount)
+    {
+        m_Frame.issued++;
+        glBindTextureUnit(unit, texture);
+    }
+    else if (changes(m_Textures[unit], texture))
+        glBindTextureUnit(unit, texture);
+}
+
+void RenderStateCache::bindSampler(GLuint unit, GLuint sampler) noexcept
+{
+    if (unit >= kTextureUnitCount)
+    {
+        m_Frame.issued++;
+        glBindSampler(unit, sampler);
+    }
+    else if (changes(m_Samplers[unit], sampler))
+        glBindSampler(unit, sampler);
+}
+
+void RenderStateCache::setEnabled(GLenum capability, bool bEnabled) noexcept
+{
+    const int index = findCapability(capability);
+    if (index >= 0 && !changes(m_Enabled[index], bEnabled ? 1u : 0u))
+        return;
+    if (index < 0)
+        m_Frame.issued++;
+
+    if (bEnabled)
+        glEnable(capability);
+    else
+        glDisable(capability);
+}
+
+void RenderStateCache::depthMask(bool bWrite) noexcept
+{
+    if (changes(m_DepthMask, bWrite ? 1u : 0u))
+        glDepthMask(bWrite ? GL_TRUE : GL_FALSE);
+}
+
+void RenderStateCache::depthFunc(GLenum func) noexcept
+{
+    if (changes(m_DepthFunc, func))
+        glDepthFunc(func);
+}
+
+void RenderStateCache::colorMask(bool bWrite) noexcept
+{
+    const GLboolean value = bWrite ? GL_TRUE : GL_FALSE;
+    if (changes(m_ColorMask, bWrite ? 1u : 0u))
+        glColorMask(value, value, value, value);
+}
+
+void RenderStateCache::cullFace(GLenum mode) noexcept
+{
+    if (changes(m_CullFace, mode))
+        glCullFace(mode);
+}
+
+void RenderStateCache::blendFunc(GLenum sfactor, GLenum dfactor) noexcept
+{
+    // one call for both factors
+    if (m_BlendSrc == sfactor && m_BlendDst == dfactor)
+    {
+        m_Frame.skipped++;
+        return;
+    }
+    m_BlendSrc = sfactor;
+    m_BlendDst = dfactor;
+    m_Frame.issued++;
+    glBlendFunc(sfactor, dfactor);
+}
+
+void RenderStateCache::blendEquation(GLenum mode) noexcept
+{
+    if (changes(m_BlendEquation, mode))
+        glBlendEquation(mode);
+}
+
+void RenderStateCache::onProgramDeleted(GLuint program) noexcept
+{
+    if (m_Program == program)
+        m_Program = kUnknown;
+}
+
+void RenderStateCache::onVertexArrayDeleted(GLuint vertexArray) noexcept
+{
+    if (m_VertexArray == vertexArray)
+        m_VertexArray = kUnknown;
+}
+
+void RenderStateCache::onTextureDeleted(GLuint texture) noexcept
+{
+    for (GLuint unit = 0; unit < kTextureUnitCount; unit++)
+    {
+        if (m_Textures[unit] == texture)
+            m_Textures[unit] = kUnknown;
+    }
+}
+
+void RenderStateCache::onSamplerDeleted(GLuint sampler) noexcept
+{
+    for (GLuint unit = 0; unit < kTextureUnitCount; unit++)
+    {
+        if (m_Samplers[unit] == sampler)
+            m_Samplers[unit] = kUnknown;
+    }
+}
+
+void RenderStateCache::endFrame() noexcept
+{
+    m_LastFrame = m_Frame;
+    m_Frame = Stats();
+}
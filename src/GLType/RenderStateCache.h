@@ -0,0 +1,89 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <tools/Singleton.hpp>
+#include <cstdint>
+
+/**
+ * Shadow copy of the GL state changed while rendering : the current program
+ * and VAO, the texture and sampler of each unit, the enable bits, the depth,
+ * color mask, cull and blend parameters. A call setting a value already current is
+ * skipped, and counted with the issued ones for the frame statistics.
+ *
+ * Values start unknown, the first call always reaches GL. Code changing the
+ * same state directly (ImGui) must call invalidate() afterwards, and objects
+ * deleted while bound must be forgotten since GL reuses their names.
+ */
+class RenderStateCache : public Singleton<RenderStateCache>
+{
+    friend class Singleton<RenderStateCache>;
+
+public:
+
+    static const GLuint kTextureUnitCount = 32;
+
+    struct Stats
+    {
+        uint32_t issued = 0;
+        uint32_t skipped = 0;
+    };
+
+    RenderStateCache() noexcept;
+
+    /** Forget every value, the next calls are all issued */
+    void invalidate() noexcept;
+
+    void useProgram(GLuint program) noexcept;
+    void bindVertexArray(GLuint vertexArray) noexcept;
+    void bindTexture(GLuint unit, GLuint texture) noexcept;
+    void bindSampler(GLuint unit, GLuint sampler) noexcept;
+
+    /** Untracked capabilities are always issued */
+    void setEnabled(GLenum capability, bool bEnabled) noexcept;
+    void enable(GLenum capability) noexcept { setEnabled(capability, true); }
+    void disable(GLenum capability) noexcept { setEnabled(capability, false); }
+
+    void depthMask(bool bWrite) noexcept;
+    void depthFunc(GLenum func) noexcept;
+    /** All the channels of every draw buffer at once */
+    void colorMask(bool bWrite) noexcept;
+    void cullFace(GLenum mode) noexcept;
+    void blendFunc(GLenum sfactor, GLenum dfactor) noexcept;
+    void blendEquation(GLenum mode) noexcept;
+
+    /** Call before deleting an object which may still be bound */
+    void onProgramDeleted(GLuint program) noexcept;
+    void onVertexArrayDeleted(GLuint vertexArray) noexcept;
+    void onTextureDeleted(GLuint texture) noexcept;
+    void onSamplerDeleted(GLuint sampler) noexcept;
+
+    /** Keep the counts of the frame ending, and start new ones */
+    void endFrame() noexcept;
+
+    /** Counts of the last complete frame */
+    const Stats& getFrameStats() const noexcept { return m_LastFrame; }
+
+private:
+
+    static const GLuint kUnknown = ~0u;
+    static const int kCapabilityCount = 8;
+
+    /** Count the call, true when it has to be issued */
+    bool changes(GLuint& current, GLuint value) noexcept;
+
+    GLuint m_Program;
+    GLuint m_VertexArray;
+    GLuint m_Textures[kTextureUnitCount];
+    GLuint m_Samplers[kTextureUnitCount];
+    GLuint m_Enabled[kCapabilityCount];
+    GLuint m_DepthMask;
+    GLuint m_DepthFunc;
+    GLuint m_ColorMask;
+    GLuint m_CullFace;
+    GLuint m_BlendSrc;
+    GLuint m_BlendDst;
+    GLuint m_BlendEquation;
+
+    Stats m_Frame;
+    Stats m_LastFrame;
+};
@@ -0,0 +1,66 @@
+#include "SamplerCache.h"
+#include <GLType/RenderStateCache.h>
+
+SamplerDesc::SamplerDesc(GLenum minFilter, GLenum magFilter, GLenum wrap) noexcept :
+    minFilter(minFilter),
+    magFilter(magFilter),
+    wrapS(wrap),
+    wrapT(wrap),
+    wrapR(wrap)
+{
+}
+
+bool SamplerDesc::operator==(const SamplerDesc& other) const noexcept
+{
+    return minFilter == other.minFilter
+        && magFilter == other.magFilter
+        && wrapS == other.wrapS
+        && wrapT == other.wrapT
+        && wrapR == other.wrapR;
+}
+
+size_t SamplerDesc::Hasher::operator()(const SamplerDesc& desc) const noexcept
+{
+    // FNV-1a on the fields, a handful of descriptors are ever used
+    const GLenum fields[] = { desc.minFilter, desc.magFilter, desc.wrapS, desc.wrapT, desc.wrapR };
+    size_t hash = 2166136261u;
+    for (GLenum field : fields)
+    {
+        hash ^= size_t(field);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+GLuint SamplerCache::get(const SamplerDesc& desc)
+{
+    auto it = m_Samplers.find(desc);
+    if (it != m_Samplers.end())
+        return it->second;
+
+    GLuint sampler = 0;
+    glCreateSamplers(1, &sampler);
+    glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, desc.minFilter);
+    glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, desc.magFilter);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, desc.wrapS);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, desc.wrapT);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_R, desc.wrapR);
+
+    m_Samplers.emplace(desc, sampler);
+    return sampler;
+}
+
+void SamplerCache::bind(GLuint unit, const SamplerDesc& desc)
+{
+    RenderStateCache::getInstance().bindSampler(unit, get(desc));
+}
+
+void SamplerCache::destroy()
+{
+    for (auto& entry : m_Samplers)
+    {
+        RenderStateCache::getInstance().onSamplerDeleted(entry.second);
+        glDeleteSamplers(1, &entry.second);
+    }
+    m_Samplers.clear();
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <tools/Singleton.hpp>
+#include <cstddef>
+#include <unordered_map>
+
+/** Filtering and wrap state of a sampler, the defaults are the GL ones */
+struct SamplerDesc
+{
+    GLenum minFilter = GL_NEAREST_MIPMAP_LINEAR;
+    GLenum magFilter = GL_LINEAR;
+    GLenum wrapS = GL_REPEAT;
+    GLenum wrapT = GL_REPEAT;
+    GLenum wrapR = GL_REPEAT;
+
+    SamplerDesc() = default;
+    SamplerDesc(GLenum minFilter, GLenum magFilter, GLenum wrap = GL_REPEAT) noexcept;
+
+    bool operator==(const SamplerDesc& other) const noexcept;
+
+    struct Hasher
+    {
+        size_t operator()(const SamplerDesc& desc) const noexcept;
+    };
+};
+
+/**
+ * Sampler objects shared by the textures, one per descriptor. The textures
+ * keep no sampling state, a texture can be bound with different filtering
+ * without changing it, and the units only switch between a few samplers.
+ */
+class SamplerCache : public Singleton<SamplerCache>
+{
+    friend class Singleton<SamplerCache>;
+
+public:
+
+    /** Sampler of 'desc', created on first use */
+    GLuint get(const SamplerDesc& desc);
+
+    /** Bind the sampler of 'desc' to 'unit' through RenderStateCache */
+    void bind(GLuint unit, const SamplerDesc& desc);
+
+    /** Delete the samplers, before the context goes away */
+    void destroy();
+
+    size_t getSamplerCount() const noexcept { return m_Samplers.size(); }
+
+private:
+
+    std::unordered_map<SamplerDesc, GLuint, SamplerDesc::Hasher> m_Samplers;
+};
@@ -0,0 +1,254 @@
+/**
+ *
+ *    \file ShaderLibrary.cpp
+ *
+ */
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <dirent.h>
+#endif
+
+#include <tools/misc.hpp>
+
+#include "ShaderLibrary.h"
+
+namespace {
+    bool isTagCharacter(char c)
+    {
+        return
+            (c >= 'A' && c <= 'Z') ||
+            (c >= 'a' && c <= 'z') ||
+            (c >= '0' && c <= '9') ||
+            c == '_' || c == '.';
+    }
+
+    bool endsWith(const std::string &str, const std::string &suffix)
+    {
+        return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    std::vector<std::string> listFiles(const std::string &directory, const std::string &suffix)
+    {
+        std::vector<std::string> files;
+    #ifdef _WIN32
+        WIN32_FIND_DATAA data;
+        HANDLE handle = FindFirstFileA((directory + "/*" + suffix).c_str(), &data);
+        if (handle == INVALID_HANDLE_VALUE)
+            return files;
+        do {
+            files.push_back(directory + "/" + data.cFileName);
+        } while (FindNextFileA(handle, &data));
+        FindClose(handle);
+    #else
+        DIR* dir = opendir(directory.c_str());
+        if (!dir)
+            return files;
+        while (struct dirent* entry = readdir(dir))
+        {
+            std::string name = entry->d_name;
+            if (endsWith(name, suffix))
+                files.push_back(directory + "/" + name);
+        }
+        closedir(dir);
+    #endif
+        return files;
+    }
+
+    std::string effectName(const std::string &filename, const std::string &suffix)
+    {
+        std::string name = nv_helpers::getFileName(filename);
+        return name.substr(0, name.size() - suffix.size());
+    }
+}
+
+bool ShaderLibrary::load(const std::string &directory, const std::string &suffix)
+{
+    m_directory = directory;
+    m_suffix = suffix;
+
+    std::vector<std::string> files = listFiles(directory, suffix);
+    if (files.empty())
+    {
+        fprintf(stderr, "ShaderLibrary : no \"%s\" file in \"%s\".\n", suffix.c_str(), directory.c_str());
+        return false;
+    }
+
+    bool bResult = true;
+    for (auto& filename : files)
+        bResult &= loadEffect(filename);
+    return bResult;
+}
+
+bool ShaderLibrary::reloadEffect(const std::string &filename)
+{
+    if (!endsWith(filename, m_suffix))
+        return false;
+
+    removeEffect(effectName(filename, m_suffix));
+    return loadEffect(filename);
+}
+
+bool ShaderLibrary::loadEffect(const std::string &filename)
+{
+    FILE *fp = fopen(filename.c_str(), "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "ShaderLibrary : unable to open effect file \"%s\".\n", filename.c_str());
+        return false;
+    }
+
+    fseek(fp, 0L, SEEK_END);
+    long size = ftell(fp);
+    rewind(fp);
+
+    // the file is read straight into the arena
+    const size_t offset = m_arena.size();
+    m_arena.resize(offset + size);
+    size_t bytes = fread(m_arena.data() + offset, 1, size, fp);
+    m_arena.resize(offset + bytes);
+    fclose(fp);
+
+    indexEffect(effectName(filename, m_suffix), offset, bytes);
+    return true;
+}
+
+void ShaderLibrary::indexEffect(const std::string &effect, size_t offset, size_t length)
+{
+    Effect& record = m_effects[effect];
+    record.offset = offset;
+    record.length = length;
+    std::vector<std::string>& tags = record.tags;
+    const char* data = m_arena.data();
+    const size_t end = offset + length;
+
+    Section* current = nullptr;
+    int lineNo = 0;
+    for (size_t begin = offset; begin < end; lineNo++)
+    {
+        const char* eol = static_cast<const char*>(memchr(data + begin, '\n', end - begin));
+        size_t next = eol ? size_t(eol - data) + 1 : end;
+
+        // If the line starts with "--", then it marks a new section
+        if (next - begin >= 2 && data[begin] == '-' && data[begin + 1] == '-')
+        {
+            if (current)
+                current->length = begin - current->offset;
+            current = nullptr;
+
+            size_t first = begin + 2;
+            while (first < next && !isTagCharacter(data[first])) first++;
+
+            // Without a name, the line starts a comment block
+            if (first < next)
+            {
+                size_t last = first;
+                while (last < next && isTagCharacter(data[last])) last++;
+
+                std::string tag = effect + "." + std::string(data + first, last - first);
+                Section& section = m_sections[tag];
+                section.offset = next;
+                section.length = 0;
+                section.line = lineNo + 2;
+                current = &section;
+                tags.push_back(tag);
+            }
+        }
+        begin = next;
+    }
+
+    if (current)
+        current->length = end - current->offset;
+}
+
+void ShaderLibrary::removeEffect(const std::string &effect)
+{
+    auto it = m_effects.find(effect);
+    if (it == m_effects.end())
+        return;
+
+    for (auto& tag : it->second.tags)
+        m_sections.erase(tag);
+
+    // compact the arena, the data past the effect moves down
+    const size_t offset = it->second.offset;
+    const size_t length = it->second.length;
+    m_effects.erase(it);
+    m_arena.erase(m_arena.begin() + offset, m_arena.begin() + offset + length);
+
+    for (auto& section : m_sections)
+    {
+        if (section.second.offset > offset)
+            section.second.offset -= length;
+    }
+    for (auto& other : m_effects)
+    {
+        if (other.second.offset > offset)
+            other.second.offset -= length;
+    }
+}
+
+void ShaderLibrary::addDirectiveToken(const std::string &token, const std::string &directive)
+{
+    m_directives.emplace_back(token, directive + "\n");
+}
+
+bool ShaderLibrary::getShader(const std::string &tag, ShaderSource &source) const
+{
+    // "Effect.Section.Variant" falls back to "Effect.Section", then "Effect"
+    std::string key = tag;
+    auto it = m_sections.find(key);
+    while (it == m_sections.end())
+    {
+        size_t dot = key.find_last_of('.');
+        if (dot == std::string::npos)
+            return false;
+        key.resize(dot);
+        it = m_sections.find(key);
+    }
+
+    const Section& section = it->second;
+    source.data = m_arena.data() + section.offset;
+    source.length = section.length;
+    source.line = section.line;
+
+    // A directive applies to every section ("*"), to the effect or to one token of the tag
+    source.directives.clear();
+    std::string tokens = "." + key + ".";
+    for (auto& directive : m_directives)
+    {
+        if (directive.first.empty() || directive.first == "*" ||
+            tokens.find("." + directive.first + ".") != std::string::npos)
+        {
+            source.directives += directive.second;
+        }
+    }
+    return true;
+}
+
+const std::vector<std::string>& ShaderLibrary::getTags(const std::string &effect) const
+{
+    static const std::vector<std::string> empty;
+    auto it = m_effects.find(effect);
+    return (it != m_effects.end()) ? it->second.tags : empty;
+}
+
+std::vector<std::string> ShaderLibrary::getEffects() const
+{
+    std::vector<std::string> effects;
+    for (auto& it : m_effects)
+        effects.push_back(it.first);
+    return effects;
+}
+
+void ShaderLibrary::clear()
+{
+    m_arena.clear();
+    m_sections.clear();
+    m_effects.clear();
+    m_directives.clear();
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+/**
+ * Source of a shader section, pointing inside the library arena.
+ * Only valid until the library is modified.
+ */
+struct ShaderSource
+{
+    const char* data;
+    size_t length;
+    int line;                   // line of the section body in the effect file
+    std::string directives;     // e.g. "#version 440 core\n"
+};
+
+/**
+ * Effect files in the GLSW format ("-- Vertex", "-- Fragment", ...) indexed
+ * by "Effect.Section" tag. Every file of a directory is read in one pass
+ * into a single arena, sections are then only referenced, never copied.
+ * A reloaded effect leaves the arena, the ones after it move down.
+ */
+class ShaderLibrary
+{
+public:
+
+    /** Load every 'suffix' file of 'directory' */
+    bool load(const std::string &directory, const std::string &suffix);
+
+    /** Read an effect file again and replace its sections */
+    bool reloadEffect(const std::string &filename);
+
+    /** Prepend 'directive' to the sections matching 'token' ("*" for all), in the order added */
+    void addDirectiveToken(const std::string &token, const std::string &directive);
+
+    /** Find the section with the longest tag prefixing 'tag' */
+    bool getShader(const std::string &tag, ShaderSource &source) const;
+
+    /** Tags of an effect, in file order */
+    const std::vector<std::string>& getTags(const std::string &effect) const;
+
+    /** Name of every loaded effect */
+    std::vector<std::string> getEffects() const;
+
+    void clear();
+
+private:
+
+    struct Section
+    {
+        size_t offset;
+        size_t length;
+        int line;
+    };
+
+    struct Effect
+    {
+        size_t offset;          // of the file in the arena
+        size_t length;
+        std::vector<std::string> tags;
+    };
+
+    bool loadEffect(const std::string &filename);
+    void indexEffect(const std::string &effect, size_t offset, size_t length);
+    void removeEffect(const std::string &effect);
+
+    std::string m_directory;
+    std::string m_suffix;
+
+    std::vector<char> m_arena;
+    std::unordered_map<std::string, Section> m_sections;            // tag -> section
+    std::unordered_map<std::string, Effect> m_effects;              // effect -> file range, tags
+    std::vector<std::pair<std::string, std::string>> m_directives;  // token, directive
+};
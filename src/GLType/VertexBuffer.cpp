@@ -7,9 +7,218 @@
 
 #include <GL/glew.h>
 #include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
 #include <vector>
+#include <cassert>
+#include <cstring>
+#include <cmath>
+
+#include <tools/MeshOptimizer.hpp>
+#include <tools/TangentSpace.hpp>
 
 #include "VertexBuffer.h"
+#include "GeometryArena.h"
+#include "RenderStateCache.h"
+
+
+namespace {
+  size_t positionSize(VertexFormat::Position f) { return (f == VertexFormat::POSITION_UNORM16) ? 4*sizeof(uint16_t) : sizeof(glm::vec3); }
+  size_t normalSize(VertexFormat::Normal f) { return (f == VertexFormat::NORMAL_OCT16) ? 2*sizeof(int16_t) : sizeof(glm::vec3); }
+  size_t texcoordSize(VertexFormat::Texcoord f) { return (f == VertexFormat::TEXCOORD_FLOAT2) ? sizeof(glm::vec2) : 2*sizeof(uint16_t); }
+  size_t tangentSize(VertexFormat::Tangent f) { return (f == VertexFormat::TANGENT_SNORM8) ? 4*sizeof(int8_t) : sizeof(glm::vec4); }
+
+  /** Project the unit normal on the octahedron, then unfold the lower half */
+  glm::vec2 octEncode(const glm::vec3 &n)
+  {
+    const float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (l1 <= 0.0f)
+      return glm::vec2(0.0f);
+
+    glm::vec2 p = glm::vec2(n) / l1;
+    if (n.z < 0.0f)
+    {
+      glm::vec2 s( (p.x >= 0.0f) ? 1.0f : -1.0f, (p.y >= 0.0f) ? 1.0f : -1.0f );
+      p = (1.0f - glm::abs(glm::vec2(p.y, p.x))) * s;
+    }
+    return p;
+  }
+
+  template<typename T>
+  void store(uint8_t *dst, const T &value) { memcpy(dst, &value, sizeof(T)); }
+}
+
+
+VertexLayout makeVertexLayout(
+  const VertexFormat &format,
+  bool hasNormal,
+  bool hasTexcoord,
+  bool hasTangent,
+  const glm::vec3 &bmin,
+  const glm::vec3 &bmax)
+{
+  VertexLayout layout;
+  layout.format = format;
+  
+  size_t stride = 0;
+  layout.positionOffset = stride;
+  stride += positionSize(format.position);
+  if (hasNormal)
+  {
+    layout.normalOffset = stride;
+    stride += normalSize(format.normal);
+  }
+  if (hasTexcoord)
+  {
+    layout.texcoordOffset = stride;
+    stride += texcoordSize(format.texcoord);
+  }
+  if (hasTangent)
+  {
+    layout.tangentOffset = stride;
+    stride += tangentSize(format.tangent);
+  }
+  layout.stride = GLsizei(stride);
+  
+  if (format.position == VertexFormat::POSITION_UNORM16)
+  {
+    layout.positionScale = bmax - bmin;
+    layout.positionBias = bmin;
+  }
+  return layout;
+}
+
+VertexLayout packVertices(
+  const VertexFormat &format,
+  size_t count,
+  const glm::vec3 *position,
+  const glm::vec3 *normal,
+  const glm::vec2 *texcoord,
+  const glm::vec4 *tangent,
+  std::vector<uint8_t> &data)
+{
+  glm::vec3 bmin(0.0f), bmax(0.0f);
+  if (count > 0)
+  {
+    bmin = bmax = position[0];
+    for (size_t i = 1; i < count; ++i)
+    {
+      bmin = glm::min(bmin, position[i]);
+      bmax = glm::max(bmax, position[i]);
+    }
+  }
+  
+  VertexLayout layout = makeVertexLayout( format, normal != nullptr, texcoord != nullptr, tangent != nullptr, bmin, bmax );
+  
+  data.resize( count * layout.stride );
+  packVertices( layout, count, position, normal, texcoord, tangent, data.empty() ? nullptr : &data[0] );
+  return layout;
+}
+
+void packVertices(
+  const VertexLayout &layout,
+  size_t count,
+  const glm::vec3 *position,
+  const glm::vec3 *normal,
+  const glm::vec2 *texcoord,
+  const glm::vec4 *tangent,
+  uint8_t *vertex)
+{
+  const VertexFormat &format = layout.format;
+  const size_t stride = layout.stride;
+  
+  // flat axis of the bounding box
+  const glm::vec3 invScale = glm::vec3(
+    (layout.positionScale.x > 0.0f) ? 1.0f / layout.positionScale.x : 0.0f,
+    (layout.positionScale.y > 0.0f) ? 1.0f / layout.positionScale.y : 0.0f,
+    (layout.positionScale.z > 0.0f) ? 1.0f / layout.positionScale.z : 0.0f);
+  
+  for (size_t i = 0; i < count; ++i, vertex += stride)
+  {
+    if (format.position == VertexFormat::POSITION_UNORM16)
+    {
+      glm::vec3 p = (position[i] - layout.positionBias) * invScale;
+      uint16_t q[4] = { glm::packUnorm1x16(p.x), glm::packUnorm1x16(p.y), glm::packUnorm1x16(p.z), 0u };
+      store( vertex + layout.positionOffset, q );
+    }
+    else
+      store( vertex + layout.positionOffset, position[i] );
+    
+    if (normal && layout.normalOffset >= 0)
+    {
+      if (format.normal == VertexFormat::NORMAL_OCT16)
+      {
+        glm::vec2 e = octEncode( normal[i] );
+        uint16_t q[2] = { glm::packSnorm1x16(e.x), glm::packSnorm1x16(e.y) };
+        store( vertex + layout.normalOffset, q );
+      }
+      else
+        store( vertex + layout.normalOffset, normal[i] );
+    }
+    
+    if (texcoord && layout.texcoordOffset >= 0)
+    {
+      if (format.texcoord == VertexFormat::TEXCOORD_HALF2)
+        store( vertex + layout.texcoordOffset, glm::packHalf2x16(texcoord[i]) );
+      else if (format.texcoord == VertexFormat::TEXCOORD_UNORM16)
+        store( vertex + layout.texcoordOffset, glm::packUnorm2x16(texcoord[i]) );
+      else
+        store( vertex + layout.texcoordOffset, texcoord[i] );
+    }
+    
+    if (tangent && layout.tangentOffset >= 0)
+    {
+      if (format.tangent == VertexFormat::TANGENT_SNORM8)
+        store( vertex + layout.tangentOffset, glm::packSnorm4x8(tangent[i]) );
+      else
+        store( vertex + layout.tangentOffset, tangent[i] );
+    }
+  }
+}
+
+void VertexLayout::setAttribPointers() const
+{
+  if (positionOffset >= 0)
+  {
+    if (format.position == VertexFormat::POSITION_UNORM16)
+      glVertexAttribPointer( VATTRIB_POSITION, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)(positionOffset));
+    else
+      glVertexAttribPointer( VATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, stride, (void*)(positionOffset));
+  }
+  
+  if (normalOffset >= 0)
+  {
+    if (format.normal == VertexFormat::NORMAL_OCT16)
+      glVertexAttribPointer( VATTRIB_NORMAL, 2, GL_SHORT, GL_TRUE, stride, (void*)(normalOffset));
+    else
+      glVertexAttribPointer( VATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, stride, (void*)(normalOffset));
+  }
+  
+  if (texcoordOffset >= 0)
+  {
+    if (format.texcoord == VertexFormat::TEXCOORD_HALF2)
+      glVertexAttribPointer( VATTRIB_TEXCOORD, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)(texcoordOffset));
+    else if (format.texcoord == VertexFormat::TEXCOORD_UNORM16)
+      glVertexAttribPointer( VATTRIB_TEXCOORD, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)(texcoordOffset));
+    else
+      glVertexAttribPointer( VATTRIB_TEXCOORD, 2, GL_FLOAT, GL_FALSE, stride, (void*)(texcoordOffset));
+  }
+  
+  if (tangentOffset >= 0)
+  {
+    if (format.tangent == VertexFormat::TANGENT_SNORM8)
+      glVertexAttribPointer( VATTRIB_TANGENT, 4, GL_BYTE, GL_TRUE, stride, (void*)(tangentOffset));
+    else
+      glVertexAttribPointer( VATTRIB_TANGENT, 4, GL_FLOAT, GL_FALSE, stride, (void*)(tangentOffset));
+  }
+}
+
+void VertexLayout::enable() const
+{
+  if (positionOffset >= 0)  glEnableVertexAttribArray( VATTRIB_POSITION );
+  if (normalOffset >= 0)    glEnableVertexAttribArray( VATTRIB_NORMAL );
+  if (texcoordOffset >= 0)  glEnableVertexAttribArray( VATTRIB_TEXCOORD );
+  if (tangentOffset >= 0)   glEnableVertexAttribArray( VATTRIB_TANGENT );
+}
 
 
     
@@ -21,12 +230,19 @@ void VertexBuffer::initialize()
 
 void VertexBuffer::destroy()
 {
-  if (m_vao) glDeleteVertexArrays( 1, &m_vao);
+  if (m_vao)
+  {
+    RenderStateCache::getInstance().onVertexArrayDeleted( m_vao );
+    glDeleteVertexArrays( 1, &m_vao);
+  }
   if (m_vbo) glDeleteBuffers( 1, &m_vbo);
+  if (m_ibo) glDeleteBuffers( 1, &m_ibo);
   
   cleanData();
   m_vao = 0;
   m_vbo = 0;
+  m_ibo = 0;
+  m_lods.clear();
 }
 
 void VertexBuffer::cleanData()
@@ -34,78 +250,145 @@ void VertexBuffer::cleanData()
   m_position.clear();
   m_normal.clear();
   m_texcoord.clear();
+  m_tangent.clear();
+  m_index.clear();
+}
+
+void VertexBuffer::generateTangents()
+{
+  if (m_index.empty())
+    return;
+  
+  tangent_space::generateTangents( m_index, m_position, m_normal, m_texcoord, m_tangent );
+}
+
+void VertexBuffer::optimize()
+{
+  if (m_index.empty() || m_position.empty())
+    return;
+  
+  const size_t count = m_position.size();
+  
+  mesh_optimizer::optimizeVertexCache( m_index, count );
+  mesh_optimizer::optimizeOverdraw( m_index, &m_position[0], count );
+  
+  size_t newCount = 0;
+  std::vector<uint32_t> remap = mesh_optimizer::optimizeVertexFetch( m_index, count, newCount );
+  mesh_optimizer::remapVertices( m_position, remap, newCount );
+  mesh_optimizer::remapVertices( m_normal, remap, newCount );
+  mesh_optimizer::remapVertices( m_texcoord, remap, newCount );
+  mesh_optimizer::remapVertices( m_tangent, remap, newCount );
+}
+
+void VertexBuffer::generateLods(size_t lodCount)
+{
+  if (m_index.empty() || m_position.empty())
+    return;
+  
+  ::generateLods( m_index, &m_position[0], m_position.size(), lodCount, m_lods );
 }
 
 void VertexBuffer::complete(GLenum usage)
 {
   assert( m_vao && m_vbo );
   
+  // without generateLods, the full mesh is the only level
+  if (m_lods.empty() && !m_index.empty())
+    m_lods.push_back( MeshLod{ 0u, uint32_t(m_index.size()), 0.0f } );
   
-  m_positionSize = m_normalSize = m_texcoordSize = 0;  
-  if (!m_position.empty()) m_positionSize = m_position.size() * sizeof(glm::vec3);
-  if (!m_normal.empty()) m_normalSize = m_normal.size() * sizeof(glm::vec3);
-  if (!m_texcoord.empty()) m_texcoordSize  = m_texcoord.size() * sizeof(glm::vec2);  
+  if (!m_position.empty())
+    m_boundingSphere = computeBoundingSphere( &m_position[0], m_position.size() );
   
-  GLsizeiptr bufferSize = m_positionSize + m_normalSize + m_texcoordSize;
-    
+  std::vector<uint8_t> data;
+  if (!m_position.empty())
+  {
+    const size_t count = m_position.size();
+    m_layout = packVertices( m_format, count, &m_position[0],
+      (m_normal.size() == count) ? &m_normal[0] : nullptr,
+      (m_texcoord.size() == count) ? &m_texcoord[0] : nullptr,
+      (m_tangent.size() == count) ? &m_tangent[0] : nullptr,
+      data);
+  }
+  else
+  {
+    m_layout = VertexLayout();
+  }
+  
+  m_offset = data.size();
   
   bind();
   {    
-    glBufferData( GL_ARRAY_BUFFER, bufferSize, 0, usage);
-      
-    m_offset = 0;
-    
-    if (!m_position.empty())
-    {
-      glBufferSubData( GL_ARRAY_BUFFER, m_offset, m_positionSize, &m_position[0]);
-      glVertexAttribPointer( VATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, 0, (void*)(m_offset));
-      m_offset += m_positionSize;
-    }
-    
-    if (!m_normal.empty())
-    {
-      glBufferSubData( GL_ARRAY_BUFFER, m_offset, m_normalSize, &m_normal[0]);
-      glVertexAttribPointer( VATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, 0, (void*)(m_offset));
-      m_offset += m_normalSize;
-    }
+    // a single upload of the interleaved vertices
+    glBufferData( GL_ARRAY_BUFFER, m_offset, data.empty() ? 0 : &data[0], usage);
+    m_layout.setAttribPointers();
+    m_layout.enable();
     
-    if (!m_texcoord.empty())
+    // the element buffer binding is part of the VAO
+    if (!m_index.empty())
     {
-      glBufferSubData( GL_ARRAY_BUFFER, m_offset, m_texcoordSize, &m_texcoord[0]);
-      glVertexAttribPointer( VATTRIB_TEXCOORD, 2, GL_FLOAT, GL_FALSE, 0, (void*)(m_offset));  
-      m_offset += m_texcoordSize;
+      if (!m_ibo) glGenBuffers( 1, &m_ibo);
+      glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+      
+      if (m_position.size() <= 0x10000)
+      {
+        std::vector<uint16_t> index16( m_index.begin(), m_index.end() );
+        m_indexType = GL_UNSIGNED_SHORT;
+        glBufferData( GL_ELEMENT_ARRAY_BUFFER, index16.size() * sizeof(uint16_t), &index16[0], usage);
+      }
+      else
+      {
+        m_indexType = GL_UNSIGNED_INT;
+        glBufferData( GL_ELEMENT_ARRAY_BUFFER, m_index.size() * sizeof(uint32_t), &m_index[0], usage);
+      }
     }
   }
   unbind();
 }
 
 
+uint32_t VertexBuffer::complete(GeometryArena &arena)
+{
+  if (m_lods.empty() && !m_index.empty())
+    m_lods.push_back( MeshLod{ 0u, uint32_t(m_index.size()), 0.0f } );
+  
+  if (m_position.empty() || m_index.empty())
+    return GeometryArena::kInvalidMesh;
+  
+  const size_t count = m_position.size();
+  m_boundingSphere = computeBoundingSphere( &m_position[0], count );
+  
+  std::vector<uint8_t> data;
+  m_layout = packVertices( m_format, count, &m_position[0],
+    (m_normal.size() == count) ? &m_normal[0] : nullptr,
+    (m_texcoord.size() == count) ? &m_texcoord[0] : nullptr,
+    (m_tangent.size() == count) ? &m_tangent[0] : nullptr,
+    data);
+  m_offset = data.size();
+  m_indexType = GL_UNSIGNED_INT;
+  
+  return arena.addMesh( m_layout, &data[0], uint32_t(count), &m_index[0], uint32_t(m_index.size()), m_lods, m_boundingSphere );
+}
+
+
 void VertexBuffer::bind() const
 {
-  glBindVertexArray( m_vao );
+  RenderStateCache::getInstance().bindVertexArray( m_vao );
   glBindBuffer( GL_ARRAY_BUFFER, m_vbo);
 }
 
 void VertexBuffer::unbind()
 {
   glBindBuffer( GL_ARRAY_BUFFER, 0u);
-  glBindVertexArray( 0u );
+  RenderStateCache::getInstance().bindVertexArray( 0u );
 }
 
 void VertexBuffer::enable() const
 {  
-  bind();
-  
-  if (m_positionSize != 0)  glEnableVertexAttribArray( VATTRIB_POSITION );
-  if (m_normalSize != 0)    glEnableVertexAttribArray( VATTRIB_NORMAL );
-  if (m_texcoordSize != 0)  glEnableVertexAttribArray( VATTRIB_TEXCOORD );
+  // the attribute arrays were enabled in the VAO by complete()
+  RenderStateCache::getInstance().bindVertexArray( m_vao );
 }
 
 void VertexBuffer::disable()
 {    
- 	glDisableVertexAttribArray( VATTRIB_POSITION );
-  glDisableVertexAttribArray( VATTRIB_NORMAL );
-  glDisableVertexAttribArray( VATTRIB_TEXCOORD );
-  
-  unbind();
+  // the VAO stays bound until the next draw binds another one
 }
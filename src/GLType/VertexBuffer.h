@@ -2,9 +2,6 @@
  * 
  *    \file VertexBuffer.hpp  
  * 
- *    \todo # allow index buffer
- *          # allow interleaving
- *          # add tangent ?
  */
  
 
@@ -16,37 +13,142 @@
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 #include <vector>
+#include <cstdint>
 
+#include <MeshLod.h>
+
+class GeometryArena;
 
 enum VertexAttribLocation
 {
   VATTRIB_POSITION = 0,
   VATTRIB_NORMAL,
-  VATTRIB_TEXCOORD
+  VATTRIB_TEXCOORD,
+  VATTRIB_TANGENT,
+  VATTRIB_DRAWINDEX       // per draw, see GeometryArena
+};
+
+/** Storage of each attribute in the interleaved vertex */
+struct VertexFormat
+{
+  enum Position {
+    POSITION_FLOAT3,      // 12 bytes
+    POSITION_UNORM16      //  8 bytes, dequantized with the bounding box
+  };
+  enum Normal {
+    NORMAL_FLOAT3,        // 12 bytes
+    NORMAL_OCT16          //  4 bytes, octahedral encoding in 2 x snorm16
+  };
+  enum Texcoord {
+    TEXCOORD_FLOAT2,      //  8 bytes
+    TEXCOORD_HALF2,       //  4 bytes
+    TEXCOORD_UNORM16      //  4 bytes, only for coordinates in [0, 1]
+  };
+  enum Tangent {
+    TANGENT_FLOAT4,       // 16 bytes, handedness in w
+    TANGENT_SNORM8        //  4 bytes
+  };
+
+  Position position;
+  Normal normal;
+  Texcoord texcoord;
+  Tangent tangent;
+
+  VertexFormat(Position p = POSITION_FLOAT3, Normal n = NORMAL_FLOAT3, Texcoord t = TEXCOORD_FLOAT2, Tangent ta = TANGENT_FLOAT4)
+    : position(p), normal(n), texcoord(t), tangent(ta)
+  {}
+
+  /** 20 bytes per vertex instead of 48 */
+  static VertexFormat Compact() { return VertexFormat(POSITION_UNORM16, NORMAL_OCT16, TEXCOORD_HALF2, TANGENT_SNORM8); }
+};
+
+/**
+ *  Offsets of the attributes inside an interleaved vertex, and the
+ *  bounding box mapping quantized positions back to object space :
+ *    position = quantized * positionScale + positionBias
+ */
+struct VertexLayout
+{
+  VertexFormat format;
+  GLsizei stride;
+  GLintptr positionOffset;    // -1 when the attribute is missing
+  GLintptr normalOffset;
+  GLintptr texcoordOffset;
+  GLintptr tangentOffset;
+  glm::vec3 positionScale;
+  glm::vec3 positionBias;
+
+  VertexLayout()
+    : stride(0), positionOffset(-1), normalOffset(-1), texcoordOffset(-1), tangentOffset(-1),
+      positionScale(1.0f), positionBias(0.0f)
+  {}
+
+  /** Set the attrib pointers of the VAO, reading from the bound GL_ARRAY_BUFFER */
+  void setAttribPointers() const;
+
+  /** Enable the vertex attribs arrays of the present attributes */
+  void enable() const;
 };
 
+/** Offsets of 'format' and the dequantization of positions inside [bmin, bmax] */
+VertexLayout makeVertexLayout(
+  const VertexFormat &format,
+  bool hasNormal,
+  bool hasTexcoord,
+  bool hasTangent,
+  const glm::vec3 &bmin,
+  const glm::vec3 &bmax);
+
+/** Interleave and quantize 'count' vertices at 'data', with an existing layout */
+void packVertices(
+  const VertexLayout &layout,
+  size_t count,
+  const glm::vec3 *position,
+  const glm::vec3 *normal,
+  const glm::vec2 *texcoord,
+  const glm::vec4 *tangent,
+  uint8_t *data);
+
+/**
+ *  Interleave and quantize 'count' vertices into 'data'.
+ *  'normal', 'texcoord' and 'tangent' may be null, the attribute is then left out.
+ */
+VertexLayout packVertices(
+  const VertexFormat &format,
+  size_t count,
+  const glm::vec3 *position,
+  const glm::vec3 *normal,
+  const glm::vec2 *texcoord,
+  const glm::vec4 *tangent,
+  std::vector<uint8_t> &data);
+
 class VertexBuffer
 {
   protected:
     GLuint m_vao;
     GLuint m_vbo;    
+    GLuint m_ibo;
 
     std::vector<glm::vec3> m_position;
     std::vector<glm::vec3> m_normal;
     std::vector<glm::vec2> m_texcoord;
+    std::vector<glm::vec4> m_tangent;
+    std::vector<uint32_t> m_index;
+    std::vector<MeshLod> m_lods;
+    glm::vec4 m_boundingSphere;
         
-    GLsizeiptr m_positionSize;
-    GLsizeiptr m_normalSize;
-    GLsizeiptr m_texcoordSize;
+    VertexFormat m_format;
+    VertexLayout m_layout;
     
     GLintptr m_offset;
+    GLenum m_indexType;
     
 
   public:
     VertexBuffer() 
-      : m_vao(0u), m_vbo(0u),
-        m_positionSize(0), m_normalSize(0), m_texcoordSize(0),
-        m_offset(0)
+      : m_vao(0u), m_vbo(0u), m_ibo(0u),
+        m_boundingSphere(0.0f),
+        m_offset(0), m_indexType(GL_UNSIGNED_INT)
     {}
                      
     virtual ~VertexBuffer() { destroy(); }
@@ -57,26 +159,54 @@ class VertexBuffer
     /** Destroy the client side memory (CPU) */
     void cleanData();
 
-    /** Set the VAO parameters & send data to the GPU */
+    /** Layout used by the next complete(), the default keeps full floats */
+    void setFormat(const VertexFormat &format) { m_format = format; }
+
+    /** Tangents from the indexed positions, normals & texcoords, vertices on
+        mirrored UV seams are duplicated */
+    void generateTangents();
+
+    /** Reorder the indexed triangles for the vertex cache and overdraw, then
+        the vertices in fetch order (CPU side, before complete) */
+    void optimize();
+
+    /** Append up to 'lodCount' - 1 simplified levels to the indices
+        (CPU side, after optimize) */
+    void generateLods(size_t lodCount);
+
+    /** Set the VAO parameters & send data to the GPU
+        Indices are stored in 16 bits when the vertices allow it */
     void complete(GLenum usage);
     
+    /** Pack the vertices into a shared arena instead of own buffers,
+        returns the arena mesh (GeometryArena::kInvalidMesh on failure) */
+    uint32_t complete(GeometryArena &arena);
+    
     void bind() const;        
     static void unbind();
     
-    /** Enable vertex attribs arrays (for rendering) */
+    /** Bind the VAO for rendering, its attribs arrays are enabled once */
     void enable() const;
     
-    /** Disable vertex attribs arrays */
+    /** Nothing to undo, kept to pair with enable() */
     static void disable();    
     
     
     GLuint getVBO() const {return m_vbo;}
+    GLuint getIBO() const {return m_ibo;}
+    GLenum getIndexType() const {return m_indexType;}
     
     std::vector<glm::vec3>& getPosition() {return m_position;}
     std::vector<glm::vec3>& getNormal() {return m_normal;}
     std::vector<glm::vec2>& getTexcoord() {return m_texcoord;}
+    std::vector<glm::vec4>& getTangent() {return m_tangent;}
+    std::vector<uint32_t>& getIndex() {return m_index;}
+    
+    const std::vector<MeshLod>& getLods() const {return m_lods;}
+    const glm::vec4& getBoundingSphere() const {return m_boundingSphere;}
     
     GLintptr getOffset() const { return m_offset; }
+    const VertexLayout& getLayout() const { return m_layout; }
 };
 
 
@@ -89,16 +219,32 @@ class VertexBuffer
   std::vector<glm::vec3> &pos = vertexBuffer.getPosition();
   std::vector<glm::vec3> &nor = vertexBuffer.getNormal();
   std::vector<glm::vec2> &tex = vertexBuffer.getTexcoord();
+  std::vector<uint32_t> &idx = vertexBuffer.getIndex();
 
-  // Update pos, nor, tex
+  // Update pos, nor, tex, idx [optional]
   // ..
 
+  // Tangents for normal mapping [optional, indexed only]
+  m_vertexBuffer.generateTangents();
+
+  // Reorder the triangles & vertices [optional, indexed only]
+  m_vertexBuffer.optimize();
+
+  // Simplified levels of detail [optional, indexed only]
+  m_vertexBuffer.generateLods( 4 );
+
+  // Quantize the attributes [optional]
+  m_vertexBuffer.setFormat( VertexFormat::Compact() );
+
   // Generate buffer's id
   m_vertexBuffer.initialize();  
 
   // Send data to the GPU
   m_vertexBuffer.complete( GL_STATIC_DRAW );
 
+  // .. or to a shared GeometryArena, without initialize() [indexed only]
+  uint32_t arenaMesh = m_vertexBuffer.complete( arena );
+
   // Remove data from the CPU [optional]
   m_vertexBuffer.cleanData();
 
@@ -5,5 +5,6 @@
 
 typedef std::shared_ptr<class BaseTexture> BaseTexturePtr;
 typedef std::shared_ptr<class Framebuffer> FramebufferPtr;
+typedef std::shared_ptr<class GraphicsBuffer> GraphicsBufferPtr;
 
 typedef std::vector<class AttachmentBinding> AttachmentBindings;
\ No newline at end of file
@@ -9,6 +9,8 @@
 #include <GLType/ProgramShader.h>
 #include <GLType/Framebuffer.h>
 #include <tools/SimpleProfile.h>
+#include <algorithm>
+#include <cstdio>
 
 using namespace light_probe;
 
@@ -28,9 +30,15 @@ namespace light_probe
     CubeMesh s_cube;
 
     BaseTexturePtr createBrdfLutTexture();
+    void bakeBrdfLut(const BaseTexturePtr& tex);
+
+    bool contains(const std::vector<ProgramShader*>& programs, const ProgramShader& program)
+    {
+        return std::find(programs.begin(), programs.end(), &program) != programs.end();
+    }
 }
 
-void light_probe::initialize()
+bool light_probe::initialize(const std::string& environment)
 {
     s_equirectangularToCubemapShader.initalize();
     s_equirectangularToCubemapShader.addShader(GL_VERTEX_SHADER, "Cubemap.Vertex");
@@ -54,9 +62,36 @@ void light_probe::initialize()
 
     s_brdfTexture = createBrdfLutTexture();
 
+    return environment.empty() || loadEnvironment(environment);
+}
+
+bool light_probe::loadEnvironment(const std::string& filename)
+{
     // load the HDR environment map
-    s_newportTex = BaseTexture::Create("resource/newport_loft.hdr");
-    s_newportTex->parameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    auto tex = std::make_shared<BaseTexture>();
+    if (!tex->create(filename))
+    {
+        fprintf(stderr, "Failed to load the environment %s\n", filename.c_str());
+        return false;
+    }
+    setEnvironment(tex);
+    return true;
+}
+
+void light_probe::setEnvironment(const BaseTexturePtr& texture)
+{
+    texture->setSampler(SamplerDesc(GL_LINEAR, GL_LINEAR));
+    s_newportTex = texture;
+}
+
+void light_probe::addQualityDirectives(ShaderLibrary& library, uint32_t quality)
+{
+    const char* irradianceSamples[] = { "48u", "96u", "384u" };
+    const char* radianceSamples[] = { "16u", "32u", "128u" };
+    quality = std::min(quality, 2u);
+
+    library.addDirectiveToken("Irradiance", std::string("#define SAMPLE_COUNT ") + irradianceSamples[quality]);
+    library.addDirectiveToken("Radiance", std::string("#define SAMPLE_COUNT ") + radianceSamples[quality]);
 }
 
 void light_probe::shutdown()
@@ -71,6 +106,22 @@ BaseTexturePtr light_probe::getBrdfLut()
     return s_brdfTexture;
 }
 
+uint32_t light_probe::reloadPrograms(const std::vector<ProgramShader*>& programs)
+{
+    if (contains(programs, s_programBrdfLut))
+        bakeBrdfLut(s_brdfTexture);
+
+    // the filtered cubemaps are computed from the env cubemap
+    uint32_t stages = 0;
+    if (contains(programs, s_equirectangularToCubemapShader))
+        stages |= LightProbe::BAKE_ALL;
+    if (contains(programs, s_programIrradiance))
+        stages |= LightProbe::BAKE_IRRADIANCE;
+    if (contains(programs, s_programPrefilter))
+        stages |= LightProbe::BAKE_PREFILTER;
+    return stages;
+}
+
 BaseTexturePtr light_probe::createBrdfLutTexture()
 {
     // Generate a 2D LUT from the BRDF quation used.
@@ -78,36 +129,46 @@ BaseTexturePtr light_probe::createBrdfLutTexture()
     if (!tex) return nullptr;
 
     // be sure to set wrapping mode to GL_CLAMP_TO_EDGE
-    tex->parameter(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    tex->parameter(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    tex->parameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    tex->parameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    tex->setSampler(SamplerDesc(GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE));
+
+    bakeBrdfLut(tex);
 
+    return tex;
+}
+
+void light_probe::bakeBrdfLut(const BaseTexturePtr& tex)
+{
     // solve diffuse integral by convolution to create an irradiance cbuemap
-    const int localSize = 16;
     s_programBrdfLut.bind();
     s_programBrdfLut.bindImage("uLUT", tex, 0, 0, GL_TRUE, 0, GL_WRITE_ONLY);
-    s_programBrdfLut.Dispatch2D(s_brdfSize, s_brdfSize, localSize, localSize);
-
-    return tex;
+    s_programBrdfLut.DispatchThreads(s_brdfSize, s_brdfSize);
 }
 
-bool LightProbe::initialize()
+bool LightProbe::initialize(uint32_t envMapSize, uint32_t irradianceSize)
 {
+    assert(envMapSize >= 2 && irradianceSize >= 1);
+    m_envMapSize = envMapSize;
+    m_irradianceSize = irradianceSize;
+    m_prefilterSize = envMapSize / 2;
+
+    // full mip chains, the prefilter writes one roughness per level
+    const uint32_t envLevels = uint32_t(glm::log2(float(m_envMapSize))) + 1;
+    const uint32_t prefilterLevels = envLevels - 1;
+
     // create an irradiance cubemap
     m_irradianceCubemap = BaseTexture::Create(m_irradianceSize, m_irradianceSize, GL_TEXTURE_CUBE_MAP, GL_RGBA16F, 1);
     if (!m_irradianceCubemap) return false;
-    m_irradianceCubemap->parameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    m_irradianceCubemap->setSampler(SamplerDesc(GL_LINEAR, GL_LINEAR));
 
     // create a prefilter cubemap and allocate mips
-    m_prefilterCubemap = BaseTexture::Create(m_prefilterSize, m_prefilterSize, GL_TEXTURE_CUBE_MAP, GL_RGBA16F, 8);
+    m_prefilterCubemap = BaseTexture::Create(m_prefilterSize, m_prefilterSize, GL_TEXTURE_CUBE_MAP, GL_RGBA16F, prefilterLevels);
     if (!m_prefilterCubemap) return false;
-    m_prefilterCubemap->parameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    m_prefilterCubemap->setSampler(SamplerDesc(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR));
 
-    // For Env capture
-    m_envCubemap = BaseTexture::Create(m_envMapSize, m_envMapSize, GL_TEXTURE_CUBE_MAP, GL_RGB16F, m_MipmapLevels);
+    // For Env capture, only sampled once the mips are generated
+    m_envCubemap = BaseTexture::Create(m_envMapSize, m_envMapSize, GL_TEXTURE_CUBE_MAP, GL_RGB16F, envLevels);
     if (!m_envCubemap) return false;
-    m_envCubemap->parameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    m_envCubemap->setSampler(SamplerDesc(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR));
 
     auto depth = BaseTexture::Create(m_envMapSize, m_envMapSize, GL_TEXTURE_2D, GL_DEPTH_COMPONENT24, 1);
 
@@ -119,15 +180,17 @@ bool LightProbe::initialize()
     return true;
 }
 
-bool LightProbe::update()
+bool LightProbe::update(uint32_t stages)
 {
-    createEnvCube();
+    if (stages & BAKE_ENV_CUBE)
+        createEnvCube();
+    if (stages & (BAKE_IRRADIANCE | BAKE_PREFILTER))
     {
         PROFILEGL("Prefiltering");
-        glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
-        createIrradiance(m_envCubemap);
-        createPrefilter(m_envCubemap);
-        glDisable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+        if (stages & BAKE_IRRADIANCE)
+            createIrradiance(m_envCubemap);
+        if (stages & BAKE_PREFILTER)
+            createPrefilter(m_envCubemap);
     }
 
     return true;
@@ -137,6 +200,14 @@ void LightProbe::destroy()
 {
 }
 
+bool LightProbe::save(const std::string& path) const
+{
+    bool bSaved = m_envCubemap->save(path + "_environment.dds");
+    bSaved &= m_irradianceCubemap->save(path + "_irradiance.dds");
+    bSaved &= m_prefilterCubemap->save(path + "_prefilter.dds");
+    return bSaved;
+}
+
 LightProbe::~LightProbe()
 {
     destroy();
@@ -180,20 +251,18 @@ void LightProbe::createEnvCube()
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
     // then let OpenGL generate mipmaps from first mip face (combatting visible dots artifact)
-    m_envCubemap->parameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     m_envCubemap->generateMipmap();
 }
 
 void LightProbe::createIrradiance(const BaseTexturePtr& envMap)
 {
     // solve diffuse integral by convolution to create an irradiance cbuemap
-    const int localSize = 16;
     s_programIrradiance.bind();
     s_programIrradiance.bindTexture("uEnvMap", envMap, 0);
 
     // Set layered true to use whole cube face
     s_programIrradiance.bindImage("uCube", m_irradianceCubemap, 0, 0, GL_TRUE, 0, GL_WRITE_ONLY);
-    s_programIrradiance.Dispatch3D(m_irradianceSize, m_irradianceSize, 6, localSize, localSize, 1);
+    s_programIrradiance.DispatchThreads(m_irradianceSize, m_irradianceSize, 6);
 }
 
 void LightProbe::createPrefilter(const BaseTexturePtr& envMap)
@@ -204,7 +273,6 @@ void LightProbe::createPrefilter(const BaseTexturePtr& envMap)
         m_prefilterCubemap->m_TextureID, GL_TEXTURE_CUBE_MAP, 0, 0, 0, 0,
         m_prefilterSize, m_prefilterSize, 6);
 
-    const int localSize = 16;
     // Skip mipLevel 0
     auto size = m_prefilterSize / 2;
     auto mipLevel = 1;
@@ -217,7 +285,7 @@ void LightProbe::createPrefilter(const BaseTexturePtr& envMap)
         s_programPrefilter.setUniform("uRoughness", float(mipLevel) / maxLevel);
         // Set layered true to use whole cube face
         s_programPrefilter.bindImage("uCube", m_prefilterCubemap, 0, mipLevel, GL_TRUE, 0, GL_WRITE_ONLY);
-        s_programPrefilter.Dispatch3D(tsize, tsize, 6, localSize, localSize, 1);
+        s_programPrefilter.DispatchThreads(tsize, tsize, 6);
         mipLevel++;
     }
 }
@@ -1,22 +1,52 @@
 #include <memory>
+#include <vector>
+#include <cstdint>
+#include <string>
 #include <GraphicsTypes.h>
 
+class ProgramShader;
+class ShaderLibrary;
+
 namespace light_probe
 {
-    void initialize();
+    /** 'environment' may be empty, for bakes setting it later */
+    bool initialize(const std::string& environment = "resource/newport_loft.hdr");
     void shutdown();
 
+    /** Equirectangular HDR image the next LightProbe::update captures */
+    bool loadEnvironment(const std::string& filename);
+    void setEnvironment(const BaseTexturePtr& texture);
+
+    /** Sample counts of the filters : 0 low, 1 medium (interactive), 2 high. Before loading the shaders */
+    void addQualityDirectives(ShaderLibrary& library, uint32_t quality);
+
     BaseTexturePtr getBrdfLut();
+
+    /** Rebake what the reloaded programs produce, return the LightProbe::BakeStage to update */
+    uint32_t reloadPrograms(const std::vector<ProgramShader*>& programs);
 }
 
 class LightProbe
 {
 public:
 
-    bool initialize();
-    bool update();
+    enum BakeStage
+    {
+        BAKE_ENV_CUBE   = 1 << 0,
+        BAKE_IRRADIANCE = 1 << 1,
+        BAKE_PREFILTER  = 1 << 2,
+
+        BAKE_ALL = BAKE_ENV_CUBE | BAKE_IRRADIANCE | BAKE_PREFILTER
+    };
+
+    /** The prefiltered cubemap is half the environment size, sizes are powers of two */
+    bool initialize(uint32_t envMapSize = 512, uint32_t irradianceSize = 16);
+    bool update(uint32_t stages = BAKE_ALL);
     void draw();
     void destroy();
+
+    /** Write 'path'_environment, _irradiance and _prefilter DDS files */
+    bool save(const std::string& path) const;
     ~LightProbe();
 
     BaseTexturePtr getEnvCube();
@@ -29,10 +59,9 @@ private:
     void createIrradiance(const BaseTexturePtr& envMap);
     void createPrefilter(const BaseTexturePtr& envMap);
 
-    const uint32_t m_MipmapLevels = 8;
-    const uint32_t m_envMapSize = 512;
-    const uint32_t m_irradianceSize = 16;
-    const uint32_t m_prefilterSize = 256;
+    uint32_t m_envMapSize = 512;
+    uint32_t m_irradianceSize = 16;
+    uint32_t m_prefilterSize = 256;
 
     FramebufferPtr m_captureFBO;
 
@@ -9,87 +9,164 @@
 #include <cstdio>
 #include <cassert>
 #include <vector>
+#include <algorithm>
 
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
 #include <tools/gltools.hpp>
+#include <GLType/GeometryArena.h>
 #include "Mesh.h"
 
 
 void Mesh::destroy()
 {
+	if (m_arena && isInArena())
+		m_arena->removeMesh( m_arenaMesh );
+	m_arenaMesh = ~0u;
 	m_vertexBuffer.destroy();
 }
 
+void Mesh::upload()
+{
+  if (m_arena)
+    m_arenaMesh = m_vertexBuffer.complete( *m_arena );
+  
+  // own buffers when the arena is full or holds another layout
+  if (!isInArena())
+  {
+    m_vertexBuffer.initialize();  
+    m_vertexBuffer.complete( GL_STATIC_DRAW );
+  }
+  m_vertexBuffer.cleanData();
+}
+
+void Mesh::submit(const glm::mat4 &model, const glm::vec4 &material, size_t lod) const
+{
+  assert( m_bInitialized && isInArena() );
+  m_arena->draw( m_arenaMesh, model, material, lod );
+}
+
+void Mesh::submitInstanced(const LodSelector &selector, const glm::mat4 *models, const glm::vec4 *materials, uint32_t count) const
+{
+  assert( m_bInitialized && isInArena() );
+  
+  // instances of a command share their level
+  const std::vector<MeshLod> &lods = m_vertexBuffer.getLods();
+  const glm::vec4 &sphere = m_vertexBuffer.getBoundingSphere();
+  
+  std::vector<glm::mat4> lodModels[kMaxMeshLods];
+  std::vector<glm::vec4> lodMaterials[kMaxMeshLods];
+  
+  for (uint32_t i = 0u; i < count; ++i)
+  {
+    const size_t lod = std::min( selector.select(lods, sphere, models[i]), kMaxMeshLods-1u );
+    lodModels[lod].push_back( models[i] );
+    lodMaterials[lod].push_back( materials ? materials[i] : glm::vec4(0.0f) );
+  }
+  
+  for (size_t lod = 0u; lod < kMaxMeshLods; ++lod)
+  {
+    if (!lodModels[lod].empty())
+      m_arena->drawInstanced( m_arenaMesh, &lodModels[lod][0], &lodMaterials[lod][0], uint32_t(lodModels[lod].size()), lod );
+  }
+}
+
+uint32_t Mesh::addObject(const glm::mat4 &model, const glm::vec4 &material) const
+{
+  assert( m_bInitialized && isInArena() );
+  return m_arena->addObject( m_arenaMesh, model, material );
+}
+
+size_t Mesh::selectLod(const LodSelector &selector, const glm::mat4 &model) const
+{
+  return selector.select( m_vertexBuffer.getLods(), m_vertexBuffer.getBoundingSphere(), model );
+}
+
+void Mesh::drawLod(size_t lod) const
+{
+  assert( m_bInitialized );
+  
+  if (isInArena())
+  {
+    m_arena->drawImmediate( m_arenaMesh, lod );
+    return;
+  }
+  
+  const std::vector<MeshLod> &lods = m_vertexBuffer.getLods();
+  if (lod >= lods.size())
+  {
+    draw();
+    return;
+  }
+  
+  const GLenum type = m_vertexBuffer.getIndexType();
+  const size_t indexSize = (type == GL_UNSIGNED_SHORT) ? sizeof(uint16_t) : sizeof(uint32_t);
+  
+  m_vertexBuffer.enable();
+    glDrawElements( GL_TRIANGLES, lods[lod].indexCount, type, (void*)(lods[lod].firstIndex * indexSize));
+  m_vertexBuffer.disable();
+  
+  CHECKGLERROR();
+}
+
 /** PLANE MESH ----------------------------------------- */
 
 void PlaneMesh::init()
 {
-  /**
-   *  todo : use indexed tristrip instead
-   */
-  
   assert( !m_bInitialized );
   m_bInitialized = true;
   
   
   const float SIZE = m_size; //
   const int RES = 32; //  
+  const int ROW = RES+1;
   
   m_count = 3*2*(RES*RES);  
     
   std::vector<glm::vec3> &positions = m_vertexBuffer.getPosition();
   std::vector<glm::vec3> &normals   = m_vertexBuffer.getNormal();
   std::vector<glm::vec2> &texCoords = m_vertexBuffer.getTexcoord();
+  std::vector<uint32_t>  &indices   = m_vertexBuffer.getIndex();
     
-  positions.resize( m_count );
-  normals.resize( m_count, glm::vec3( 0.0f, 1.0f, 0.0f) );
-  texCoords.resize( m_count );
+  positions.resize( ROW*ROW );
+  normals.resize( ROW*ROW, glm::vec3( 0.0f, 1.0f, 0.0f) );
+  texCoords.resize( ROW*ROW );
+  indices.resize( m_count );
     
-  glm::vec3 *pPos = &(positions[0]);
-  glm::vec2 *pUV = &(texCoords[0]);
-  
-
   const float Delta = 1.0f / float(RES);
   
-	for (int j=0; j<RES; ++j)
-	{
+  // vertex (i, j) is shared by up to 6 triangles
+  for (int j=0; j<ROW; ++j)
+  {
+    for (int i=0; i<ROW; ++i)
+    {
+      texCoords[j*ROW + i] = Delta * glm::vec2( i, j);
+      positions[j*ROW + i] = SIZE * glm::vec3( i*Delta-0.5f, 0.0f, j*Delta-0.5f);
+    }
+  }
+  
+  uint32_t *pIdx = &(indices[0]);
+  
+  for (int j=0; j<RES; ++j)
+  {
     for (int i=0; i<RES; ++i)
     {
-      glm::vec4 vInd = Delta * glm::vec4( i, j, i+1, j+1);
-      
-      *pUV = glm::vec2( vInd.x, vInd.y);
-      *pPos = SIZE * glm::vec3( pUV->x-0.5f, 0.0f, pUV->y-0.5f);
-      ++pPos; ++pUV;
-      
-      *pUV = glm::vec2( vInd.x, vInd.w);
-      *pPos = SIZE * glm::vec3( pUV->x-0.5f, 0.0f, pUV->y-0.5f);
-      ++pPos; ++pUV;
+      const uint32_t i00 = j*ROW + i;
+      const uint32_t i01 = i00 + ROW;
+      const uint32_t i10 = i00 + 1;
+      const uint32_t i11 = i01 + 1;
       
-      *pUV = glm::vec2( vInd.z, vInd.y);
-      *pPos = SIZE * glm::vec3( pUV->x-0.5f, 0.0f, pUV->y-0.5f);
-      ++pPos; ++pUV;
-      
-      
-      *pUV = pUV[-1];
-      *pPos = pPos[-1];
-      ++pPos; ++pUV;
-      
-      *pUV = pUV[-3];
-      *pPos = pPos[-3];
-      ++pPos; ++pUV;
-      
-      *pUV = glm::vec2( vInd.z, vInd.w);
-      *pPos = SIZE * glm::vec3( pUV->x-0.5f, 0.0f, pUV->y-0.5f);
-      ++pPos; ++pUV;
+      *pIdx++ = i00; *pIdx++ = i01; *pIdx++ = i10;
+      *pIdx++ = i10; *pIdx++ = i01; *pIdx++ = i11;
     }
   }
   
   
-  m_vertexBuffer.initialize();  
-  m_vertexBuffer.complete( GL_STATIC_DRAW );
-  m_vertexBuffer.cleanData();
+  m_vertexBuffer.generateTangents();
+  m_vertexBuffer.optimize();
+  m_vertexBuffer.generateLods( m_lodCount );
+  upload();
   
   CHECKGLERROR();
 }
@@ -98,8 +175,14 @@ void PlaneMesh::draw() const
 {
   assert( m_bInitialized );
   
+  if (isInArena())
+  {
+    drawLod( 0 );
+    return;
+  }
+  
   m_vertexBuffer.enable();  
-    glDrawArrays( GL_TRIANGLES, 0, m_count);
+    glDrawElements( GL_TRIANGLES, m_count, m_vertexBuffer.getIndexType(), 0);
  	m_vertexBuffer.disable();
   
   CHECKGLERROR();
@@ -116,89 +199,79 @@ void SphereMesh::init()
 
 
 	const float RADIUS = m_radius; //
+	const int RES = m_meshResolution;
+	const int ROW = RES+1;  // the seam is duplicated for the texcoords
 
-	m_count = 2*m_meshResolution*(m_meshResolution+2);  
+	// the quads touching a pole lose their degenerated triangle
+	m_count = 3*2*RES*(RES-1);  
 
 	std::vector<glm::vec3> &positions = m_vertexBuffer.getPosition();
 	std::vector<glm::vec3> &normals   = m_vertexBuffer.getNormal();
 	std::vector<glm::vec2> &texCoords = m_vertexBuffer.getTexcoord();
+	std::vector<uint32_t>  &indices   = m_vertexBuffer.getIndex();
 
-	positions.resize( m_count );
-	normals.resize( m_count );
-	texCoords.resize( m_count );
-
-	glm::vec3 *pPos = &(positions[0]);
-	glm::vec3 *pNor = &(normals[0]);
-	glm::vec2 *pUV = &(texCoords[0]);  
+	positions.resize( ROW*ROW );
+	normals.resize( ROW*ROW );
+	texCoords.resize( ROW*ROW );
+	indices.resize( m_count );
 
 
-	float theta2, phi;    // next theta angle, phi angle
+	float theta, phi;     // theta angle, phi angle
 	float ct, st;         // cos(theta), sin(theta)
-	float ct2, st2;       // cos(next theta), sin(next theta)
 	float cp, sp;         // cos(phi), sin(phi)
 
 
 	const float TwoPI = 2.0f*M_PI;
-	const float Delta = 1.0f / float(m_meshResolution);
+	const float Delta = 1.0f / float(RES);
 
-	ct2 = 0.0f; st2 = -1.0f;
+	/* Rings from bottom to top */
+	for (int j=0; j<ROW; ++j)
+	{
+		theta = (j * Delta - 0.5f) * M_PI;
+		ct = cos(theta);
+		st = sin(theta);
 
-	/* Create the sphere from bottom to top (like a spiral) as a tristrip */
-	for (int j=0; j<m_meshResolution; ++j)
-	{    
-		ct = ct2;
-		st = st2;
-
-		theta2 = ((j+1) * Delta - 0.5f) * M_PI;
-		ct2 = cos(theta2);
-		st2 = sin(theta2);    
-
-		pNor->x = ct;
-		pNor->y = st;
-		pNor->z = 0.0f;
-		*pPos = RADIUS * (*pNor);
-		pUV->x = 0.0f;
-		pUV->y = j * Delta;
-		++pPos; ++pNor; ++pUV;
-
-		for (int i=0; i<m_meshResolution+1; ++i)
+		for (int i=0; i<ROW; ++i)
 		{
 			phi = TwoPI * i * Delta;
 			cp = cos(phi);
-			sp = sin(phi);      
-
-			pNor->x = ct2 * cp;
-			pNor->y = st2;
-			pNor->z = ct2 * sp;      
-			*pPos = RADIUS * (*pNor);
-			pUV->x = i * Delta;
-			pUV->y = (j+1) * Delta;      
-			++pPos; ++pNor; ++pUV;
-
-			pNor->x = ct * cp;
-			pNor->y = st;
-			pNor->z = ct * sp;			
-			*pPos = RADIUS * (*pNor);      
-			pUV->x = i * Delta;
-			pUV->y = j * Delta;      
-			++pPos; ++pNor; ++pUV;      
-		}    
-
-		pNor->x = ct2;
-		pNor->y = st2;
-		pNor->z = 0.0f;    
-		*pPos = RADIUS * (*pNor);
-		pUV->x = 1.0f;
-		pUV->y = 1.0f;
-		++pPos; ++pNor; ++pUV;    
+			sp = sin(phi);
+
+			const int v = j*ROW + i;
+			normals[v] = glm::vec3( ct * cp, st, ct * sp);
+			positions[v] = RADIUS * normals[v];
+			texCoords[v] = glm::vec2( i * Delta, j * Delta);
+		}
+	}
+
+	uint32_t *pIdx = &(indices[0]);
+
+	/* Same winding as the former triangle strip */
+	for (int j=0; j<RES; ++j)
+	{
+		for (int i=0; i<RES; ++i)
+		{
+			const uint32_t b0 = j*ROW + i;
+			const uint32_t b1 = b0 + 1;
+			const uint32_t a0 = b0 + ROW;
+			const uint32_t a1 = a0 + 1;
+
+			if (j != RES-1) {
+				*pIdx++ = a0; *pIdx++ = b0; *pIdx++ = a1;
+			}
+			if (j != 0) {
+				*pIdx++ = a1; *pIdx++ = b0; *pIdx++ = b1;
+			}
+		}
 	}
 
 	//-------------------------
 
 
-	m_vertexBuffer.initialize();  
-	m_vertexBuffer.complete( GL_STATIC_DRAW );
-	m_vertexBuffer.cleanData();
+	m_vertexBuffer.generateTangents();
+	m_vertexBuffer.optimize();
+	m_vertexBuffer.generateLods( m_lodCount );
+	upload();
 
 	CHECKGLERROR();
 }
@@ -207,8 +280,14 @@ void SphereMesh::draw() const
 {
   assert( m_bInitialized );
   
+  if (isInArena())
+  {
+    drawLod( 0 );
+    return;
+  }
+  
   m_vertexBuffer.enable();  
-    glDrawArrays( GL_TRIANGLE_STRIP, 0, m_count);
+    glDrawElements( GL_TRIANGLES, m_count, m_vertexBuffer.getIndexType(), 0);
   m_vertexBuffer.disable();
   
   CHECKGLERROR();
@@ -229,18 +308,25 @@ void ConeMesh::init()
   
   m_count = 2*3*(RES);  
   
+  // flat shaded sides can't share their vertices, the base does
+  const unsigned int sideCount = 3*RES;
+  const unsigned int vertexCount = sideCount + 1 + (RES+1);
+  
   std::vector<glm::vec3> &positions = m_vertexBuffer.getPosition();
   std::vector<glm::vec3> &normals   = m_vertexBuffer.getNormal();
   std::vector<glm::vec2> &texCoords = m_vertexBuffer.getTexcoord();
+  std::vector<uint32_t>  &indices   = m_vertexBuffer.getIndex();
   // Note : not sure for the uv coords
     
-  positions.resize( m_count );
-  normals.resize( m_count );
-  texCoords.resize( m_count );
+  positions.resize( vertexCount );
+  normals.resize( vertexCount );
+  texCoords.resize( vertexCount );
+  indices.resize( m_count );
       
   glm::vec3 *pPos = &(positions[0]);
   glm::vec3 *pNor = &(normals[0]);
   glm::vec2 *pUV = &(texCoords[0]);  
+  uint32_t *pIdx = &(indices[0]);
   
   
   std::vector<glm::vec3> baseVertex( RES );
@@ -281,37 +367,42 @@ void ConeMesh::init()
         
     pNor[0] = pNor[1] = pNor[2] = glm::normalize(glm::cross( pPos[-2], pPos[-1]));    
     pNor += 3;
+    
+    *pIdx++ = 3*i; *pIdx++ = 3*i+1; *pIdx++ = 3*i+2;
 	}
   
   // Adding the first one to loop
   baseVertex.push_back( baseVertex[0] );
   
-  // Base
-  for (i=0; i<baseVertex.size()-1u; ++i)
+  // Base : center then the rim
+  const uint32_t center = sideCount;
+  
+  *pNor = glm::vec3( 0.0f, 0.0f, -1.0f );
+  *pUV = glm::vec2( 0.5f, 0.0f ); //
+  *pPos = glm::vec3( 0.0f, 0.0f, -HEIGHT);
+  ++pPos; ++pNor; ++pUV; 
+  
+  for (i=0; i<baseVertex.size(); ++i)
   {
     *pNor = glm::vec3( 0.0f, 0.0f, -1.0f );
-    *pUV = glm::vec2( 0.5f, 0.0f ); //
-    *pPos = glm::vec3( 0.0f, 0.0f, -HEIGHT);
-    ++pPos; ++pNor; ++pUV; 
-    
-    *pNor = glm::vec3( 0.0f, 0.0f, -1.0f );
-    *pUV = glm::vec2( (i+1)*Delta, 0.0f ); //
-    *pPos = baseVertex[i+1];
-    ++pPos; ++pNor; ++pUV;
-        
-    *pNor = glm::vec3( 0.0f, 0.0f, -1.0f );
-    *pUV = glm::vec2( (i)*Delta, 0.0f ); //
+    *pUV = glm::vec2( i*Delta, 0.0f ); //
     *pPos = baseVertex[i];
-    ++pPos; ++pNor; ++pUV;        
+    ++pPos; ++pNor; ++pUV;
+  }
+  
+  for (i=0; i<baseVertex.size()-1u; ++i)
+  {
+    *pIdx++ = center; *pIdx++ = center+1 + (i+1); *pIdx++ = center+1 + i;
   }
   
   
   //-------------------------
   
   
-  m_vertexBuffer.initialize();  
-  m_vertexBuffer.complete( GL_STATIC_DRAW );
-  m_vertexBuffer.cleanData();
+  m_vertexBuffer.generateTangents();
+  m_vertexBuffer.optimize();
+  m_vertexBuffer.generateLods( m_lodCount );
+  upload();
   
   CHECKGLERROR();
 }
@@ -320,8 +411,14 @@ void ConeMesh::draw() const
 {
   assert( m_bInitialized );
   
+  if (isInArena())
+  {
+    drawLod( 0 );
+    return;
+  }
+  
   m_vertexBuffer.enable();
-    glDrawArrays( GL_TRIANGLES, 0, m_count);
+    glDrawElements( GL_TRIANGLES, m_count, m_vertexBuffer.getIndexType(), 0);
   m_vertexBuffer.disable(); 
   
   CHECKGLERROR();
@@ -333,8 +430,6 @@ void ConeMesh::draw() const
 
 void CubeMesh::init()
 {
-  /// not optimized at all, better with indices
-  
   assert( !m_bInitialized );
   m_bInitialized = true;
     
@@ -347,17 +442,20 @@ void CubeMesh::init()
   std::vector<glm::vec3> &positions = m_vertexBuffer.getPosition();
   std::vector<glm::vec3> &normals = m_vertexBuffer.getNormal();
   std::vector<glm::vec2> &coords = m_vertexBuffer.getTexcoord();
+  std::vector<uint32_t>  &indices = m_vertexBuffer.getIndex();
   
-  positions.resize( m_count );
-  normals.resize( m_count );
-  coords.resize( m_count );
+  // 4 corners per face, the normals prevent more sharing
+  positions.resize( 4u*6u );
+  normals.resize( 4u*6u );
+  coords.resize( 4u*6u );
+  indices.resize( m_count );
   
   #define PX  0u
-  #define NX  6u
-  #define PY  12u
-  #define NY  18u
-  #define PZ  24u
-  #define NZ  30u
+  #define NX  4u
+  #define PY  8u
+  #define NY  12u
+  #define PZ  16u
+  #define NZ  20u
   
   glm::vec3 default_normals[] = 
   {
@@ -365,65 +463,74 @@ void CubeMesh::init()
   };
   
   /// POSITIVE-X
-  positions[PX+0u] = positions[PX+5u] = glm::vec3( 1.0f, -1.0f, 1.0f);
+  positions[PX+0u] = glm::vec3( 1.0f, -1.0f, 1.0f);
   positions[PX+1u] = glm::vec3( 1.0f, -1.0f, -1.0f);
-  positions[PX+2u] = positions[PX+3u] = glm::vec3( 1.0f, 1.0f, -1.0f);
-  positions[PX+4u] = glm::vec3( 1.0f, 1.0f, 1.0f);
-  normals[PX+0u] = normals[PX+1u] = normals[PX+2u] = 
-  normals[PX+3u] = normals[PX+4u] = normals[PX+5u] = default_normals[0u];
+  positions[PX+2u] = glm::vec3( 1.0f, 1.0f, -1.0f);
+  positions[PX+3u] = glm::vec3( 1.0f, 1.0f, 1.0f);
+  normals[PX+0u] = normals[PX+1u] = normals[PX+2u] = normals[PX+3u] = default_normals[0u];
   
   /// NEGATIVE-X
-  positions[NX+0u] = positions[NX+5u] = glm::vec3( -1.0f, -1.0f, -1.0f);
+  positions[NX+0u] = glm::vec3( -1.0f, -1.0f, -1.0f);
   positions[NX+1u] = glm::vec3( -1.0f, -1.0f, 1.0f);
-  positions[NX+2u] = positions[NX+3u] = glm::vec3( -1.0f, 1.0f, 1.0f);
-  positions[NX+4u] = glm::vec3( -1.0f, 1.0f, -1.0f);
-  normals[NX+0u] = normals[NX+1u] = normals[NX+2u] = 
-  normals[NX+3u] = normals[NX+4u] = normals[NX+5u] = - default_normals[0u];
+  positions[NX+2u] = glm::vec3( -1.0f, 1.0f, 1.0f);
+  positions[NX+3u] = glm::vec3( -1.0f, 1.0f, -1.0f);
+  normals[NX+0u] = normals[NX+1u] = normals[NX+2u] = normals[NX+3u] = - default_normals[0u];
   
   /// POSITIVE-Y
-  positions[PY+0u] = positions[PY+5u] = glm::vec3( -1.0f, 1.0f, 1.0f);
+  positions[PY+0u] = glm::vec3( -1.0f, 1.0f, 1.0f);
   positions[PY+1u] = glm::vec3( 1.0f, 1.0f, 1.0f);
-  positions[PY+2u] = positions[PY+3u] = glm::vec3( 1.0f, 1.0f, -1.0f);
-  positions[PY+4u] = glm::vec3( -1.0f, 1.0f, -1.0f);
-  normals[PY+0u] = normals[PY+1u] = normals[PY+2u] = 
-  normals[PY+3u] = normals[PY+4u] = normals[PY+5u] = default_normals[1u];
+  positions[PY+2u] = glm::vec3( 1.0f, 1.0f, -1.0f);
+  positions[PY+3u] = glm::vec3( -1.0f, 1.0f, -1.0f);
+  normals[PY+0u] = normals[PY+1u] = normals[PY+2u] = normals[PY+3u] = default_normals[1u];
   
   /// NEGATIVE-Y
-  positions[NY+0u] = positions[NY+5u] = glm::vec3( -1.0f, -1.0f, -1.0f);
+  positions[NY+0u] = glm::vec3( -1.0f, -1.0f, -1.0f);
   positions[NY+1u] = glm::vec3( 1.0f, -1.0f, -1.0f);
-  positions[NY+2u] = positions[NY+3u] = glm::vec3( 1.0f, -1.0f, 1.0f);
-  positions[NY+4u] = glm::vec3( -1.0f, -1.0f, 1.0f);
-  normals[NY+0u] = normals[NY+1u] = normals[NY+2u] = 
-  normals[NY+3u] = normals[NY+4u] = normals[NY+5u] = - default_normals[1u];
+  positions[NY+2u] = glm::vec3( 1.0f, -1.0f, 1.0f);
+  positions[NY+3u] = glm::vec3( -1.0f, -1.0f, 1.0f);
+  normals[NY+0u] = normals[NY+1u] = normals[NY+2u] = normals[NY+3u] = - default_normals[1u];
   
   /// POSITIVE-Z
-  positions[PZ+0u] = positions[PZ+5u] = glm::vec3( -1.0f, -1.0f, 1.0f);
+  positions[PZ+0u] = glm::vec3( -1.0f, -1.0f, 1.0f);
   positions[PZ+1u] = glm::vec3( 1.0f, -1.0f, 1.0f);
-  positions[PZ+2u] = positions[PZ+3u] = glm::vec3( 1.0f, 1.0f, 1.0f);
-  positions[PZ+4u] = glm::vec3( -1.0f, 1.0f, 1.0f);
-  normals[PZ+0u] = normals[PZ+1u] = normals[PZ+2u] = 
-  normals[PZ+3u] = normals[PZ+4u] = normals[PZ+5u] = default_normals[2u];
+  positions[PZ+2u] = glm::vec3( 1.0f, 1.0f, 1.0f);
+  positions[PZ+3u] = glm::vec3( -1.0f, 1.0f, 1.0f);
+  normals[PZ+0u] = normals[PZ+1u] = normals[PZ+2u] = normals[PZ+3u] = default_normals[2u];
   
   /// NEGATIVE-Z
-  positions[NZ+0u] = positions[NZ+5u] = glm::vec3( 1.0f, -1.0f, -1.0f);
+  positions[NZ+0u] = glm::vec3( 1.0f, -1.0f, -1.0f);
   positions[NZ+1u] = glm::vec3( -1.0f, -1.0f, -1.0f);
-  positions[NZ+2u] = positions[NZ+3u] = glm::vec3( -1.0f, 1.0f, -1.0f);
-  positions[NZ+4u] = glm::vec3( 1.0f, 1.0f, -1.0f);
-  normals[NZ+0u] = normals[NZ+1u] = normals[NZ+2u] = 
-  normals[NZ+3u] = normals[NZ+4u] = normals[NZ+5u] = - default_normals[2u];
-
-  coords[PX+0u] = coords[NX+0u] = coords[PY+0u] = coords[NY+0u] = coords[PZ+0u] = coords[NZ+0u] = glm::vec2(1.0f, 0.f);
-  coords[PX+1u] = coords[NX+1u] = coords[PY+1u] = coords[NY+1u] = coords[PZ+1u] = coords[NZ+1u] = glm::vec2(0.0f, 0.f);
-  coords[PX+2u] = coords[NX+2u] = coords[PY+2u] = coords[NY+2u] = coords[PZ+2u] = coords[NZ+2u] = glm::vec2(0.0f, 1.f);
-  coords[PX+3u] = coords[NX+3u] = coords[PY+3u] = coords[NY+3u] = coords[PZ+3u] = coords[NZ+3u] = glm::vec2(0.0f, 1.f);
-  coords[PX+4u] = coords[NX+4u] = coords[PY+4u] = coords[NY+4u] = coords[PZ+4u] = coords[NZ+4u] = glm::vec2(1.0f, 1.f);
-  coords[PX+5u] = coords[NX+5u] = coords[PY+5u] = coords[NY+5u] = coords[PZ+5u] = coords[NZ+5u] = glm::vec2(1.0f, 0.f);
+  positions[NZ+2u] = glm::vec3( -1.0f, 1.0f, -1.0f);
+  positions[NZ+3u] = glm::vec3( 1.0f, 1.0f, -1.0f);
+  normals[NZ+0u] = normals[NZ+1u] = normals[NZ+2u] = normals[NZ+3u] = - default_normals[2u];
+
+  const unsigned int faces[] = { PX, NX, PY, NY, PZ, NZ };
+  for (unsigned int f = 0u; f < 6u; ++f)
+  {
+    const unsigned int face = faces[f];
+    coords[face+0u] = glm::vec2(1.0f, 0.f);
+    coords[face+1u] = glm::vec2(0.0f, 0.f);
+    coords[face+2u] = glm::vec2(0.0f, 1.f);
+    coords[face+3u] = glm::vec2(1.0f, 1.f);
+    
+    const uint32_t quad[] = { 0u, 1u, 2u, 2u, 3u, 0u };
+    for (unsigned int k = 0u; k < 6u; ++k)
+      indices[6u*f + k] = face + quad[k];
+  }
+  
+  #undef PX
+  #undef NX
+  #undef PY
+  #undef NY
+  #undef PZ
+  #undef NZ
   
   //-------------------------
   
-  m_vertexBuffer.initialize();  
-  m_vertexBuffer.complete( GL_STATIC_DRAW );
-  m_vertexBuffer.cleanData();
+  m_vertexBuffer.generateTangents();
+  m_vertexBuffer.optimize();
+  m_vertexBuffer.generateLods( m_lodCount );
+  upload();
   
   CHECKGLERROR();
 }
@@ -432,8 +539,14 @@ void CubeMesh::draw() const
 {
   assert( m_bInitialized );    
   
+  if (isInArena())
+  {
+    drawLod( 0 );
+    return;
+  }
+  
   m_vertexBuffer.enable();
-    glDrawArrays( GL_TRIANGLES, 0, m_count);
+    glDrawElements( GL_TRIANGLES, m_count, m_vertexBuffer.getIndexType(), 0);
   m_vertexBuffer.disable(); 
   
   CHECKGLERROR();
@@ -19,6 +19,9 @@
 #include <glm/glm.hpp>
 
 #include <GLType/VertexBuffer.h>
+#include <MeshLod.h>
+
+class GeometryArena;
 
 #ifndef M_PI
   #define M_PI    3.14159265358979323846
@@ -39,6 +42,10 @@ class Mesh
     
     VertexBuffer m_vertexBuffer;
     GLsizei m_count;
+    size_t m_lodCount;
+    
+    GeometryArena *m_arena;
+    uint32_t m_arenaMesh;
     
     /* TODO Move in another object */
     glm::mat4 m_model;
@@ -49,15 +56,49 @@ class Mesh
     
   public:
     Mesh()
-      : m_bInitialized(false), m_model(1.f), m_normal(1.f)
+      : m_bInitialized(false), m_lodCount(1u), m_arena(nullptr), m_arenaMesh(~0u), m_model(1.f), m_normal(1.f)
     {}
     
+    /** Send the indexed geometry to the arena, or to its own buffers */
+    void upload();
+    
     virtual ~Mesh() { destroy(); }
     
     virtual void init() {}
     virtual void draw() const {}
 	virtual void destroy();
     
+    /** Vertex storage, to set before init() */
+    void setVertexFormat(const VertexFormat &format) {m_vertexBuffer.setFormat(format);}
+    const VertexLayout& getVertexLayout() const     {return m_vertexBuffer.getLayout();}
+    
+    /** Levels of detail built by init(), the full mesh only by default */
+    void setLodCount(size_t lodCount)               {m_lodCount = lodCount;}
+    const std::vector<MeshLod>& getLods() const     {return m_vertexBuffer.getLods();}
+    
+    /** Object space bounds, computed by init() */
+    const glm::vec4& getBoundingSphere() const      {return m_vertexBuffer.getBoundingSphere();}
+    
+    /** Level to draw with the model matrix 'model' */
+    size_t selectLod(const LodSelector &selector, const glm::mat4 &model) const;
+    
+    /** Draw a single level, as draw() does for the full mesh */
+    void drawLod(size_t lod) const;
+    
+    /** Store the geometry in a shared arena, to set before init() */
+    void setArena(GeometryArena *arena)             {m_arena = arena;}
+    bool isInArena() const                          {return m_arenaMesh != ~0u;}
+    
+    /** Queue a draw in the arena, submitted by GeometryArena::flush */
+    void submit(const glm::mat4 &model, const glm::vec4 &material, size_t lod = 0) const;
+    
+    /** Queue 'count' instances in the arena, one instanced command per level
+        picked by 'selector' ('materials' may be null) */
+    void submitInstanced(const LodSelector &selector, const glm::mat4 *models, const glm::vec4 *materials, uint32_t count) const;
+    
+    /** Keep an object in the arena, culled and drawn on the GPU by GeometryArena::cullObjects */
+    uint32_t addObject(const glm::mat4 &model, const glm::vec4 &material) const;
+    
     void setModelMatrix(const glm::mat4 &model)     {m_model = model;}
     void setNormalMatrix(const glm::mat3 &normal)   {m_normal = normal;}
     
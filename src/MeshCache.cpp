@@ -0,0 +1,200 @@
+#include "MeshCache.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace {
+	const char kMagic[4] = { 'L', 'P', 'M', 'C' };
+
+	// Written as is, the file is only meant for the machine which built it
+	struct MeshCacheHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t sourceHash;
+		uint32_t importFlags;
+		uint32_t positionFormat;
+		uint32_t normalFormat;
+		uint32_t texcoordFormat;
+		uint32_t tangentFormat;
+		int32_t stride;
+		int32_t positionOffset;
+		int32_t normalOffset;
+		int32_t texcoordOffset;
+		int32_t tangentOffset;
+		float positionScale[3];
+		float positionBias[3];
+		uint32_t submeshCount;
+		uint32_t meshletCount;
+		uint64_t vertexSize;
+		uint64_t indexSize;
+	};
+
+	static_assert(sizeof(MeshCacheHeader) == 104, "MeshCacheHeader must not be padded");
+	static_assert(sizeof(MeshCacheSubmesh) == 96, "MeshCacheSubmesh must not be padded");
+	static_assert(sizeof(mesh_optimizer::Meshlet) == 40, "Meshlet must not be padded");
+
+	size_t align8(size_t offset) { return (offset + 7u) & ~size_t(7u); }
+}
+
+uint64_t MeshCache::hashFile(const std::string& filename)
+{
+	MappedFile file;
+	if (!file.open(filename))
+		return 0;
+
+	uint64_t hash = 14695981039346656037ull;
+	const unsigned char* data = file.data();
+	for (size_t i = 0; i < file.size(); i++)
+	{
+		hash ^= data[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+bool MeshCache::write(
+	const std::string& filename,
+	uint64_t sourceHash,
+	uint32_t importFlags,
+	const VertexLayout& layout,
+	const std::vector<MeshCacheSubmesh>& submeshes,
+	const std::vector<mesh_optimizer::Meshlet>& meshlets,
+	const std::vector<uint8_t>& vertices,
+	const std::vector<uint8_t>& indices)
+{
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, kMagic, sizeof(kMagic));
+	header.version = kVersion;
+	header.sourceHash = sourceHash;
+	header.importFlags = importFlags;
+	header.positionFormat = layout.format.position;
+	header.normalFormat = layout.format.normal;
+	header.texcoordFormat = layout.format.texcoord;
+	header.tangentFormat = layout.format.tangent;
+	header.stride = layout.stride;
+	header.positionOffset = int32_t(layout.positionOffset);
+	header.normalOffset = int32_t(layout.normalOffset);
+	header.texcoordOffset = int32_t(layout.texcoordOffset);
+	header.tangentOffset = int32_t(layout.tangentOffset);
+	memcpy(header.positionScale, &layout.positionScale[0], sizeof(header.positionScale));
+	memcpy(header.positionBias, &layout.positionBias[0], sizeof(header.positionBias));
+	header.submeshCount = uint32_t(submeshes.size());
+	header.meshletCount = uint32_t(meshlets.size());
+	header.vertexSize = vertices.size();
+	header.indexSize = indices.size();
+
+	// Write to a temporary, a concurrent reader never sees a partial file
+	const std::string tmpname = filename + ".tmp";
+	FILE* fp = fopen(tmpname.c_str(), "wb");
+	if (!fp)
+	{
+		fprintf(stderr, "MeshCache : unable to write \"%s\".\n", tmpname.c_str());
+		return false;
+	}
+
+	const uint64_t zero = 0;
+	size_t offset = sizeof(header);
+	bool bResult = fwrite(&header, sizeof(header), 1, fp) == 1;
+	if (!submeshes.empty())
+		bResult &= fwrite(submeshes.data(), sizeof(MeshCacheSubmesh), submeshes.size(), fp) == submeshes.size();
+	offset += submeshes.size()*sizeof(MeshCacheSubmesh);
+
+	if (!meshlets.empty())
+		bResult &= fwrite(meshlets.data(), sizeof(mesh_optimizer::Meshlet), meshlets.size(), fp) == meshlets.size();
+	offset += meshlets.size()*sizeof(mesh_optimizer::Meshlet);
+
+	if (!vertices.empty())
+		bResult &= fwrite(vertices.data(), 1, vertices.size(), fp) == vertices.size();
+	offset += vertices.size();
+
+	// keep the index blob aligned for 32-bit indices
+	bResult &= fwrite(&zero, 1, align8(offset) - offset, fp) == align8(offset) - offset;
+	if (!indices.empty())
+		bResult &= fwrite(indices.data(), 1, indices.size(), fp) == indices.size();
+	fclose(fp);
+
+	// rename does not replace an existing file on Windows
+	if (bResult)
+		remove(filename.c_str());
+
+	if (!bResult || rename(tmpname.c_str(), filename.c_str()) != 0)
+	{
+		fprintf(stderr, "MeshCache : unable to write \"%s\".\n", filename.c_str());
+		remove(tmpname.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool MeshCache::open(const std::string& filename, uint64_t sourceHash, uint32_t importFlags, const VertexFormat& format)
+{
+	close();
+
+	if (!m_File.open(filename))
+		return false;
+
+	MeshCacheHeader header;
+	if (m_File.size() < sizeof(header))
+	{
+		close();
+		return false;
+	}
+	memcpy(&header, m_File.data(), sizeof(header));
+
+	if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+		header.version != kVersion ||
+		header.sourceHash != sourceHash ||
+		header.importFlags != importFlags ||
+		header.positionFormat != uint32_t(format.position) ||
+		header.normalFormat != uint32_t(format.normal) ||
+		header.texcoordFormat != uint32_t(format.texcoord) ||
+		header.tangentFormat != uint32_t(format.tangent))
+	{
+		close();
+		return false;
+	}
+
+	const size_t submeshOffset = sizeof(header);
+	const size_t meshletOffset = submeshOffset + header.submeshCount*sizeof(MeshCacheSubmesh);
+	const size_t vertexOffset = meshletOffset + header.meshletCount*sizeof(mesh_optimizer::Meshlet);
+	const size_t indexOffset = align8(vertexOffset + header.vertexSize);
+	if (indexOffset + header.indexSize != m_File.size())
+	{
+		fprintf(stderr, "MeshCache : \"%s\" is truncated.\n", filename.c_str());
+		close();
+		return false;
+	}
+
+	m_Layout.format = format;
+	m_Layout.stride = header.stride;
+	m_Layout.positionOffset = header.positionOffset;
+	m_Layout.normalOffset = header.normalOffset;
+	m_Layout.texcoordOffset = header.texcoordOffset;
+	m_Layout.tangentOffset = header.tangentOffset;
+	m_Layout.positionScale = glm::vec3(header.positionScale[0], header.positionScale[1], header.positionScale[2]);
+	m_Layout.positionBias = glm::vec3(header.positionBias[0], header.positionBias[1], header.positionBias[2]);
+
+	m_Submeshes = reinterpret_cast<const MeshCacheSubmesh*>(m_File.data() + submeshOffset);
+	m_SubmeshCount = header.submeshCount;
+	m_Meshlets = reinterpret_cast<const mesh_optimizer::Meshlet*>(m_File.data() + meshletOffset);
+	m_MeshletCount = header.meshletCount;
+	m_VertexData = m_File.data() + vertexOffset;
+	m_VertexSize = size_t(header.vertexSize);
+	m_IndexData = m_File.data() + indexOffset;
+	m_IndexSize = size_t(header.indexSize);
+	return true;
+}
+
+void MeshCache::close()
+{
+	m_File.close();
+	m_Layout = VertexLayout();
+	m_Submeshes = nullptr;
+	m_SubmeshCount = 0;
+	m_Meshlets = nullptr;
+	m_MeshletCount = 0;
+	m_VertexData = m_IndexData = nullptr;
+	m_VertexSize = m_IndexSize = 0;
+}
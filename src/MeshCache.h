@@ -0,0 +1,78 @@
+#pragma once
+
+#include <GLType/VertexBuffer.h>
+#include <MeshLod.h>
+#include <tools/MeshOptimizer.hpp>
+#include <tools/MappedFile.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * One draw of a cached model, ranges are relative to the vertex and index blobs.
+ * The levels of detail follow each other inside the index range, the meshlets
+ * split the first level and follow the submesh order in the meshlet table.
+ */
+struct MeshCacheSubmesh
+{
+	int32_t materialIndex;
+	uint32_t vertexBase;
+	uint32_t indexCount;	// of all the levels
+	uint32_t indexType;		// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	uint64_t indexOffset;	// in bytes
+	float boundingSphere[4];
+	uint32_t lodCount;
+	uint32_t meshletCount;
+	MeshLod lods[kMaxMeshLods];
+};
+
+/**
+ * GPU ready copy of an imported model, stored next to the source file :
+ *   header | submesh table | meshlet table | vertex blob | index blob
+ * The file is memory-mapped and its blobs are uploaded as they are. It is
+ * rejected when its version, the source hash, the import flags or the vertex
+ * format differ from the current ones.
+ */
+class MeshCache
+{
+public:
+	static const uint32_t kVersion = 4;
+
+	/** FNV-1a hash of a whole file, 0 when it can't be read */
+	static uint64_t hashFile(const std::string& filename);
+
+	static bool write(
+		const std::string& filename,
+		uint64_t sourceHash,
+		uint32_t importFlags,
+		const VertexLayout& layout,
+		const std::vector<MeshCacheSubmesh>& submeshes,
+		const std::vector<mesh_optimizer::Meshlet>& meshlets,
+		const std::vector<uint8_t>& vertices,
+		const std::vector<uint8_t>& indices);
+
+	bool open(const std::string& filename, uint64_t sourceHash, uint32_t importFlags, const VertexFormat& format);
+	void close();
+
+	const VertexLayout& getLayout() const { return m_Layout; }
+	const MeshCacheSubmesh* getSubmeshes() const { return m_Submeshes; }
+	uint32_t getSubmeshCount() const { return m_SubmeshCount; }
+	const mesh_optimizer::Meshlet* getMeshlets() const { return m_Meshlets; }
+	uint32_t getMeshletCount() const { return m_MeshletCount; }
+	const uint8_t* getVertexData() const { return m_VertexData; }
+	size_t getVertexSize() const { return m_VertexSize; }
+	const uint8_t* getIndexData() const { return m_IndexData; }
+	size_t getIndexSize() const { return m_IndexSize; }
+
+private:
+	MappedFile m_File;
+	VertexLayout m_Layout;
+	const MeshCacheSubmesh* m_Submeshes = nullptr;
+	uint32_t m_SubmeshCount = 0;
+	const mesh_optimizer::Meshlet* m_Meshlets = nullptr;
+	uint32_t m_MeshletCount = 0;
+	const uint8_t* m_VertexData = nullptr;
+	size_t m_VertexSize = 0;
+	const uint8_t* m_IndexData = nullptr;
+	size_t m_IndexSize = 0;
+};
@@ -0,0 +1,96 @@
+#include "MeshLod.h"
+
+#include <tools/MeshOptimizer.hpp>
+#include <tools/TCamera.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+void generateLods(
+	std::vector<uint32_t>& indices,
+	const glm::vec3* positions,
+	size_t vertexCount,
+	size_t lodCount,
+	std::vector<MeshLod>& lods)
+{
+	lods.clear();
+	if (indices.empty())
+		return;
+
+	lods.push_back(MeshLod{ 0u, uint32_t(indices.size()), 0.0f });
+	lodCount = std::min(lodCount, kMaxMeshLods);
+
+	// Each level starts from the previous one, the errors add up
+	std::vector<uint32_t> source(indices), destination;
+	float error = 0.0f;
+
+	while (lods.size() < lodCount)
+	{
+		const size_t target = (source.size() / 6u) * 3u;
+		error += mesh_optimizer::simplify(destination, source, positions, vertexCount, target);
+
+		if (destination.empty() || destination.size() * 10u > source.size() * 9u)
+			break;
+
+		mesh_optimizer::optimizeVertexCache(destination, vertexCount);
+
+		lods.push_back(MeshLod{ uint32_t(indices.size()), uint32_t(destination.size()), error });
+		indices.insert(indices.end(), destination.begin(), destination.end());
+		source.swap(destination);
+	}
+}
+
+glm::vec4 computeBoundingSphere(const glm::vec3* positions, size_t count)
+{
+	if (count == 0u)
+		return glm::vec4(0.0f);
+
+	glm::vec3 bmin = positions[0], bmax = positions[0];
+	for (size_t i = 1; i < count; i++)
+	{
+		bmin = glm::min(bmin, positions[i]);
+		bmax = glm::max(bmax, positions[i]);
+	}
+
+	const glm::vec3 center = 0.5f * (bmin + bmax);
+	float radius2 = 0.0f;
+	for (size_t i = 0; i < count; i++)
+	{
+		const glm::vec3 d = positions[i] - center;
+		radius2 = std::max(radius2, glm::dot(d, d));
+	}
+	return glm::vec4(center, std::sqrt(radius2));
+}
+
+LodSelector::LodSelector(const TCamera& camera, float viewportHeight, float threshold)
+	: m_Eye(camera.getPosition()),
+	  m_PixelsPerUnit(0.5f * viewportHeight * camera.getProjectionMatrix()[1][1]),
+	  m_Threshold(threshold)
+{
+}
+
+size_t LodSelector::select(const std::vector<MeshLod>& lods, const glm::vec4& sphere, const glm::mat4& model) const
+{
+	if (lods.size() < 2u)
+		return 0u;
+
+	// Errors and radius grow with the largest scale of the model matrix
+	const float scale = std::sqrt(std::max(std::max(
+		glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+		glm::dot(glm::vec3(model[1]), glm::vec3(model[1]))),
+		glm::dot(glm::vec3(model[2]), glm::vec3(model[2]))));
+
+	const glm::vec3 center = glm::vec3(model * glm::vec4(glm::vec3(sphere), 1.0f));
+	const float distance = glm::length(center - m_Eye) - sphere.w * scale;
+
+	// The camera is inside the sphere
+	if (distance <= 0.0f)
+		return 0u;
+
+	const float pixelsPerError = scale * m_PixelsPerUnit / distance;
+
+	size_t lod = 0u;
+	while (lod + 1u < lods.size() && lods[lod + 1u].error * pixelsPerError <= m_Threshold)
+		++lod;
+	return lod;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+class TCamera;
+
+/**
+ * One level of detail : a range of the shared index buffer, and the
+ * geometric deviation from the full mesh in object units
+ */
+struct MeshLod
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	float error;
+};
+
+static const size_t kMaxMeshLods = 4;
+
+/**
+ * Simplify 'indices' into up to 'lodCount' levels, each with about half the
+ * triangles of the previous one. The coarser levels are appended to 'indices'
+ * and reference the same vertices, the chain stops early when a level can't
+ * drop 10% of the triangles.
+ */
+void generateLods(
+	std::vector<uint32_t>& indices,
+	const glm::vec3* positions,
+	size_t vertexCount,
+	size_t lodCount,
+	std::vector<MeshLod>& lods);
+
+/** Center (xyz) and radius (w) around the bounding box of the positions */
+glm::vec4 computeBoundingSphere(const glm::vec3* positions, size_t count);
+
+/**
+ * Pick the coarsest level whose error, projected at the nearest point of the
+ * bounding sphere, stays under 'threshold' pixels
+ */
+class LodSelector
+{
+public:
+	LodSelector(const TCamera& camera, float viewportHeight, float threshold = 1.0f);
+
+	size_t select(const std::vector<MeshLod>& lods, const glm::vec4& sphere, const glm::mat4& model) const;
+
+	/** The same test runs on the GPU, see GeometryArena::cullObjects */
+	const glm::vec3& getEye() const { return m_Eye; }
+	float getPixelsPerUnit() const { return m_PixelsPerUnit; }
+	float getThreshold() const { return m_Threshold; }
+
+private:
+	glm::vec3 m_Eye;
+	float m_PixelsPerUnit;		// at distance 1
+	float m_Threshold;
+};
@@ -11,14 +11,147 @@
 #include <assimp/scene.h>           // Output data structure
 #include <assimp/postprocess.h>     // Post processing fla
 
+#include <tools/MeshOptimizer.hpp>
+#include <tools/ParallelFor.hpp>
+#include <tools/TangentSpace.hpp>
+#include <tools/misc.hpp>
+#include <GLType/GeometryArena.h>
+#include <GLType/GraphicsBuffer.h>
+#include <GLType/ProgramShader.h>
+#include <GLType/RenderStateCache.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+#include <cstring>
+
 #include "BaseMesh.h"
+#include "FrustumCuller.h"
+#include "MeshCache.h"
+#include "MeshLod.h"
+
+namespace {
+	// Part of the mesh cache key
+	const unsigned int kImportFlags = aiProcess_Triangulate 
+		| aiProcess_GenSmoothNormals 
+		| aiProcess_SplitLargeMeshes
+		| aiProcess_SortByPType
+		| aiProcess_OptimizeMeshes
+		| aiProcess_CalcTangentSpace
+		| aiProcess_JoinIdenticalVertices
+		;
+
+	struct SubmeshData
+	{
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec3> normals;
+		std::vector<glm::vec2> texcoords;
+		std::vector<glm::vec4> tangents;
+		std::vector<uint32_t> indices;
+		std::vector<MeshLod> lods;
+		std::vector<mesh_optimizer::Meshlet> meshlets;
+		glm::vec3 bmin, bmax;
+	};
+
+	// std430 layout of the meshlets read by MeshletCull.glsl
+	struct MeshletCullData
+	{
+		glm::vec4 sphere;		// center, radius
+		glm::vec4 cone;			// axis, cutoff
+		uint32_t indexOffset;	// in bytes, inside the model index buffer
+		uint32_t indexCount;
+		uint32_t vertexBase;
+		uint32_t shortIndex;
+	};
+
+	const GLuint kMeshletGroupCount = 65535;	// per dispatch dimension
+
+	void loadSubmesh(const aiMesh* paiMesh, SubmeshData& submesh)
+	{
+		const unsigned int NumVertices = paiMesh->mNumVertices;
+		submesh.positions.resize(NumVertices);
+		submesh.normals.resize(NumVertices);
+		submesh.texcoords.resize(NumVertices);
+		submesh.tangents.resize(NumVertices);
+
+		bool bHasTex = paiMesh->HasTextureCoords(0);
+		bool bHasTangent = paiMesh->HasTangentsAndBitangents();
+		const aiVector3D zero(0.f, 0.f, 0.f);
+		for (unsigned int i = 0; i < NumVertices; i++)
+		{
+			const aiVector3D& pos = paiMesh->mVertices[i];
+			const aiVector3D& nor = paiMesh->mNormals[i];
+			const aiVector3D& tex = bHasTex ? paiMesh->mTextureCoords[0][i] : zero;
+
+			submesh.positions[i] = glm::vec3(pos.x, pos.y, pos.z);
+			submesh.texcoords[i] = glm::vec2(tex.x, tex.y);
+			submesh.normals[i] = glm::vec3(nor.x, nor.y, nor.z);
+
+			// handedness from the imported bitangent
+			if (bHasTangent)
+			{
+				const aiVector3D& tan = paiMesh->mTangents[i];
+				const aiVector3D& bit = paiMesh->mBitangents[i];
+				submesh.tangents[i] = tangent_space::makeTangent(submesh.normals[i],
+					glm::vec3(tan.x, tan.y, tan.z), glm::vec3(bit.x, bit.y, bit.z));
+			}
+		}
+
+		submesh.bmin = submesh.bmax = NumVertices ? submesh.positions[0] : glm::vec3(0.f);
+		for (unsigned int i = 1; i < NumVertices; i++)
+		{
+			submesh.bmin = glm::min(submesh.bmin, submesh.positions[i]);
+			submesh.bmax = glm::max(submesh.bmax, submesh.positions[i]);
+		}
+
+		submesh.indices.resize(paiMesh->mNumFaces*3);
+		for (unsigned int i = 0; i < paiMesh->mNumFaces; i++) {
+			const aiFace& face = paiMesh->mFaces[i];
+            const unsigned int base = i*3;
+			for (unsigned int j = 0; j < 3; j++)
+				submesh.indices[base + j] = face.mIndices[j];
+		}
+
+		if (!bHasTangent)
+			tangent_space::generateTangents(submesh.indices, submesh.positions, submesh.normals, submesh.texcoords, submesh.tangents);
+	}
+
+	// Post-transform cache, overdraw, then vertex fetch order
+	void optimizeSubmesh(SubmeshData& submesh)
+	{
+		if (submesh.indices.empty())
+			return;
+
+		const size_t NumVertices = submesh.positions.size();
+		mesh_optimizer::optimizeVertexCache(submesh.indices, NumVertices);
+		mesh_optimizer::optimizeOverdraw(submesh.indices, submesh.positions.data(), NumVertices);
+
+		size_t NumUsed = 0;
+		std::vector<uint32_t> remap = mesh_optimizer::optimizeVertexFetch(submesh.indices, NumVertices, NumUsed);
+		mesh_optimizer::remapVertices(submesh.positions, remap, NumUsed);
+		mesh_optimizer::remapVertices(submesh.normals, remap, NumUsed);
+		mesh_optimizer::remapVertices(submesh.texcoords, remap, NumUsed);
+		mesh_optimizer::remapVertices(submesh.tangents, remap, NumUsed);
+
+		// Coarser levels, appended to the indices
+		generateLods(submesh.indices, submesh.positions.data(), NumUsed, kMaxMeshLods, submesh.lods);
+
+		// Clusters of the full level for the GPU culling
+		mesh_optimizer::buildMeshlets(submesh.meshlets, submesh.indices.data(), submesh.lods[0].indexCount,
+			submesh.positions.data(), NumUsed);
+	}
+}
 
 ModelAssImp::ModelAssImp()
 {
 	m_VAO = 0;
 	m_IBO = 0;
-	for (unsigned int i = 0; i < VATTR_COUNT; i++)
-		m_VBO[i] = 0;
+	m_VBO = 0;
+	m_CullVAO = 0;
+	m_MeshletCount = 0;
+	m_Arena = nullptr;
+	m_BoundingSphere = glm::vec4(0.f);
+	m_VertexFormat = VertexFormat::Compact();
 }
 
 ModelAssImp::~ModelAssImp()
@@ -29,8 +162,9 @@ ModelAssImp::~ModelAssImp()
 void ModelAssImp::create()
 {
 	glGenVertexArrays(1, &m_VAO);   
-	glGenBuffers(VATTR_COUNT, m_VBO);   
+	glGenBuffers(1, &m_VBO);   
 	glGenBuffers(1, &m_IBO);   
+	glGenVertexArrays(1, &m_CullVAO);   
 }
 
 void ModelAssImp::destroy()
@@ -41,34 +175,92 @@ void ModelAssImp::destroy()
 		m_IBO = 0;
 	}
 
-	glDeleteBuffers(VATTR_COUNT, m_VBO);
-	for (unsigned int i = 0; i < VATTR_COUNT; i++)
-		m_VBO[i] = 0;
+	if (m_VBO)
+	{
+		glDeleteBuffers(1, &m_VBO);
+		m_VBO = 0;
+	}
 
 	if (m_VAO)
 	{
+		RenderStateCache::getInstance().onVertexArrayDeleted(m_VAO);
 		glDeleteVertexArrays(1, &m_VAO);
 		m_VAO = 0;
 	}
 
+	if (m_CullVAO)
+	{
+		RenderStateCache::getInstance().onVertexArrayDeleted(m_CullVAO);
+		glDeleteVertexArrays(1, &m_CullVAO);
+		m_CullVAO = 0;
+	}
+
+	m_MeshletBuffer = nullptr;
+	m_CulledIndexBuffer = nullptr;
+	m_DrawCommandBuffer = nullptr;
+	m_MeshletCount = 0;
+
+	for (auto& mesh : m_Meshes)
+		if (m_Arena && mesh->m_ArenaMesh != GeometryArena::kInvalidMesh)
+			m_Arena->removeMesh(mesh->m_ArenaMesh);
+
 	m_Meshes.clear();
 	m_Materials.clear();
+	m_BoundingSphere = glm::vec4(0.f);
 }
 
 bool ModelAssImp::loadFromFile(const std::string& filename)
 {
-	Assimp::Importer Importer;
+	const uint64_t sourceHash = MeshCache::hashFile(filename);
+	if (sourceHash == 0)
+	{
+		fprintf(stderr, "ModelAssImp : unable to read \"%s\".\n", filename.c_str());
+		return false;
+	}
 
-	int postprocess = aiProcess_Triangulate 
-		| aiProcess_GenSmoothNormals 
-		| aiProcess_SplitLargeMeshes
-		| aiProcess_SortByPType
-		| aiProcess_OptimizeMeshes
-		| aiProcess_CalcTangentSpace
-		| aiProcess_JoinIdenticalVertices
-		;
+	// Reuse the GPU ready data of a previous import
+	const std::string cachename = filename + ".meshcache";
+	MeshCache cache;
+	if (cache.open(cachename, sourceHash, kImportFlags, m_VertexFormat))
+	{
+		m_VertexLayout = cache.getLayout();
+		for (uint32_t i = 0; i < cache.getSubmeshCount(); i++)
+			addMesh(cache.getSubmeshes()[i]);
+		upload(cache.getVertexData(), cache.getVertexSize(), cache.getIndexData(), cache.getIndexSize(),
+			cache.getSubmeshes(), cache.getSubmeshCount(), cache.getMeshlets());
+		if (m_Arena)
+			addToArena(cache.getVertexData(), cache.getVertexSize(), cache.getIndexData(), cache.getSubmeshes(), cache.getSubmeshCount());
+		return true;
+	}
 
-	const aiScene* pScene = Importer.ReadFile(filename.c_str(), postprocess);
+	std::vector<MeshCacheSubmesh> submeshes;
+	std::vector<mesh_optimizer::Meshlet> meshlets;
+	std::vector<uint8_t> vertices;
+	std::vector<uint8_t> indices;
+	if (!importFile(filename, submeshes, meshlets, vertices, indices))
+		return false;
+
+	for (auto& submesh : submeshes)
+		addMesh(submesh);
+	upload(vertices.data(), vertices.size(), indices.data(), indices.size(),
+		submeshes.data(), uint32_t(submeshes.size()), meshlets.data());
+	if (m_Arena)
+		addToArena(vertices.data(), vertices.size(), indices.data(), submeshes.data(), uint32_t(submeshes.size()));
+
+	MeshCache::write(cachename, sourceHash, kImportFlags, m_VertexLayout, submeshes, meshlets, vertices, indices);
+	return true;
+}
+
+bool ModelAssImp::importFile(
+	const std::string& filename,
+	std::vector<MeshCacheSubmesh>& submeshes,
+	std::vector<mesh_optimizer::Meshlet>& meshlets,
+	std::vector<uint8_t>& vertices,
+	std::vector<uint8_t>& indices)
+{
+	Assimp::Importer Importer;
+
+	const aiScene* pScene = Importer.ReadFile(filename.c_str(), kImportFlags);
 	assert(pScene != nullptr);
 	if (!pScene) return false;
 
@@ -77,17 +269,7 @@ bool ModelAssImp::loadFromFile(const std::string& filename)
 	{
 	}
 
-	unsigned int NumIndices = 0;
-	unsigned int NumVertices = 0;
-	auto NumMeshes = pScene->mNumMeshes;
-	auto NumMaterials = pScene->mNumMaterials;
-
-	for (auto i = 0; i < NumMeshes; i++)
-	{
-		const aiMesh* paiMesh = pScene->mMeshes[i];
-		NumVertices += paiMesh->mNumVertices;
-		NumIndices += paiMesh->mNumFaces*3;
-	}
+	const unsigned int NumMeshes = pScene->mNumMeshes;
 
 	// material
 	for (uint32_t i = 0; i < pScene->mNumMaterials; i++)
@@ -95,83 +277,313 @@ bool ModelAssImp::loadFromFile(const std::string& filename)
 
 	}
 
-	// Apppend all vertex and index
-	std::vector<glm::vec3> positions(NumVertices);
-	std::vector<glm::vec3> normals(NumVertices);
-	std::vector<glm::vec2> texcoords(NumVertices);
-	std::vector<unsigned int> indices(NumIndices);
+	// Load and optimize the submeshes concurrently
+	std::vector<SubmeshData> data(NumMeshes);
+	parallelFor(NumMeshes, [&](size_t meshIdx) {
+		loadSubmesh(pScene->mMeshes[meshIdx], data[meshIdx]);
+		optimizeSubmesh(data[meshIdx]);
+	});
+
+	// Prefix sums of the vertex and index ranges, 16-bit indices when the
+	// submesh has few enough vertices
+	submeshes.resize(NumMeshes);
+	size_t NumVertices = 0u, NumIndexBytes = 0u;
+	glm::vec3 bmin(FLT_MAX), bmax(-FLT_MAX);
 
-	unsigned int baseVert = 0u, baseIdx = 0u;
 	for (uint32_t meshIdx = 0; meshIdx < NumMeshes; meshIdx++)
 	{
-		const aiMesh* paiMesh = pScene->mMeshes[meshIdx];
-		BaseMeshPtr mesh = std::make_shared<BaseMesh>();
-		mesh->m_MaterialIndex = paiMesh->mMaterialIndex;
-		if (mesh->m_MaterialIndex < m_Materials.size()) 
-			mesh->m_Material = m_Materials[mesh->m_MaterialIndex];
-
-		// vertex buffer
-		bool bHasTex = paiMesh->HasTextureCoords(0);
-		const aiVector3D zero(0.f, 0.f, 0.f);
-		for (int i = 0; i < NumVertices; i++)
+		const SubmeshData& submesh = data[meshIdx];
+		const bool bShortIndex = submesh.positions.size() <= 0x10000;
+		const size_t indexSize = bShortIndex ? sizeof(uint16_t) : sizeof(uint32_t);
+
+		MeshCacheSubmesh& range = submeshes[meshIdx];
+		range.materialIndex = pScene->mMeshes[meshIdx]->mMaterialIndex;
+		range.vertexBase = uint32_t(NumVertices);
+		range.indexCount = uint32_t(submesh.indices.size());
+		range.indexType = bShortIndex ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+		range.indexOffset = (NumIndexBytes + indexSize - 1) / indexSize * indexSize;
+
+		const glm::vec4 sphere = computeBoundingSphere(submesh.positions.data(), submesh.positions.size());
+		memcpy(range.boundingSphere, &sphere[0], sizeof(range.boundingSphere));
+		range.lodCount = uint32_t(submesh.lods.size());
+		range.meshletCount = uint32_t(submesh.meshlets.size());
+		meshlets.insert(meshlets.end(), submesh.meshlets.begin(), submesh.meshlets.end());
+		memset(range.lods, 0, sizeof(range.lods));
+		std::copy(submesh.lods.begin(), submesh.lods.end(), range.lods);
+
+		NumVertices += submesh.positions.size();
+		NumIndexBytes = size_t(range.indexOffset) + submesh.indices.size()*indexSize;
+
+		if (!submesh.positions.empty())
 		{
-			const aiVector3D& pos = paiMesh->mVertices[i];
-			const aiVector3D& nor = paiMesh->mNormals[i];
-			const aiVector3D& tex = bHasTex ? paiMesh->mTextureCoords[0][i] : zero;
-
-			positions[baseVert + i] = glm::vec3(pos.x, pos.y, pos.z);
-			texcoords[baseVert + i] = glm::vec2(tex.x, tex.y);
-			normals[baseVert + i] = glm::vec3(nor.x, nor.y, nor.z);
+			bmin = glm::min(bmin, submesh.bmin);
+			bmax = glm::max(bmax, submesh.bmax);
 		}
+	}
 
-		// index buffer 
-		for (unsigned int i = 0; i < paiMesh->mNumFaces; i++) {
-			const aiFace& face = paiMesh->mFaces[i];
-            const unsigned int base = i*3;
-			for (unsigned int j = 0; j < 3; j++)
-				indices[baseIdx + base + j] = face.mIndices[j];
-		}
+	if (NumVertices == 0u)
+		bmin = bmax = glm::vec3(0.f);
 
-		mesh->m_VertexBase = baseVert;
-		mesh->m_IndexBase = baseIdx;
-		mesh->m_IndexCount = paiMesh->mNumFaces*3;
-		m_Meshes.push_back(mesh);
+	// One staging allocation per buffer, the model bounds drive the quantization
+	m_VertexLayout = makeVertexLayout(m_VertexFormat, true, true, true, bmin, bmax);
+	vertices.resize(NumVertices*m_VertexLayout.stride);
+	indices.assign((NumIndexBytes + 3u) & ~size_t(3u), 0u);	// read as uint[] by the culling
 
-		baseVert += paiMesh->mNumVertices;
-		baseIdx += paiMesh->mNumFaces*3;
-	}
+	// Fill the ranges concurrently
+	parallelFor(NumMeshes, [&](size_t meshIdx) {
+		const SubmeshData& submesh = data[meshIdx];
+		const MeshCacheSubmesh& range = submeshes[meshIdx];
 
-    GL_ASSERT(glBindVertexArray(m_VAO));
+		packVertices(m_VertexLayout, submesh.positions.size(),
+			submesh.positions.data(), submesh.normals.data(), submesh.texcoords.data(), submesh.tangents.data(),
+			vertices.data() + size_t(range.vertexBase)*m_VertexLayout.stride);
+
+		uint8_t* dst = indices.data() + range.indexOffset;
+		if (range.indexType == GL_UNSIGNED_SHORT)
+		{
+			for (size_t i = 0; i < submesh.indices.size(); i++, dst += sizeof(uint16_t))
+			{
+				uint16_t index = uint16_t(submesh.indices[i]);
+				memcpy(dst, &index, sizeof(uint16_t));
+			}
+		}
+		else if (!submesh.indices.empty())
+			memcpy(dst, submesh.indices.data(), submesh.indices.size()*sizeof(uint32_t));
+	});
+
+	return true;
+}
 
-	GL_ASSERT(glBindBuffer(GL_ARRAY_BUFFER, m_VBO[VATTR_POSITION]));
-	GL_ASSERT(glBufferData(GL_ARRAY_BUFFER, sizeof(positions[0])*positions.size(), positions.data(), GL_STATIC_DRAW));
-	GL_ASSERT(glEnableVertexAttribArray(VATTR_POSITION));
-	GL_ASSERT(glVertexAttribPointer(VATTR_POSITION, 3, GL_FLOAT, GL_FALSE, 0, 0));
+void ModelAssImp::addMesh(const MeshCacheSubmesh& submesh)
+{
+	BaseMeshPtr mesh = std::make_shared<BaseMesh>();
+	mesh->m_MaterialIndex = submesh.materialIndex;
+	if (mesh->m_MaterialIndex >= 0 && size_t(mesh->m_MaterialIndex) < m_Materials.size())
+		mesh->m_Material = m_Materials[mesh->m_MaterialIndex];
+
+	mesh->m_VertexBase = submesh.vertexBase;
+	mesh->m_IndexOffset = size_t(submesh.indexOffset);
+	mesh->m_IndexType = submesh.indexType;
+	mesh->m_Lods.assign(submesh.lods, submesh.lods + std::min(submesh.lodCount, uint32_t(kMaxMeshLods)));
+	mesh->m_IndexCount = mesh->m_Lods.empty() ? submesh.indexCount : mesh->m_Lods[0].indexCount;
+	mesh->m_BoundingSphere = glm::vec4(submesh.boundingSphere[0], submesh.boundingSphere[1],
+		submesh.boundingSphere[2], submesh.boundingSphere[3]);
+	m_BoundingSphere = mergeSpheres(m_BoundingSphere, mesh->m_BoundingSphere);
+	m_Meshes.push_back(mesh);
+}
 
-	glBindBuffer(GL_ARRAY_BUFFER, m_VBO[VATTR_NORMAL]);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(normals[0])*normals.size(), normals.data(), GL_STATIC_DRAW);
-	glEnableVertexAttribArray(VATTR_NORMAL);
-	glVertexAttribPointer(VATTR_NORMAL, 3, GL_FLOAT, GL_FALSE, 0, 0);
+void ModelAssImp::upload(
+	const void* vertices, size_t vertexSize,
+	const void* indices, size_t indexSize,
+	const MeshCacheSubmesh* submeshes, uint32_t submeshCount,
+	const mesh_optimizer::Meshlet* meshlets)
+{
+    GL_ASSERT(RenderStateCache::getInstance().bindVertexArray(m_VAO));
 
-	glBindBuffer(GL_ARRAY_BUFFER, m_VBO[VATTR_TEXCOORD]);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(texcoords[0])*texcoords.size(), texcoords.data(), GL_STATIC_DRAW);
-	glEnableVertexAttribArray(VATTR_TEXCOORD);
-	glVertexAttribPointer(VATTR_TEXCOORD, 2, GL_FLOAT, GL_FALSE, 0, 0);
+	GL_ASSERT(glBindBuffer(GL_ARRAY_BUFFER, m_VBO));
+	GL_ASSERT(glBufferData(GL_ARRAY_BUFFER, vertexSize, vertices, GL_STATIC_DRAW));
+	m_VertexLayout.setAttribPointers();
+	m_VertexLayout.enable();
 
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices[0])*indices.size(), indices.data(), GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexSize, indices, GL_STATIC_DRAW);
 	
-    glBindVertexArray(0);	
+    RenderStateCache::getInstance().bindVertexArray(0);	
+
+	// Meshlets with absolute ranges, and room for all of them once culled
+	std::vector<MeshletCullData> cullData;
+	size_t NumCulledIndices = 0u;
+	for (uint32_t i = 0; i < submeshCount; i++)
+	{
+		const MeshCacheSubmesh& submesh = submeshes[i];
+		const size_t indexSize = (submesh.indexType == GL_UNSIGNED_SHORT) ? sizeof(uint16_t) : sizeof(uint32_t);
+
+		for (uint32_t j = 0; j < submesh.meshletCount; j++, meshlets++)
+		{
+			MeshletCullData data;
+			data.sphere = glm::vec4(meshlets->center, meshlets->radius);
+			data.cone = glm::vec4(meshlets->coneAxis, meshlets->coneCutoff);
+			data.indexOffset = uint32_t(submesh.indexOffset + meshlets->firstIndex*indexSize);
+			data.indexCount = meshlets->indexCount;
+			data.vertexBase = submesh.vertexBase;
+			data.shortIndex = (submesh.indexType == GL_UNSIGNED_SHORT) ? 1u : 0u;
+			cullData.push_back(data);
+			NumCulledIndices += meshlets->indexCount;
+		}
+	}
+
+	m_MeshletCount = uint32_t(cullData.size());
+	if (m_MeshletCount > 0)
+	{
+		m_MeshletBuffer = GraphicsBuffer::Create(GL_SHADER_STORAGE_BUFFER, cullData.size()*sizeof(MeshletCullData), 0, cullData.data());
+		m_CulledIndexBuffer = GraphicsBuffer::Create(GL_ELEMENT_ARRAY_BUFFER, NumCulledIndices*sizeof(uint32_t), 0);
+		m_DrawCommandBuffer = GraphicsBuffer::Create(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand), GL_DYNAMIC_STORAGE_BIT);
+
+		GL_ASSERT(RenderStateCache::getInstance().bindVertexArray(m_CullVAO));
+		GL_ASSERT(glBindBuffer(GL_ARRAY_BUFFER, m_VBO));
+		m_VertexLayout.setAttribPointers();
+		m_VertexLayout.enable();
+		m_CulledIndexBuffer->bind();
+		RenderStateCache::getInstance().bindVertexArray(0);
+	}
 
 	CHECKGLERROR();
+}
+
+void ModelAssImp::addToArena(
+	const void* vertices, size_t vertexSize,
+	const void* indices,
+	const MeshCacheSubmesh* submeshes, uint32_t submeshCount)
+{
+	// The arena takes 32-bit indices and the vertex count of each submesh
+	const size_t NumVertices = vertexSize / m_VertexLayout.stride;
+	std::vector<uint32_t> index32;
+
+	for (uint32_t i = 0; i < submeshCount; i++)
+	{
+		const MeshCacheSubmesh& submesh = submeshes[i];
+		const uint32_t vertexEnd = (i + 1 < submeshCount) ? submeshes[i + 1].vertexBase : uint32_t(NumVertices);
+		const uint8_t* src = static_cast<const uint8_t*>(indices) + submesh.indexOffset;
 
+		index32.resize(submesh.indexCount);
+		if (submesh.indexType == GL_UNSIGNED_SHORT)
+		{
+			for (uint32_t k = 0; k < submesh.indexCount; k++, src += sizeof(uint16_t))
+			{
+				uint16_t index;
+				memcpy(&index, src, sizeof(uint16_t));
+				index32[k] = index;
+			}
+		}
+		else if (submesh.indexCount > 0)
+			memcpy(index32.data(), src, submesh.indexCount*sizeof(uint32_t));
+
+		BaseMesh& mesh = *m_Meshes[m_Meshes.size() - submeshCount + i];
+		mesh.m_ArenaMesh = m_Arena->addMesh(m_VertexLayout,
+			static_cast<const uint8_t*>(vertices) + size_t(submesh.vertexBase)*m_VertexLayout.stride,
+			vertexEnd - submesh.vertexBase, index32.data(), submesh.indexCount,
+			mesh.m_Lods, mesh.m_BoundingSphere);
+	}
+
+	if (!isInArena())
+		fprintf(stderr, "ModelAssImp : the arena can't hold every submesh, drawing from the model buffers.\n");
+}
+
+bool ModelAssImp::isInArena() const
+{
+	if (!m_Arena || m_Meshes.empty())
+		return false;
+	for (auto& mesh : m_Meshes)
+		if (mesh->m_ArenaMesh == GeometryArena::kInvalidMesh)
+			return false;
 	return true;
 }
 
+uint32_t ModelAssImp::submit(const LodSelector& selector, const glm::mat4& model, const FrustumCuller* culler)
+{
+	cullSubmeshes(model, culler);
+	for (uint32_t i : m_VisibleMeshes)
+	{
+		const BaseMesh& mesh = *m_Meshes[i];
+		m_Arena->draw(mesh.m_ArenaMesh, model, glm::vec4(0.f), selector.select(mesh.m_Lods, mesh.m_BoundingSphere, model));
+	}
+	return uint32_t(m_VisibleMeshes.size());
+}
+
+void ModelAssImp::submitInstanced(const glm::mat4* models, uint32_t count, size_t lod)
+{
+	for (auto& mesh : m_Meshes)
+		m_Arena->drawInstanced(mesh->m_ArenaMesh, models, nullptr, count, lod);
+}
+
 void ModelAssImp::render()
 {
-    glBindVertexArray(m_VAO);	
+    RenderStateCache::getInstance().bindVertexArray(m_VAO);	
 	for (auto& mesh : m_Meshes)
 		mesh->render();
-    glBindVertexArray(0);	
+}
+
+uint32_t ModelAssImp::render(const LodSelector& selector, const glm::mat4& model, const FrustumCuller* culler)
+{
+	cullSubmeshes(model, culler);
+	if (m_VisibleMeshes.empty())
+		return 0u;
+
+    RenderStateCache::getInstance().bindVertexArray(m_VAO);	
+	for (uint32_t i : m_VisibleMeshes)
+	{
+		BaseMesh& mesh = *m_Meshes[i];
+		mesh.render(selector.select(mesh.m_Lods, mesh.m_BoundingSphere, model));
+	}
+	return uint32_t(m_VisibleMeshes.size());
+}
+
+void ModelAssImp::cullSubmeshes(const glm::mat4& model, const FrustumCuller* culler)
+{
+	m_VisibleMeshes.clear();
+	if (!culler)
+	{
+		for (uint32_t i = 0; i < uint32_t(m_Meshes.size()); i++)
+			m_VisibleMeshes.push_back(i);
+		return;
+	}
+
+	// the whole model first, then its submeshes 4 at a time
+	if (!culler->isVisible(transformSphere(m_BoundingSphere, model)))
+		return;
+
+	m_CullSpheres.clear();
+	for (auto& mesh : m_Meshes)
+		m_CullSpheres.add(transformSphere(mesh->m_BoundingSphere, model));
+	culler->cull(m_CullSpheres, m_VisibleMeshes);
+}
+
+void ModelAssImp::cullMeshlets(ProgramShader& cullProgram, const glm::mat4& viewProj, const glm::vec3& eyePos, const glm::mat4& model)
+{
+	if (m_MeshletCount == 0)
+		return;
+
+	// Test in object space, the meshlet bounds stay as they are
+	const glm::mat4 mvp = viewProj * model;
+	const nv_helpers::Frustum frustum(glm::value_ptr(mvp));
+	const glm::vec3 eyePosOS = glm::vec3(glm::inverse(model) * glm::vec4(eyePos, 1.f));
+
+	const DrawElementsIndirectCommand command = { 0u, 1u, 0u, 0, 0u };
+	m_DrawCommandBuffer->update(0, sizeof(command), &command);
+
+	cullProgram.bind();
+	cullProgram.setUniform("uMeshletCount", GLint(m_MeshletCount));
+	cullProgram.setUniform("uEyePosOS", eyePosOS);
+	for (int i = 0; i < nv_helpers::Frustum::NUM_PLANES; i++)
+	{
+		const float* plane = frustum.m_planes[i];
+		cullProgram.setUniform("uFrustumPlanes[" + std::to_string(i) + "]", glm::vec4(plane[0], plane[1], plane[2], plane[3]));
+	}
+
+	m_MeshletBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_IBO);
+	m_CulledIndexBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, 2);
+	m_DrawCommandBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, 3);
+
+	// One work group per meshlet
+	const GLuint groupCountX = std::min(m_MeshletCount, uint32_t(kMeshletGroupCount));
+	cullProgram.Dispatch(groupCountX, (m_MeshletCount + groupCountX - 1) / groupCountX);
+	cullProgram.unbind();
+
+	glMemoryBarrier(GL_ELEMENT_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+	CHECKGLERROR();
+}
+
+void ModelAssImp::renderCulled()
+{
+	if (m_MeshletCount == 0)
+	{
+		render();
+		return;
+	}
+
+    RenderStateCache::getInstance().bindVertexArray(m_CullVAO);	
+	m_DrawCommandBuffer->bind();
+	GL_ASSERT(glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr));
+	m_DrawCommandBuffer->unbind();
 }
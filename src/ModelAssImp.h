@@ -1,15 +1,17 @@
 #include <Types.h>
+#include <GraphicsTypes.h>
 #include <GL/glew.h>
+#include <GLType/VertexBuffer.h>
+#include <FrustumCuller.h>
 #include <string>
+#include <vector>
 
-enum VertexAttrib
-{
-	VATTR_POSITION = 0,
-	VATTR_NORMAL,
-	VATTR_TEXCOORD,
+struct MeshCacheSubmesh;
+class LodSelector;
+class ProgramShader;
+class GeometryArena;
 
-	VATTR_COUNT
-};
+namespace mesh_optimizer { struct Meshlet; }
 
 class ModelAssImp
 {
@@ -21,13 +23,81 @@ public:
 	void destroy();
 	void render();
 
+	/**
+	 * Draw each submesh at the level picked for the model matrix 'model',
+	 * the ones outside the frustum of 'culler' are skipped. Returns the draw count.
+	 */
+	uint32_t render(const LodSelector& selector, const glm::mat4& model, const FrustumCuller* culler = nullptr);
+
+	/**
+	 * Cull the meshlets outside the frustum or facing away from the eye, and
+	 * write the indices of the others for renderCulled. To call with no
+	 * program bound, 'cullProgram' is built from "MeshletCull.Compute".
+	 */
+	void cullMeshlets(ProgramShader& cullProgram, const glm::mat4& viewProj, const glm::vec3& eyePos, const glm::mat4& model);
+
+	/** Draw the meshlets kept by cullMeshlets in a single indirect draw */
+	void renderCulled();
+
 	bool loadFromFile(const std::string& filename);
 
+	/** Also store the submeshes in a shared arena, to set before loadFromFile */
+	void setArena(GeometryArena* arena) { m_Arena = arena; }
+	bool isInArena() const;
+
+	/** Queue each visible submesh in the arena at the level picked for 'model', as render() */
+	uint32_t submit(const LodSelector& selector, const glm::mat4& model, const FrustumCuller* culler = nullptr);
+
+	/** Queue 'count' instances of the whole model at one level */
+	void submitInstanced(const glm::mat4* models, uint32_t count, size_t lod = 0);
+
+	/** Vertex storage, to set before loadFromFile */
+	void setVertexFormat(const VertexFormat& format) { m_VertexFormat = format; }
+	const VertexLayout& getVertexLayout() const { return m_VertexLayout; }
+
+	/** Object space bounds of every submesh */
+	const glm::vec4& getBoundingSphere() const { return m_BoundingSphere; }
+	uint32_t getSubmeshCount() const { return uint32_t(m_Meshes.size()); }
+
 	GLuint m_VAO;
 	GLuint m_IBO;
-	GLuint m_VBO[VATTR_COUNT];
+	GLuint m_VBO;
+	GLuint m_CullVAO;		// same vertices, culled indices
+
+	GraphicsBufferPtr m_MeshletBuffer;
+	GraphicsBufferPtr m_CulledIndexBuffer;
+	GraphicsBufferPtr m_DrawCommandBuffer;
+	uint32_t m_MeshletCount;
+	GeometryArena* m_Arena;
+
+	VertexFormat m_VertexFormat;
+	VertexLayout m_VertexLayout;
 
 	BaseMeshList m_Meshes;
 	BaseMaterialList m_Materials;
+	glm::vec4 m_BoundingSphere;
+
+private:
+	/** Run AssImp and build the GPU ready buffers */
+	bool importFile(
+		const std::string& filename,
+		std::vector<MeshCacheSubmesh>& submeshes,
+		std::vector<mesh_optimizer::Meshlet>& meshlets,
+		std::vector<uint8_t>& vertices,
+		std::vector<uint8_t>& indices);
+	void addMesh(const MeshCacheSubmesh& submesh);
+	void cullSubmeshes(const glm::mat4& model, const FrustumCuller* culler);
+	void upload(
+		const void* vertices, size_t vertexSize,
+		const void* indices, size_t indexSize,
+		const MeshCacheSubmesh* submeshes, uint32_t submeshCount,
+		const mesh_optimizer::Meshlet* meshlets);
+	void addToArena(
+		const void* vertices, size_t vertexSize,
+		const void* indices,
+		const MeshCacheSubmesh* submeshes, uint32_t submeshCount);
+
+	SphereBatch m_CullSpheres;
+	std::vector<uint32_t> m_VisibleMeshes;
 };
 
@@ -0,0 +1,218 @@
+#include "RenderQueue.h"
+
+#include <BaseMaterial.h>
+#include <Mesh.h>
+#include <GLType/ProgramShader.h>
+#include <GLType/RenderStateCache.h>
+#include <tools/gltools.hpp>
+
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+	const uint32_t kProgramBits = 12;
+	const uint32_t kMaterialBits = 16;
+	const uint32_t kMeshBits = 16;
+	const uint32_t kDepthBits = 16;
+
+	const uint32_t kMeshShift = kDepthBits;
+	const uint32_t kMaterialShift = kMeshShift + kMeshBits;
+	const uint32_t kProgramShift = kMaterialShift + kMaterialBits;
+	const uint32_t kPassShift = kProgramShift + kProgramBits;
+
+	// front to back passes : pass | depth | program | material | mesh
+	const uint32_t kStateBits = kProgramBits + kMaterialBits + kMeshBits;
+}
+
+void RenderQueue::setPassState(uint32_t pass, const PassState& state)
+{
+	assert(pass < kPassCount);
+	m_PassStates[pass] = state;
+}
+
+void RenderQueue::setDepthPrepass(uint32_t pass, uint32_t depthPass, ProgramShader* program)
+{
+	assert(pass < kPassCount && depthPass < kPassCount);
+	assert(depthPass != pass);
+	m_Prepasses[pass].program = program;
+	m_Prepasses[pass].pass = depthPass;
+}
+
+void RenderQueue::clear(const glm::vec3& eye, float farDistance)
+{
+	m_Eye = eye;
+	m_InvFarDistance = (farDistance > 0.f) ? 1.f / farDistance : 0.f;
+
+	m_Packets.clear();
+	m_Entries.clear();
+	m_ProgramSlots.clear();
+	m_MaterialSlots.clear();
+	m_MeshSlots.clear();
+}
+
+void RenderQueue::submit(uint32_t pass, ProgramShader& program, const BaseMaterial* material,
+	const Mesh& mesh, size_t lod, const glm::mat4& model)
+{
+	push(pass, Packet{ &program, material, &mesh, lod, model, nullptr }, glm::vec3(model[3]));
+}
+
+void RenderQueue::submit(uint32_t pass, ProgramShader& program, const BaseMaterial* material,
+	std::function<void(ProgramShader&)> draw, const glm::vec3& position)
+{
+	push(pass, Packet{ &program, material, nullptr, 0, glm::mat4(1.f), std::move(draw) }, position);
+}
+
+void RenderQueue::push(uint32_t pass, Packet&& packet, const glm::vec3& position)
+{
+	assert(pass < kPassCount);
+
+	// same draw, without the material
+	const Prepass& prepass = m_Prepasses[pass];
+	if (prepass.program)
+	{
+		Packet depthPacket = packet;
+		depthPacket.program = prepass.program;
+		depthPacket.material = nullptr;
+
+		const uint64_t key = makeKey(prepass.pass, *prepass.program, nullptr, depthPacket.mesh, position);
+		m_Entries.push_back(SortEntry{ key, uint32_t(m_Packets.size()) });
+		m_Packets.push_back(std::move(depthPacket));
+	}
+
+	const uint64_t key = makeKey(pass, *packet.program, packet.material, packet.mesh, position);
+	m_Entries.push_back(SortEntry{ key, uint32_t(m_Packets.size()) });
+	m_Packets.push_back(std::move(packet));
+}
+
+void RenderQueue::execute()
+{
+	m_Stats = Stats();
+	m_Stats.packets = uint32_t(m_Packets.size());
+
+	radixSort(m_Entries, m_Scratch);
+
+	RenderStateCache& state = RenderStateCache::getInstance();
+	uint32_t pass = kPassCount;
+	ProgramShader* program = nullptr;
+	const BaseMaterial* material = nullptr;
+	const Mesh* mesh = nullptr;
+	GLint mtxSrtLocation = -1;
+
+	for (const SortEntry& entry : m_Entries)
+	{
+		const Packet& packet = m_Packets[entry.packet];
+
+		const uint32_t packetPass = uint32_t(entry.key >> kPassShift);
+		if (packetPass != pass)
+		{
+			pass = packetPass;
+			const PassState& passState = m_PassStates[pass];
+			const bool bPrepass = (nullptr != m_Prepasses[pass].program);
+			state.setEnabled(GL_DEPTH_TEST, passState.depthTest);
+			// the depth is complete, only the visible fragments pass
+			state.depthMask(passState.depthWrite && !bPrepass);
+			state.depthFunc(bPrepass ? GL_EQUAL : passState.depthFunc);
+			state.colorMask(passState.colorWrite);
+			state.setEnabled(GL_CULL_FACE, passState.cullFace);
+		}
+
+		// the material uniforms belong to the program, set them again after a change
+		if (packet.program != program)
+		{
+			program = packet.program;
+			program->bind();
+			mtxSrtLocation = program->getUniformLocation("uMtxSrt");
+			material = nullptr;
+			mesh = nullptr;
+			m_Stats.programChanges++;
+		}
+		if (packet.material && packet.material != material)
+		{
+			material = packet.material;
+			material->bind(*program);
+			m_Stats.materialChanges++;
+		}
+
+		if (packet.mesh)
+		{
+			if (packet.mesh != mesh)
+			{
+				mesh = packet.mesh;
+				program->setVertexLayout(mesh->getVertexLayout());
+			}
+			program->setUniform(mtxSrtLocation, packet.model);
+			mesh->drawLod(packet.lod);
+		}
+		else
+		{
+			// the callback may set its own layout
+			packet.draw(*program);
+			mesh = nullptr;
+		}
+	}
+
+	m_Entries.clear();
+	state.colorMask(true);
+	state.depthMask(true);
+	CHECKGLERROR();
+}
+
+uint64_t RenderQueue::getSlot(std::unordered_map<const void*, uint32_t>& slots, const void* object, uint32_t bits)
+{
+	if (!object)
+		return 0u;
+
+	auto it = slots.find(object);
+	if (it != slots.end())
+		return it->second;
+
+	// past the last slot the objects share it, the order stays valid
+	const uint32_t slot = std::min(uint32_t(slots.size()) + 1u, (1u << bits) - 1u);
+	slots.emplace(object, slot);
+	return slot;
+}
+
+uint64_t RenderQueue::makeKey(uint32_t pass, ProgramShader& program, const BaseMaterial* material, const Mesh* mesh, const glm::vec3& position)
+{
+	assert(pass < kPassCount);
+
+	const float depth = std::min(glm::length(position - m_Eye) * m_InvFarDistance, 1.f);
+	const uint64_t quantizedDepth = uint64_t(depth * float((1u << kDepthBits) - 1u));
+
+	const uint64_t stateBits = (getSlot(m_ProgramSlots, &program, kProgramBits) << kProgramShift)
+		| (getSlot(m_MaterialSlots, material, kMaterialBits) << kMaterialShift)
+		| (getSlot(m_MeshSlots, mesh, kMeshBits) << kMeshShift);
+
+	if (m_PassStates[pass].frontToBack)
+		return (uint64_t(pass) << kPassShift) | (quantizedDepth << kStateBits) | (stateBits >> kDepthBits);
+	return (uint64_t(pass) << kPassShift) | stateBits | quantizedDepth;
+}
+
+void RenderQueue::radixSort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch)
+{
+	scratch.resize(entries.size());
+
+	for (uint32_t shift = 0; shift < 64; shift += 8)
+	{
+		uint32_t offsets[256] = {};
+		for (const SortEntry& entry : entries)
+			offsets[(entry.key >> shift) & 0xFF]++;
+
+		// every key has the same byte
+		if (entries.empty() || offsets[(entries[0].key >> shift) & 0xFF] == entries.size())
+			continue;
+
+		uint32_t sum = 0;
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			const uint32_t count = offsets[i];
+			offsets[i] = sum;
+			sum += count;
+		}
+
+		for (const SortEntry& entry : entries)
+			scratch[offsets[(entry.key >> shift) & 0xFF]++] = entry;
+		entries.swap(scratch);
+	}
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+class BaseMaterial;
+class Mesh;
+class ProgramShader;
+
+/**
+ * Draws of a frame, sorted before they are issued. Each packet gets a 64-bit
+ * key, most significant first :
+ *
+ *	pass (4) | program (12) | material (16) | mesh (16) | depth (16)
+ *
+ * so a program is bound once per pass, a material once per program, and the
+ * draws of a mesh go front to back. Programs, materials and meshes get their
+ * key slot in submission order, the frame uniforms of a program are set by
+ * the caller before execute().
+ *
+ * A front to back pass moves the depth right after the pass, for the passes
+ * where hidden fragments cost more than the state changes. A pass with a
+ * depth pre-pass also submits its packets to the pre-pass with the depth
+ * program, then only shades the fragments of equal depth.
+ */
+class RenderQueue
+{
+public:
+	static const uint32_t kPassCount = 16;
+
+	/** State applied through RenderStateCache when a pass starts */
+	struct PassState
+	{
+		bool depthTest = true;
+		bool depthWrite = true;
+		GLenum depthFunc = GL_LEQUAL;
+		bool colorWrite = true;
+		bool cullFace = true;
+		bool frontToBack = false;
+	};
+
+	struct Stats
+	{
+		uint32_t packets = 0;
+		uint32_t programChanges = 0;
+		uint32_t materialChanges = 0;
+	};
+
+	void setPassState(uint32_t pass, const PassState& state);
+
+	/**
+	 * Draw the packets of 'pass' in 'depthPass' first with 'program', a depth
+	 * only program with the same vertex transform. Null disables the pre-pass.
+	 */
+	void setDepthPrepass(uint32_t pass, uint32_t depthPass, ProgramShader* program);
+
+	/** Forget the packets and slots, 'eye' and 'farDistance' quantize the depths */
+	void clear(const glm::vec3& eye, float farDistance);
+
+	/** Draw a level of 'mesh' with the uMtxSrt model matrix, 'material' may be null */
+	void submit(uint32_t pass, ProgramShader& program, const BaseMaterial* material,
+		const Mesh& mesh, size_t lod, const glm::mat4& model);
+
+	/**
+	 * Run 'draw' with the program and material bound, it gets the program since
+	 * the depth pre-pass runs it with its own. It must leave the program bound.
+	 */
+	void submit(uint32_t pass, ProgramShader& program, const BaseMaterial* material,
+		std::function<void(ProgramShader&)> draw, const glm::vec3& position = glm::vec3(0.f));
+
+	/** Sort the packets and issue them */
+	void execute();
+
+	const Stats& getStats() const { return m_Stats; }
+
+private:
+	struct Packet
+	{
+		ProgramShader* program;
+		const BaseMaterial* material;
+		const Mesh* mesh;			// null for the callbacks
+		size_t lod;
+		glm::mat4 model;
+		std::function<void(ProgramShader&)> draw;
+	};
+
+	struct Prepass
+	{
+		ProgramShader* program = nullptr;
+		uint32_t pass = 0;
+	};
+
+	struct SortEntry
+	{
+		uint64_t key;
+		uint32_t packet;
+	};
+
+	/** Slot of 'object' in 'slots', 0 is kept for null */
+	static uint64_t getSlot(std::unordered_map<const void*, uint32_t>& slots, const void* object, uint32_t bits);
+
+	uint64_t makeKey(uint32_t pass, ProgramShader& program, const BaseMaterial* material, const Mesh* mesh, const glm::vec3& position);
+
+	/** Queue 'packet' in 'pass', and in its depth pre-pass */
+	void push(uint32_t pass, Packet&& packet, const glm::vec3& position);
+
+	/** LSD radix sort on the key bytes, the passes of a constant byte are skipped */
+	static void radixSort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch);
+
+	PassState m_PassStates[kPassCount];
+	Prepass m_Prepasses[kPassCount];
+	glm::vec3 m_Eye = glm::vec3(0.f);
+	float m_InvFarDistance = 0.f;
+
+	std::vector<Packet> m_Packets;
+	std::vector<SortEntry> m_Entries;
+	std::vector<SortEntry> m_Scratch;
+	std::unordered_map<const void*, uint32_t> m_ProgramSlots;
+	std::unordered_map<const void*, uint32_t> m_MaterialSlots;
+	std::unordered_map<const void*, uint32_t> m_MeshSlots;
+	Stats m_Stats;
+};
@@ -13,6 +13,7 @@
 #include <tools/gltools.hpp>
 #include <tools/Timer.hpp>
 #include <GLType/ProgramShader.h>
+#include <GLType/RenderStateCache.h>
 #include <GLType/BaseTexture.h>
 #include "Mesh.h"
 #include "SkyBox.h"
@@ -27,8 +28,8 @@ void SkyBox::shutdown()
 {
   if (0 != m_Program) delete m_Program;
   m_Program = 0;
-  if (0 != m_CubeMesh) delete m_CubeMesh;
-  m_CubeMesh = 0;
+  if (0 != m_TriangleMesh) delete m_TriangleMesh;
+  m_TriangleMesh = 0;
   m_cubemaps.clear();
 }
 
@@ -39,13 +40,13 @@ void SkyBox::initialize()
   // Create & load the CubeMap program
   m_Program = new ProgramShader();  
   m_Program->initalize();
-    m_Program->addShader( GL_VERTEX_SHADER, "SkyBox.Vertex" );
+    m_Program->addShader( GL_VERTEX_SHADER, "SkyTriangle.Vertex" );
     m_Program->addShader( GL_FRAGMENT_SHADER, "SkyBox.Fragment" );
   m_Program->link();
   
-  // Create the cube mesh
-  m_CubeMesh = new CubeMesh();
-  m_CubeMesh->init();
+  // Create the far plane triangle
+  m_TriangleMesh = new FullscreenTriangleMesh();
+  m_TriangleMesh->init();
   
   // [optionnal] clear the vector  
   m_cubemaps.clear();
@@ -64,11 +65,11 @@ void SkyBox::render(const TCamera& camera)
   }
   
   
-  glDisable( GL_DEPTH_TEST );
-  glDepthMask( GL_FALSE );  
-  glDisable( GL_CULL_FACE );  
-  
-  glEnable( GL_TEXTURE_CUBE_MAP_SEAMLESS );  
+  // at depth 1.0, behind what is already drawn
+  RenderStateCache::getInstance().enable( GL_DEPTH_TEST );
+  RenderStateCache::getInstance().depthFunc( GL_LEQUAL );
+  RenderStateCache::getInstance().depthMask( false );  
+  RenderStateCache::getInstance().disable( GL_CULL_FACE );  
   
   m_Program->bind();
   {    
@@ -84,25 +85,19 @@ void SkyBox::render(const TCamera& camera)
     //-------------------------------------------------
     
     // Vertex uniform
-    glm::mat4 followCamera = glm::translate( glm::mat4(1.0f), camera.getPosition());
-    glm::mat4 model = m_CubeMesh->getModelMatrix() * followCamera * m_rotateMatrix;
-    glm::mat4 mvp = camera.getViewProjMatrix() * model;    
-    m_Program->setUniform( "uModelViewProjMatrix", mvp);
+    m_Program->setUniform( "uInvViewProjMatrix", camera.getSkyMatrix( m_rotateMatrix ));
     
     // Fragment uniform
     m_Program->setUniform( "uCubemap", 0);
     
     m_cubemaps[m_curIdx]->bind( 0u );
-      m_CubeMesh->draw();    
+      m_TriangleMesh->draw();    
     m_cubemaps[m_curIdx]->unbind( 0u );
   }
   m_Program->unbind();
-  
-  glDisable( GL_TEXTURE_CUBE_MAP_SEAMLESS );
      
   //glEnable( GL_CULL_FACE );
-  glDepthMask( GL_TRUE );
-  glEnable( GL_DEPTH_TEST ); 
+  RenderStateCache::getInstance().depthMask( true );
   
   CHECKGLERROR();
 }
@@ -16,7 +16,7 @@
 
 class TCamera;
 class ProgramShader;
-class CubeMesh;
+class FullscreenTriangleMesh;
 
 class SkyBox
 {
@@ -24,7 +24,7 @@ class SkyBox
     bool m_bInitialized;
     
     ProgramShader *m_Program;
-    CubeMesh *m_CubeMesh;
+    FullscreenTriangleMesh *m_TriangleMesh;
     
     std::vector<std::shared_ptr<class BaseTexture>> m_cubemaps;
     size_t m_curIdx;
@@ -41,7 +41,7 @@ class SkyBox
     SkyBox()
       : m_bInitialized(false),
         m_Program(0),
-        m_CubeMesh(0),
+        m_TriangleMesh(0),
         m_curIdx(0u),
         m_rotateMatrix(1.f),
         m_invRotateMatrix(1.f),
@@ -53,6 +53,7 @@ class SkyBox
     
     void initialize();
 	void shutdown();
+    /** After the opaque meshes, only the uncovered pixels are shaded */
     void render(const TCamera& camera);
     
     void addCubemap( const std::string &name );
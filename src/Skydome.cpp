@@ -15,6 +15,7 @@
 #include <tools/gltools.hpp>
 #include <tools/Timer.hpp>
 #include <GLType/ProgramShader.h>
+#include <GLType/RenderStateCache.h>
 #include <GLType/BaseTexture.h>
 #include "Mesh.h"
 #include "Skydome.h"
@@ -27,9 +28,9 @@ Skydome::~Skydome()
 void Skydome::shutdown()
 {
 	if (0 != m_Program) delete m_Program;
-	if (0 != m_SphereMesh) delete m_SphereMesh;
+	if (0 != m_TriangleMesh) delete m_TriangleMesh;
 	m_Program = 0;
-	m_SphereMesh = 0;
+	m_TriangleMesh = 0;
 	m_texture = nullptr;
 }
 
@@ -40,13 +41,13 @@ void Skydome::initialize()
 	// Create & load the CubeMap program
 	m_Program = new ProgramShader();  
 	m_Program->initalize();
-	m_Program->addShader( GL_VERTEX_SHADER, "Skydome.Vertex" );
+	m_Program->addShader( GL_VERTEX_SHADER, "SkyTriangle.Vertex" );
 	m_Program->addShader( GL_FRAGMENT_SHADER, "Skydome.Fragment" );
 	m_Program->link();
 
-	// Create the cube mesh
-	m_SphereMesh = new SphereMesh(32, 10);
-	m_SphereMesh->init();
+	// Create the far plane triangle
+	m_TriangleMesh = new FullscreenTriangleMesh();
+	m_TriangleMesh->init();
 
 	m_bInitialized = true;
 }
@@ -61,9 +62,11 @@ void Skydome::render(const TCamera& camera)
 		exit(0);
 	}
 
-	glDisable( GL_DEPTH_TEST );
-	glDepthMask( GL_FALSE );  
-	glDisable( GL_CULL_FACE );  
+	// at depth 1.0, behind what is already drawn
+	RenderStateCache::getInstance().enable( GL_DEPTH_TEST );
+	RenderStateCache::getInstance().depthFunc( GL_LEQUAL );
+	RenderStateCache::getInstance().depthMask( false );  
+	RenderStateCache::getInstance().disable( GL_CULL_FACE );  
 
 	m_Program->bind();
 	{    
@@ -78,25 +81,21 @@ void Skydome::render(const TCamera& camera)
 		}
 		//-------------------------------------------------
 
-		// Vertex uniform
+		// Vertex uniform, the dome is flipped upside down
 		glm::mat4 scale = glm::scale(glm::vec3(1.f, -1.f, 1.f));
-		glm::mat4 followCamera = glm::translate( glm::mat4(1.0f), camera.getPosition());
-		glm::mat4 model = m_SphereMesh->getModelMatrix() * followCamera * m_rotateMatrix;
-		glm::mat4 mvp = camera.getViewProjMatrix() * model * scale;    
-		m_Program->setUniform( "uModelViewProjMatrix", mvp);
+		m_Program->setUniform( "uInvViewProjMatrix", camera.getSkyMatrix( m_rotateMatrix * scale ));
 
 		// Fragment uniform
-		m_Program->setUniform( "uCubemap", 0);
+		m_Program->setUniform( "tex", 0);
 
 		m_texture->bind( 0u );
-		m_SphereMesh->draw();    
+		m_TriangleMesh->draw();    
 		m_texture->unbind( 0u );
 	}
 	m_Program->unbind();
 
 	//glEnable( GL_CULL_FACE );
-	glDepthMask( GL_TRUE );
-	glEnable( GL_DEPTH_TEST ); 
+	RenderStateCache::getInstance().depthMask( true );
 
 	CHECKGLERROR();
 }
@@ -13,7 +13,7 @@
 
 class TCamera;
 class ProgramShader;
-class SphereMesh;
+class FullscreenTriangleMesh;
 class Texture2D;
 class BaseTexture;
 
@@ -23,7 +23,7 @@ class Skydome
     bool m_bInitialized;
     
     ProgramShader *m_Program;
-    SphereMesh *m_SphereMesh;
+    FullscreenTriangleMesh *m_TriangleMesh;
 	  std::shared_ptr<BaseTexture> m_texture;
     
     //-------------------------------------------------
@@ -38,7 +38,7 @@ class Skydome
     Skydome()
       : m_bInitialized(false),
         m_Program(0),
-        m_SphereMesh(0),
+        m_TriangleMesh(0),
         m_bAutoRotation(false),
         m_spin(0.0f)
     {}
@@ -47,6 +47,7 @@ class Skydome
     
     void initialize();
 	void shutdown();
+    /** After the opaque meshes, only the uncovered pixels are shaded */
     void render(const TCamera& camera);
     
     void setTexture( const std::string &name );
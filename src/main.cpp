@@ -12,9 +12,6 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp> 
 
-// GLSL Wrangler
-#include <glsw/glsw.h>
-
 // Standard libraries
 #include <iostream>
 #include <cstdlib>
@@ -31,12 +28,22 @@
 #include <tools/Logger.hpp>
 #include <tools/gltools.hpp>
 #include <tools/SimpleProfile.h>
+#include <tools/FileWatcher.hpp>
 
 #include <GLType/ProgramShader.h>
 #include <GLType/BaseTexture.h>
+#include <GLType/GeometryArena.h>
+#include <GLType/HeadlessContext.h>
+#include <GLType/RenderStateCache.h>
+#include <GLType/SamplerCache.h>
+#include <BaseMaterial.h>
+#include <ClusteredLights.h>
+#include <RenderQueue.h>
 #include <SkyBox.h>
 #include <Mesh.h>
 #include <ModelAssImp.h>
+#include <MeshLod.h>
+#include <FrustumCuller.h>
 
 #include <fstream>
 #include <memory>
@@ -45,7 +52,7 @@
 #include <LightProbe.h>
 
 namespace {
-    // lights
+    // lights, the first ones of the clustered list
     // ------
     glm::vec3 lightPositions[] = {
         glm::vec3(-10.0f,  10.0f, 15.0f),
@@ -90,6 +97,12 @@ struct Settings
 		m_showSpecColorWheel = true;
 		m_metalOrSpec = 0;
 		m_meshSelection = 1;
+		m_doClusterCulling = true;
+		m_doFrustumCulling = true;
+		m_orbGridSize = 5;
+		m_doGpuCulling = false;
+		m_doDepthPrepass = false;
+		m_lightCount = 4;
 	}
 
 	float m_envRotCurr;
@@ -113,6 +126,30 @@ struct Settings
 	bool  m_showSpecColorWheel;
 	int32_t m_metalOrSpec;
 	int32_t m_meshSelection;
+	bool  m_doClusterCulling;
+	bool  m_doFrustumCulling;
+	int32_t m_orbGridSize;
+	bool  m_doGpuCulling;
+	bool  m_doDepthPrepass;
+	int32_t m_lightCount;
+};
+
+// lightProbe.app --bake <hdr> [--output <dir>] [--size <n>] [--irradiance-size <n>] [--quality low|medium|high]
+struct BakeOptions
+{
+	BakeOptions()
+	{
+		m_output = ".";
+		m_envMapSize = 512;
+		m_irradianceSize = 16;
+		m_quality = 1;
+	}
+
+	std::string m_input;
+	std::string m_output;
+	uint32_t m_envMapSize;
+	uint32_t m_irradianceSize;
+	uint32_t m_quality;     // 0 low, 1 medium (interactive), 2 high
 };
 
 
@@ -121,6 +158,9 @@ namespace
 	struct fRGB {
 		float r, g, b; 
 	};
+    // drawn in this order by the render queue
+    enum RenderPass { PASS_DEPTH = 0, PASS_OPAQUE, PASS_SKY };
+
     const unsigned int WINDOW_WIDTH = 1280;
     const unsigned int WINDOW_HEIGHT = 720;
 	const char* WINDOW_NAME = "Light probe";
@@ -131,15 +171,27 @@ namespace
     ProgramShader m_programMesh;
     ProgramShader m_programMeshTex;
     ProgramShader m_programSky;
+    ProgramShader m_programMeshletCull;
+    ProgramShader m_programDrawCull;
+    ProgramShader m_programDepth;
+    ProgramShader m_programLightCluster;
     BaseTexture m_pistolTex[4];
 	BaseTexture m_pbrTex[5][4];
+    GeometryArena m_arena;
+    ClusteredLights m_clusteredLights;
+    RenderQueue m_renderQueue;
+    BaseMaterial m_skyMaterial;
+    BaseMaterial m_pistolMaterial;
+    BaseMaterial m_pbrMaterials[5];
     SphereMesh m_sphere( 48, 5.0f );
-    CubeMesh m_cube;
+    FullscreenTriangleMesh m_skyTriangle;
 	Settings m_settings;
 	ModelPtr m_pistol;
 	ModelPtr m_orb;
 
     std::shared_ptr<LightProbe> m_lightProbe;
+    FileWatcher m_shaderWatcher;
+    HeadlessContext m_headlessContext;
 
     //?
 
@@ -148,22 +200,41 @@ namespace
     GLuint m_EmptyVAO = 0;
     bool bWireframe = false;
 
+    // objects drawn after frustum culling, of the ones submitted, last frame
+    uint32_t m_drawnObjects = 0;
+    uint32_t m_totalObjects = 0;
+
+    // size of the orb grid held by the arena objects, 0 before the first GPU cull
+    int32_t m_objectGridSize = 0;
+
+    // size of the light list uploaded to m_clusteredLights, 0 before the first frame
+    int32_t m_uploadedLightCount = 0;
+
     //?
 
 	void initialize(int argc, char** argv);
 	void initExtension();
 	void initGL();
 	void initWindow(int argc, char** argv);
+	bool initHeadless();
+	void setContextHints();
     void finalizeApp();
 	void mainLoopApp();
+	bool parseBakeOptions(int argc, char** argv, BakeOptions& options);
+	int bakeApp(const BakeOptions& options);
     void moveCamera( int key, bool isPressed );
 	void prepareRender();
     void render();
 	void renderHUD();
-    void renderTestCubeSample();
-    void renderTexturedCube();
+    void submitSky();
+    void submitTestCubeSample();
+    void submitTexturedCube();
+    LodSelector makeLodSelector();
+    void makeOrbGrid(int gridSize, std::vector<glm::mat4>& models, std::vector<glm::vec4>& materials);
+    void makeLights(int count, std::vector<PointLight>& lights);
 	void update();
 	void updateHUD();
+	void updateShaders(const std::vector<std::string>& filenames);
 
 	void glfw_error_callback(int error, const char* description);
     void glfw_keyboard_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
@@ -297,10 +368,13 @@ namespace {
 		// io.Fonts->AddFontFromFileTTF("../../extra_fonts/ProggyClean.ttf", 13.0f);
 		// io.Fonts->AddFontFromFileTTF("../../extra_fonts/ProggyTiny.ttf", 10.0f);
 
-		// GLSW : shader file manager
-		glswInit();
-		glswSetPath("./shaders/", ".glsl");
-		glswAddDirectiveToken("*", "#version 440 core");
+		// Shader library : every effect file, indexed by tag
+		ShaderLibrary& library = ProgramShader::getShaderLibrary();
+		library.addDirectiveToken("*", "#version 440 core");
+		library.load("./shaders", ".glsl");
+
+		// Hot reload of the modified shaders
+		m_shaderWatcher.watch("./shaders");
 
         Timer::getInstance().start();
 
@@ -313,13 +387,20 @@ namespace {
 
         GLuint m_VertexArrayID;
         GL_ASSERT(glGenVertexArrays(1, &m_VertexArrayID));
-        GL_ASSERT(glBindVertexArray(m_VertexArrayID));
+        RenderStateCache::getInstance().bindVertexArray(m_VertexArrayID);
+
+        // Shared buffers for the compact meshes, drawn with multi-draw indirect
+        m_arena.create(makeVertexLayout(VertexFormat::Compact(), true, true, true, glm::vec3(0.f), glm::vec3(1.f)), 1u << 20, 4u << 20);
 
+        m_sphere.setVertexFormat(VertexFormat::Compact());
+        m_sphere.setLodCount(4);
+        m_sphere.setArena(&m_arena);
         m_sphere.init();
-		m_cube.init();
+		m_skyTriangle.init();
 
 		m_pistol = std::make_shared<ModelAssImp>();
 		m_pistol->create();
+		m_pistol->setArena(&m_arena);
     #if !_DEBUG
 		m_pistol->loadFromFile( "resource/pistol/pistol.obj" );
     #endif
@@ -353,8 +434,27 @@ namespace {
 		{
             m_pistolTex[i].create("resource/pistol/" + textureTypename[i]);
 		}
+
+        for (int k = 0; k < 5; k++)
+            for(int i = 0; i < 4; i++) 
+                m_pbrMaterials[k].setTexture(i, &m_pbrTex[k][i]);
+        for (int i = 0; i < 4; i++)
+            m_pistolMaterial.setTexture(i, &m_pistolTex[i]);
     #endif
 
+        // depth only, the nearest occluders first
+        RenderQueue::PassState depthState;
+        depthState.colorWrite = false;
+        depthState.frontToBack = true;
+        m_renderQueue.setPassState(PASS_DEPTH, depthState);
+
+        // the sky is drawn last at the far plane, only where no mesh was
+        RenderQueue::PassState skyState;
+        skyState.depthWrite = false;
+        skyState.depthFunc = GL_LEQUAL;
+        skyState.cullFace = false;
+        m_renderQueue.setPassState(PASS_SKY, skyState);
+
         m_programMeshTex.initalize();
         m_programMeshTex.addShader(GL_VERTEX_SHADER, "IblMeshTex.Vertex");
         m_programMeshTex.addShader(GL_FRAGMENT_SHADER, "IblMeshTex.Fragment");
@@ -366,10 +466,29 @@ namespace {
         m_programMesh.link();  
 
         m_programSky.initalize();
-        m_programSky.addShader(GL_VERTEX_SHADER, "IblSkyBox.Vertex");
+        m_programSky.addShader(GL_VERTEX_SHADER, "SkyTriangle.Vertex");
         m_programSky.addShader(GL_FRAGMENT_SHADER, "IblSkyBox.Fragment");
         m_programSky.link();  
 
+        m_programMeshletCull.initalize();
+        m_programMeshletCull.addShader(GL_COMPUTE_SHADER, "MeshletCull.Compute");
+        m_programMeshletCull.link();  
+
+        m_programDrawCull.initalize();
+        m_programDrawCull.addShader(GL_COMPUTE_SHADER, "DrawCull.Compute");
+        m_programDrawCull.link();  
+
+        m_programDepth.initalize();
+        m_programDepth.addShader(GL_VERTEX_SHADER, "DepthOnly.Vertex");
+        m_programDepth.addShader(GL_FRAGMENT_SHADER, "DepthOnly.Fragment");
+        m_programDepth.link();  
+
+        m_programLightCluster.initalize();
+        m_programLightCluster.addShader(GL_COMPUTE_SHADER, "LightCluster.Compute");
+        m_programLightCluster.link();  
+
+        m_clusteredLights.initialize();
+
 		// to prevent osx input bug
 		fflush(stdout);
 
@@ -428,16 +547,19 @@ namespace {
 
         glClearColor( 0.15f, 0.15f, 0.15f, 0.0f);
 
-        glEnable( GL_DEPTH_TEST );
-        glDepthFunc( GL_LEQUAL );
+        RenderStateCache::getInstance().enable( GL_DEPTH_TEST );
+        RenderStateCache::getInstance().depthFunc( GL_LEQUAL );
 
-        glDisable( GL_STENCIL_TEST );
+        RenderStateCache::getInstance().disable( GL_STENCIL_TEST );
         glClearStencil( 0 );
 
-        glCullFace( GL_BACK );    
+        RenderStateCache::getInstance().cullFace( GL_BACK );    
         glFrontFace(GL_CCW);
 
-        glDisable( GL_MULTISAMPLE );
+        RenderStateCache::getInstance().disable( GL_MULTISAMPLE );
+
+        // every cubemap is sampled seamless, nothing turns it off
+        RenderStateCache::getInstance().enable( GL_TEXTURE_CUBE_MAP_SEAMLESS );
 
         glGenVertexArrays(1, &m_EmptyVAO);
 	}
@@ -454,13 +576,7 @@ namespace {
 		}
         
         glfwWindowHint(GLFW_SAMPLES, 4);
-    #ifdef _DEBUG
-        glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
-    #endif
-        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // To make MacOS happy; should not be needed
-        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        setContextHints();
 		
 		window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_NAME, NULL, NULL );
 		if ( window == NULL ) {
@@ -480,23 +596,141 @@ namespace {
 		glfwSetScrollCallback( window, glfw_scroll_callback );
 	}
 
+	void setContextHints()
+	{
+    #ifdef _DEBUG
+        glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+    #endif
+    #ifdef LIGHTPROBE_EGL
+        // GLEW loads the entry points with eglGetProcAddress
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+    #endif
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // To make MacOS happy; should not be needed
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	}
+
+	bool initHeadless()
+	{
+		// no window, the bakes only use framebuffer objects
+    #ifdef _DEBUG
+		return m_headlessContext.create(4, 3, true);
+    #else
+		return m_headlessContext.create(4, 3);
+    #endif
+	}
+
+	bool parseBakeOptions(int argc, char** argv, BakeOptions& options)
+	{
+		bool bBake = false;
+		for (int i = 1; i < argc; i++)
+		{
+			const bool bHasValue = (i + 1 < argc);
+			if (!strcmp(argv[i], "--bake") && bHasValue)
+			{
+				options.m_input = argv[++i];
+				bBake = true;
+			}
+			else if (!strcmp(argv[i], "--output") && bHasValue)
+				options.m_output = argv[++i];
+			else if (!strcmp(argv[i], "--size") && bHasValue)
+				options.m_envMapSize = uint32_t(atoi(argv[++i]));
+			else if (!strcmp(argv[i], "--irradiance-size") && bHasValue)
+				options.m_irradianceSize = uint32_t(atoi(argv[++i]));
+			else if (!strcmp(argv[i], "--quality") && bHasValue)
+			{
+				const char* quality = argv[++i];
+				options.m_quality = !strcmp(quality, "low") ? 0 : !strcmp(quality, "high") ? 2 : 1;
+			}
+			else
+				fprintf( stderr, "Ignored argument %s\n", argv[i] );
+		}
+		return bBake;
+	}
+
+	int bakeApp(const BakeOptions& options)
+	{
+		auto isPowerOfTwo = [](uint32_t x) { return x != 0 && (x & (x - 1)) == 0; };
+		if (options.m_envMapSize < 2 || !isPowerOfTwo(options.m_envMapSize) || !isPowerOfTwo(options.m_irradianceSize))
+		{
+			fprintf( stderr, "Bake sizes must be powers of two\n" );
+			return EXIT_FAILURE;
+		}
+
+		if (!initHeadless())
+			return EXIT_FAILURE;
+		initExtension();
+		initGL();
+
+		ShaderLibrary& library = ProgramShader::getShaderLibrary();
+		library.addDirectiveToken("*", "#version 440 core");
+		light_probe::addQualityDirectives(library, options.m_quality);
+		if (!library.load("./shaders", ".glsl"))
+		{
+			library.clear();
+			m_headlessContext.destroy();
+			return EXIT_FAILURE;
+		}
+
+		int result = EXIT_FAILURE;
+		if (light_probe::initialize(options.m_input))
+		{
+			LightProbe probe;
+			if (probe.initialize(options.m_envMapSize, options.m_irradianceSize))
+			{
+				{
+					PROFILEGL("Light Probe");
+					probe.update();
+				}
+
+				// <output>/<input name>_environment.dds, ...
+				std::string name = options.m_input.substr(options.m_input.find_last_of("/\\") + 1);
+				name = name.substr(0, name.find_last_of('.'));
+				if (probe.save(options.m_output + "/" + name) &&
+					light_probe::getBrdfLut()->save(options.m_output + "/brdf_lut.dds"))
+				{
+					printf( "Baked %s to %s\n", options.m_input.c_str(), options.m_output.c_str() );
+					result = EXIT_SUCCESS;
+				}
+			}
+		}
+
+		light_probe::shutdown();
+		library.clear();
+		m_headlessContext.destroy();
+		return result;
+	}
+
 	void finalizeApp()
 	{
+		m_shaderWatcher.stop();
 		m_pistol->destroy();
 		m_orb->destroy();
-        glswShutdown();  
+        ProgramShader::getShaderLibrary().clear();
         light_probe::shutdown();
         m_programMesh.destroy();
         m_programMeshTex.destroy();
         m_programSky.destroy();
+        m_programMeshletCull.destroy();
+        m_programDrawCull.destroy();
+        m_programDepth.destroy();
+        m_programLightCluster.destroy();
+        m_clusteredLights.destroy();
         m_sphere.destroy();
-		m_cube.destroy();
+		m_skyTriangle.destroy();
+		m_arena.destroy();
+        SamplerCache::getInstance().destroy();
 
         for (int k = 0; k < 5; k++)
             for(int i = 0; i < 4; i++) 
                 m_pbrTex[k][i].destroy();
         for(int i = 0; i < 4; i++)
             m_pistolTex[i].destroy();
+        for (int k = 0; k < 5; k++)
+            m_pbrMaterials[k].destroy();
+        m_pistolMaterial.destroy();
+        m_skyMaterial.destroy();
 
         Logger::getInstance().close();
 		ImGui_ImplGlfwGL3_Shutdown();
@@ -508,6 +742,7 @@ namespace {
 		do {
 			update();
 			render();
+			RenderStateCache::getInstance().endFrame();
 
 			/* Swap front and back buffers */
 			glfwSwapBuffers(window);
@@ -541,9 +776,25 @@ namespace {
 	{
         Timer::getInstance().update();
         camera.update();
+		updateShaders(m_shaderWatcher.poll());
 		updateHUD();
 	}
 
+	void updateShaders(const std::vector<std::string>& filenames)
+	{
+		if (filenames.empty()) return;
+
+		// rebuild only the programs using these files, then the bake stages fed by them
+		auto programs = ProgramShader::reloadModified(filenames);
+		uint32_t stages = light_probe::reloadPrograms(programs);
+		if (stages != 0)
+		{
+			PROFILEGL("Light Probe");
+			m_lightProbe->update(stages);
+		}
+		fflush(stderr);
+	}
+
 	void updateHUD()
 	{
 		ImGui_ImplGlfwGL3_NewFrame();
@@ -663,6 +914,21 @@ namespace {
 		ImGui::Indent();
 		ImGui::RadioButton("Pistol", &m_settings.m_meshSelection, 0);
 		ImGui::RadioButton("Orbs",  &m_settings.m_meshSelection, 1);
+		ImGui::Checkbox("Frustum culling", &m_settings.m_doFrustumCulling);
+		ImGui::Text("Drawn: %u / %u", m_drawnObjects, m_totalObjects);
+		const RenderStateCache::Stats& stateStats = RenderStateCache::getInstance().getFrameStats();
+		ImGui::Text("GL state: %u issued, %u skipped", stateStats.issued, stateStats.skipped);
+		const RenderQueue::Stats& queueStats = m_renderQueue.getStats();
+		ImGui::Text("Queue: %u packets, %u programs, %u materials", queueStats.packets, queueStats.programChanges, queueStats.materialChanges);
+		if (0 == m_settings.m_meshSelection)
+			ImGui::Checkbox("Cluster culling", &m_settings.m_doClusterCulling);
+		else
+		{
+			ImGui::SliderInt("Orb grid", &m_settings.m_orbGridSize, 1, 320);
+			ImGui::Checkbox("GPU culling", &m_settings.m_doGpuCulling);
+		}
+		ImGui::Checkbox("Depth pre-pass", &m_settings.m_doDepthPrepass);
+		ImGui::SliderInt("Lights", &m_settings.m_lightCount, 0, 1024);
 		ImGui::Unindent();
 
 		const bool isBunny = (0 == m_settings.m_meshSelection);
@@ -709,37 +975,36 @@ namespace {
         glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );    
         glPolygonMode(GL_FRONT_AND_BACK, (bWireframe)? GL_LINE : GL_FILL);
 
-		// Submit view 0.
-		glDisable( GL_DEPTH_TEST );
-		glDepthMask( GL_FALSE );  
-		glDisable( GL_CULL_FACE );  
-		glEnable( GL_TEXTURE_CUBE_MAP_SEAMLESS );  
-		glm::mat4 followCamera = glm::translate( glm::mat4(1.0f), camera.getPosition() );
-		glm::mat4 skyboxMtx = camera.getViewProjMatrix() * followCamera;
-		m_programSky.bind();
-
-		// Texture binding
-		m_programSky.bindTexture( "uEnvmap", m_lightProbe->getEnvCube(), 0 );
-		m_programSky.bindTexture( "uEnvmapIrr", m_lightProbe->getIrradiance(), 1 );
-		m_programSky.bindTexture( "uEnvmapPrefilter", m_lightProbe->getPrefilter(), 2 );
+		if (m_uploadedLightCount != m_settings.m_lightCount)
+		{
+			std::vector<PointLight> lights;
+			makeLights( m_settings.m_lightCount, lights );
+			m_clusteredLights.setLights( lights );
+			m_uploadedLightCount = m_settings.m_lightCount;
+		}
+		m_clusteredLights.update( m_programLightCluster, camera.getViewMatrix(), camera.getProjectionMatrix(),
+			camera.getNear(), camera.getFar(), uint32_t(display_w), uint32_t(display_h) );
 
-		// Uniform binding
-        m_programSky.setUniform( "uViewMatrix", camera.getViewMatrix() );
-        m_programSky.setUniform( "uProjMatrix", camera.getProjectionMatrix() );
-		m_programSky.setUniform( "uBgType", m_settings.m_bgType );
-		m_programSky.setUniform( "uExposure", m_settings.m_exposure );
-		m_cube.draw();
-		m_programSky.unbind();
-		glDisable( GL_TEXTURE_CUBE_MAP_SEAMLESS );
-		glEnable( GL_CULL_FACE );
-		glDepthMask( GL_TRUE );
-		glEnable( GL_DEPTH_TEST ); 
+		m_renderQueue.clear( camera.getPosition(), camera.getFar() );
+		if (m_settings.m_doDepthPrepass)
+		{
+			m_programDepth.bind();
+			m_programDepth.setUniform( "uModelViewProjMatrix", camera.getViewProjMatrix() );
+		}
+		m_renderQueue.setDepthPrepass( PASS_OPAQUE, PASS_DEPTH, m_settings.m_doDepthPrepass ? &m_programDepth : nullptr );
 
+		// without the pre-pass, the nearest meshes first help early-Z
+		RenderQueue::PassState opaqueState;
+		opaqueState.frontToBack = !m_settings.m_doDepthPrepass;
+		m_renderQueue.setPassState( PASS_OPAQUE, opaqueState );
+		submitSky();
     #if !_DEBUG
-        renderTexturedCube();
+        submitTexturedCube();
     #else
-        renderTestCubeSample();
+        submitTestCubeSample();
     #endif
+		m_renderQueue.execute();
+
 		renderHUD();
     }
 
@@ -747,12 +1012,44 @@ namespace {
 	{
 		// restore some state
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        // ImGui samples its font with the texture parameters
+        RenderStateCache::getInstance().bindSampler(0, 0);
         ImGui::Render();
+
+        // ImGui sets and restores the state behind the cache
+        RenderStateCache::getInstance().invalidate();
 	}
 
-    void renderTexturedCube()
+    void submitSky()
+    {
+		m_programSky.bind();
+
+		// Uniform binding
+        m_programSky.setUniform( "uInvViewProjMatrix", camera.getSkyMatrix() );
+		m_programSky.setUniform( "uBgType", m_settings.m_bgType );
+		m_programSky.setUniform( "uExposure", m_settings.m_exposure );
+		m_programSky.setUniform( "uEnvmap", 0 );
+		m_programSky.setUniform( "uEnvmapIrr", 1 );
+		m_programSky.setUniform( "uEnvmapPrefilter", 2 );
+
+		// the probe textures are recreated by the bakes
+		m_skyMaterial.setTexture( 0, m_lightProbe->getEnvCube().get() );
+		m_skyMaterial.setTexture( 1, m_lightProbe->getIrradiance().get() );
+		m_skyMaterial.setTexture( 2, m_lightProbe->getPrefilter().get() );
+
+		m_renderQueue.submit( PASS_SKY, m_programSky, &m_skyMaterial, [](ProgramShader&) { m_skyTriangle.draw(); } );
+    }
+
+    void submitTexturedCube()
     {
-		glEnable( GL_TEXTURE_CUBE_MAP_SEAMLESS );
+        // Meshlet culling runs before the draw program is bound
+        const glm::mat4 mtxPistol = glm::scale(glm::mat4(1), glm::vec3(1.f/10));
+        const FrustumCuller frustumCuller( camera.getViewProjMatrix() );
+        const FrustumCuller* culler = m_settings.m_doFrustumCulling ? &frustumCuller : nullptr;
+        const bool pistolVisible = !culler || culler->isVisible( transformSphere(m_pistol->getBoundingSphere(), mtxPistol) );
+        const bool doClusterCulling = (0 == m_settings.m_meshSelection) && m_settings.m_doClusterCulling && pistolVisible;
+        if (doClusterCulling)
+            m_pistol->cullMeshlets(m_programMeshletCull, camera.getViewProjMatrix(), camera.getPosition(), mtxPistol);
 
         m_programMeshTex.bind();
 
@@ -765,11 +1062,7 @@ namespace {
 		m_programMeshTex.setUniform( "ubDiffuseIbl", float(m_settings.m_doDiffuseIbl) );
 		m_programMeshTex.setUniform( "ubSpecularIbl", float(m_settings.m_doSpecularIbl) );
 		m_programMeshTex.setUniform( "uMtxSrt", glm::mat4(1) );
-		for (unsigned int i = 0; i < 4; i++) {
-			std::string idx = "[" + std::to_string(i) + "]";
-			m_programMeshTex.setUniform("uLightPositions" + idx, lightPositions[i]);
-			m_programMeshTex.setUniform("uLightColors" + idx, lightColors[i]);
-		}
+		m_clusteredLights.bind( m_programMeshTex );
 
 		// Texture binding
 		m_programMeshTex.bindTexture( "uEnvmapIrr", m_lightProbe->getIrradiance(), 4 );
@@ -783,37 +1076,101 @@ namespace {
 
 		if (0 == m_settings.m_meshSelection)
 		{
-            glm::mat4 mtxS = glm::scale(glm::mat4(1), glm::vec3(1.f/10));
-            m_programMeshTex.setUniform("uMtxSrt", mtxS);
-            for(int i = 0; i < 4; i++)
-                m_pistolTex[i].bind(i);
-			m_pistol->render();
+            m_totalObjects = m_pistol->getSubmeshCount();
+            m_renderQueue.submit( PASS_OPAQUE, m_programMeshTex, &m_pistolMaterial, [mtxPistol, frustumCuller, doClusterCulling](ProgramShader& program) {
+                const FrustumCuller* culler = m_settings.m_doFrustumCulling ? &frustumCuller : nullptr;
+                program.setUniform("uMtxSrt", mtxPistol);
+                program.setVertexLayout(m_pistol->getVertexLayout());
+                if (doClusterCulling)
+                {
+                    m_pistol->renderCulled();
+                    m_drawnObjects = m_totalObjects;
+                }
+                else if (m_pistol->isInArena())
+                {
+                    program.setUniform("ubDrawData", GLint(1));
+                    m_drawnObjects = m_pistol->submit(makeLodSelector(), mtxPistol, culler);
+                    m_arena.flush();
+                    program.setUniform("ubDrawData", GLint(0));
+                }
+                else
+                    m_drawnObjects = m_pistol->render(makeLodSelector(), mtxPistol, culler);
+            }, glm::vec3(mtxPistol[3]) );
 		}
 		else
 		{
-			// Submit orbs.
+			// Submit orbs, one material each
+            const LodSelector selector = makeLodSelector();
+            m_totalObjects = 0;
+            m_drawnObjects = 0;
             for(float xx = 0, xend = 5.0f; xx < xend; xx += 1.0f)
             {
-                for(int i = 0; i < 4; i++) 
-                    m_pbrTex[uint32_t(xx)][i].bind(i);
-
                 const float scale = 1.2f;
                 const float spacing = 2.2f * 30;
                 const float yAdj = -0.8f;
                 glm::vec3 translate(0.0f + (xx / xend)*spacing - (1.0f + (scale - 1.0f)*0.5f - 1.0f / xend), 0.0f, 0.0f);
                 glm::mat4 mtxS = glm::scale(glm::mat4(1), glm::vec3(scale / xend));
                 glm::mat4 mtxST = glm::translate(mtxS, translate);
-                m_programMeshTex.setUniform("uMtxSrt", mtxST);
-                m_sphere.draw();
+
+                m_totalObjects++;
+                if (culler && !culler->isVisible( transformSphere(m_sphere.getBoundingSphere(), mtxST) ))
+                    continue;
+                m_drawnObjects++;
+
+                m_renderQueue.submit( PASS_OPAQUE, m_programMeshTex, &m_pbrMaterials[uint32_t(xx)],
+                    m_sphere, m_sphere.selectLod(selector, mtxST), mtxST );
             }
 		}
-        m_programMeshTex.unbind();
-		glDisable( GL_TEXTURE_CUBE_MAP_SEAMLESS );
     }
 
-    void renderTestCubeSample()
+    void submitTestCubeSample()
     {	
-		glEnable( GL_TEXTURE_CUBE_MAP_SEAMLESS );  
+        // Orbs, the spacing of the 5x5 grid is kept for larger ones
+        const LodSelector selector = makeLodSelector();
+        const int gridSize = m_settings.m_orbGridSize;
+        const bool doGpuCulling = m_settings.m_doGpuCulling && m_sphere.isInArena();
+        std::vector<glm::mat4> models;
+        std::vector<glm::vec4> materials;
+
+        if (doGpuCulling)
+        {
+            // the grid stays in the arena, the culling runs before the draw program is bound
+            if (m_objectGridSize != gridSize)
+            {
+                makeOrbGrid( gridSize, models, materials );
+                m_arena.clearObjects();
+                for (size_t i = 0; i < models.size(); ++i)
+                    m_sphere.addObject( models[i], materials[i] );
+                m_objectGridSize = gridSize;
+            }
+            m_arena.cullObjects( m_programDrawCull, camera.getViewProjMatrix(), selector, m_settings.m_doFrustumCulling );
+            m_totalObjects = m_arena.getObjectCount();
+            m_drawnObjects = m_arena.getVisibleObjectCount();
+        }
+        else
+        {
+            makeOrbGrid( gridSize, models, materials );
+
+            // keep the visible orbs only, in submission order
+            m_totalObjects = uint32_t(models.size());
+            if (m_settings.m_doFrustumCulling)
+            {
+                SphereBatch spheres;
+                for (size_t i = 0; i < models.size(); ++i)
+                    spheres.add( transformSphere(m_sphere.getBoundingSphere(), models[i]) );
+
+                std::vector<uint32_t> visible;
+                FrustumCuller( camera.getViewProjMatrix() ).cull( spheres, visible );
+                for (size_t i = 0; i < visible.size(); ++i)
+                {
+                    models[i] = models[visible[i]];
+                    materials[i] = materials[visible[i]];
+                }
+                models.resize( visible.size() );
+                materials.resize( visible.size() );
+            }
+            m_drawnObjects = uint32_t(models.size());
+        }
 
         m_programMesh.bind();
 
@@ -829,17 +1186,61 @@ namespace {
 		m_programMesh.setUniform( "ubSpecularIbl", float(m_settings.m_doSpecularIbl) );
 		m_programMesh.setUniform( "uRgbDiff", m_settings.m_rgbDiff );
 		m_programMesh.setUniform( "uMtxSrt", glm::mat4(1) );
+		m_clusteredLights.bind( m_programMesh );
 
 		// Texture binding
 		m_programMesh.bindTexture( "uEnvmapIrr", m_lightProbe->getIrradiance(), 4 );
 		m_programMesh.bindTexture( "uEnvmapPrefilter", m_lightProbe->getPrefilter(), 5 );
 		m_programMesh.bindTexture( "uEnvmapBrdfLUT", light_probe::getBrdfLut(), 6 );
 
-        // Submit orbs.
-        for (float yy = 0, yend = 5.0f; yy < yend; yy+=1.0f)
+        // the arena draws are queued by the packet, another one may flush the arena first
+        m_renderQueue.submit( PASS_OPAQUE, m_programMesh, nullptr, [selector, doGpuCulling, models, materials](ProgramShader& program) {
+            program.setVertexLayout( m_sphere.getVertexLayout() );
+            if (doGpuCulling)
+            {
+                program.setUniform( "ubDrawData", GLint(1) );
+                m_arena.drawObjects();
+                program.setUniform( "ubDrawData", GLint(0) );
+            }
+            else if (m_sphere.isInArena())
+            {
+                // the whole grid in one instanced command per level
+                m_sphere.submitInstanced( selector, models.data(), materials.data(), uint32_t(models.size()) );
+                program.setUniform( "ubDrawData", GLint(1) );
+                m_arena.flush();
+                program.setUniform( "ubDrawData", GLint(0) );
+            }
+            else
+            {
+                // the depth pre-pass has no material, its locations are -1
+                const GLint glossiness = program.getUniformLocation( "uGlossiness" );
+                const GLint reflectivity = program.getUniformLocation( "uReflectivity" );
+                const GLint mtxSrt = program.getUniformLocation( "uMtxSrt" );
+                for (size_t i = 0; i < models.size(); ++i)
+                {
+                    if (-1 != glossiness)
+                    {
+                        program.setUniform( glossiness, materials[i].x );
+                        program.setUniform( reflectivity, materials[i].y );
+                    }
+                    program.setUniform( mtxSrt, models[i] );
+                    m_sphere.drawLod( m_sphere.selectLod(selector, models[i]) );
+                }
+            }
+        } );
+    }
+
+    void makeOrbGrid(int gridSize, std::vector<glm::mat4>& models, std::vector<glm::vec4>& materials)
+    {
+        models.reserve( gridSize*gridSize );
+        materials.reserve( gridSize*gridSize );
+
+        for (int y = 0; y < gridSize; ++y)
         {
-            for (float xx = 0, xend = 5.0f; xx < xend; xx+=1.0f)
+            for (int x = 0; x < gridSize; ++x)
             {
+                const float xx = float(x), yy = float(y);
+                const float xend = 5.0f, yend = 5.0f;
                 const float scale   =  1.2f;
                 const float spacing =  2.2f*30;
                 const float yAdj    = -0.8f;
@@ -848,15 +1249,36 @@ namespace {
                         yAdj/yend + (yy/yend)*spacing - (1.0f + (scale-1.0f)*0.5f - 1.0f/yend),
                         0.0f);
                 glm::mat4 mtxS = glm::scale(glm::mat4(1), glm::vec3(scale/xend));
-                glm::mat4 mtxST = glm::translate(mtxS, translate);
-                m_programMesh.setUniform( "uGlossiness", xx*(1.0f/xend) );
-                m_programMesh.setUniform( "uReflectivity", (yend-yy)*(1.0f/yend) );
-                m_programMesh.setUniform( "uMtxSrt", mtxST );
-                m_sphere.draw();
+                models.push_back( glm::translate(mtxS, translate) );
+                materials.push_back( glm::vec4( xx/gridSize, (gridSize-yy)/gridSize, 0.0f, 0.0f ) );
             }
         }
-        m_programMesh.unbind();
-		glDisable( GL_TEXTURE_CUBE_MAP_SEAMLESS );  
+    }
+
+    void makeLights(int count, std::vector<PointLight>& lights)
+    {
+        lights.reserve( count );
+        for (int i = 0; i < count && i < 4; ++i)
+            lights.push_back( PointLight(lightPositions[i], lightColors[i]) );
+
+        // the others are scattered over the orb grid, dimmer so they stay local
+        uint32_t seed = 12345u;
+        auto random = [&seed] { seed = seed * 1664525u + 1013904223u; return float(seed >> 8) / float(1u << 24); };
+        const float extent = std::max( 16.0f, std::sqrt(float(count)) * 6.0f );
+        for (int i = 4; i < count; ++i)
+        {
+            const glm::vec3 position( random() * extent, random() * extent, 2.0f + random() * 4.0f );
+            const glm::vec3 color = 10.0f * glm::vec3( 0.2f + random(), 0.2f + random(), 0.2f + random() );
+            lights.push_back( PointLight(position, color, 0.05f) );
+        }
+    }
+
+    LodSelector makeLodSelector()
+    {
+        // levels are picked against the framebuffer height
+        int display_w, display_h;
+        glfwGetFramebufferSize(window, &display_w, &display_h);
+        return LodSelector(camera, float(display_h));
     }
 
 	void prepareRender()
@@ -958,6 +1380,10 @@ namespace {
 
 int main(int argc, char** argv)
 {
+	BakeOptions bakeOptions;
+	if (parseBakeOptions(argc, argv, bakeOptions))
+		return bakeApp(bakeOptions);
+
 	initialize(argc, argv);
 	mainLoopApp();
 	finalizeApp();
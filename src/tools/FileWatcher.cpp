@@ -0,0 +1,115 @@
+/**
+ * 
+ *        \file FileWatcher.cpp
+ * 
+ */
+
+#include <cstdio>
+
+#include "FileWatcher.hpp"
+
+#ifdef __linux__
+  #include <poll.h>
+  #include <sys/inotify.h>
+  #include <unistd.h>
+#endif
+
+
+FileWatcher::FileWatcher()
+  : m_bRunning(false),
+    m_fd(-1),
+    m_wd(-1)
+{
+}
+
+FileWatcher::~FileWatcher()
+{
+  stop();
+}
+
+bool FileWatcher::watch(const std::string &directory)
+{
+  stop();
+
+#ifdef __linux__
+  m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (m_fd < 0)
+  {
+    fprintf( stderr, "FileWatcher : inotify_init failed.\n");
+    return false;
+  }
+
+  // editors either rewrite the file or move a temporary over it
+  m_wd = inotify_add_watch(m_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+  if (m_wd < 0)
+  {
+    fprintf( stderr, "FileWatcher : can't watch \"%s\".\n", directory.c_str());
+    close(m_fd);
+    m_fd = -1;
+    return false;
+  }
+
+  m_directory = directory;
+  m_bRunning = true;
+  m_thread = std::thread(&FileWatcher::run, this);
+  return true;
+#else
+  fprintf( stderr, "FileWatcher : not supported on this platform.\n");
+  return false;
+#endif
+}
+
+void FileWatcher::stop()
+{
+  m_bRunning = false;
+  if (m_thread.joinable())
+    m_thread.join();
+
+#ifdef __linux__
+  if (m_fd >= 0)
+  {
+    if (m_wd >= 0) inotify_rm_watch(m_fd, m_wd);
+    close(m_fd);
+  }
+#endif
+  m_fd = -1;
+  m_wd = -1;
+}
+
+std::vector<std::string> FileWatcher::poll()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::vector<std::string> files(m_changed.begin(), m_changed.end());
+  m_changed.clear();
+  return files;
+}
+
+void FileWatcher::run()
+{
+#ifdef __linux__
+  // aligned buffer large enough for a burst of events
+  alignas(struct inotify_event) char buffer[4096];
+
+  while (m_bRunning)
+  {
+    struct pollfd pfd = { m_fd, POLLIN, 0 };
+    
+    // wake up regularly to check for stop()
+    if (::poll(&pfd, 1, 100) <= 0)
+      continue;
+
+    ssize_t length = read(m_fd, buffer, sizeof(buffer));
+    if (length <= 0)
+      continue;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (char *ptr = buffer; ptr < buffer + length; )
+    {
+      const struct inotify_event *event = reinterpret_cast<const struct inotify_event*>(ptr);
+      if (event->len > 0)
+        m_changed.insert(m_directory + "/" + event->name);
+      ptr += sizeof(struct inotify_event) + event->len;
+    }
+  }
+#endif
+}
@@ -0,0 +1,58 @@
+/**
+ * 
+ *        \file FileWatcher.hpp
+ * 
+ *      Watch a directory from a background thread and collect the
+ *      files written in it. Uses inotify on Linux.
+ * 
+ *      \todo # ReadDirectoryChangesW / FSEvents backends
+ * 
+ */
+
+
+#pragma once
+
+#ifndef FILEWATCHER_HPP
+#define FILEWATCHER_HPP
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+class FileWatcher final
+{
+  public:
+    FileWatcher();
+    ~FileWatcher();
+
+    /** Start watching 'directory', return false when unsupported */
+    bool watch(const std::string &directory);
+    void stop();
+
+    /** Return the files modified since the last call (as "directory/name") */
+    std::vector<std::string> poll();
+
+    bool isWatching() const { return m_bRunning; }
+
+  private:
+    FileWatcher(const FileWatcher&);
+    FileWatcher& operator =(const FileWatcher&);
+
+    void run();
+
+    std::string m_directory;
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::set<std::string> m_changed;
+    std::atomic<bool> m_bRunning;
+
+    int m_fd;
+    int m_wd;
+};
+
+
+#endif //FILEWATCHER_HPP
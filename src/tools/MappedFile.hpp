@@ -0,0 +1,45 @@
+/**
+ *
+ *        \file MappedFile.hpp
+ *
+ *      Read-only memory mapping of a whole file.
+ *
+ */
+
+
+#pragma once
+
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <cstddef>
+#include <string>
+
+
+class MappedFile final
+{
+  public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string &filename);
+    void close();
+
+    bool isOpen() const { return m_data != nullptr; }
+    const unsigned char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+  private:
+    const unsigned char *m_data;
+    size_t m_size;
+
+#ifdef _WIN32
+    void *m_file;
+    void *m_mapping;
+#endif
+};
+
+#endif //MAPPEDFILE_HPP
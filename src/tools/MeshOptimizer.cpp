@@ -0,0 +1,583 @@
+/**
+ *
+ *        \file MeshOptimizer.cpp
+ *
+ */
+
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <unordered_map>
+
+#include "MeshOptimizer.hpp"
+
+
+namespace
+{
+  const int kCacheSize = 32;
+
+  /** Forsyth's weights : recent vertices first, then lonely ones */
+  float vertexScore(int cachePosition, uint32_t liveTriangles)
+  {
+    if (liveTriangles == 0u)
+      return -1.0f;
+
+    float score = 0.0f;
+    if (cachePosition >= 0)
+    {
+      // the last triangle is emitted anyway, no bonus for its vertices
+      if (cachePosition < 3)
+        score = 0.75f;
+      else
+        score = std::pow(1.0f - float(cachePosition - 3) / float(kCacheSize - 3), 1.5f);
+    }
+    return score + 2.0f / std::sqrt(float(liveTriangles));
+  }
+
+  /** Symmetric 4x4 matrix of the squared distance to a set of planes */
+  struct Quadric
+  {
+    double a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+
+    Quadric() : a00(0), a01(0), a02(0), a03(0), a11(0), a12(0), a13(0), a22(0), a23(0), a33(0) {}
+
+    Quadric(const glm::dvec3 &n, double d)
+      : a00(n.x*n.x), a01(n.x*n.y), a02(n.x*n.z), a03(n.x*d),
+        a11(n.y*n.y), a12(n.y*n.z), a13(n.y*d),
+        a22(n.z*n.z), a23(n.z*d),
+        a33(d*d)
+    {}
+
+    Quadric& operator+=(const Quadric &q)
+    {
+      a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+      a11 += q.a11; a12 += q.a12; a13 += q.a13;
+      a22 += q.a22; a23 += q.a23;
+      a33 += q.a33;
+      return *this;
+    }
+
+    double error(const glm::vec3 &p) const
+    {
+      const double x = p.x, y = p.y, z = p.z;
+      const double e = x*(a00*x + 2.0*(a01*y + a02*z + a03))
+                     + y*(a11*y + 2.0*(a12*z + a13))
+                     + z*(a22*z + 2.0*a23)
+                     + a33;
+      return std::max(e, 0.0);
+    }
+  };
+
+  struct Collapse
+  {
+    double cost;
+    uint32_t from, to;
+    uint32_t fromVersion, toVersion;
+
+    bool operator<(const Collapse &c) const { return cost > c.cost; }   // min heap
+  };
+
+  uint64_t edgeKey(uint32_t a, uint32_t b)
+  {
+    return (a < b) ? (uint64_t(a) << 32 | b) : (uint64_t(b) << 32 | a);
+  }
+}
+
+
+namespace mesh_optimizer
+{
+  float computeACMR(const std::vector<uint32_t> &indices, size_t vertexCount, unsigned int cacheSize)
+  {
+    if (indices.empty())
+      return 0.0f;
+
+    // timestamp of the vertices inside the FIFO
+    std::vector<unsigned int> timestamps(vertexCount, 0u);
+    unsigned int time = cacheSize + 1u;
+    unsigned int misses = 0u;
+
+    for (auto index : indices)
+    {
+      if (time - timestamps[index] > cacheSize)
+      {
+        timestamps[index] = time++;
+        ++misses;
+      }
+    }
+    return float(misses) / float(indices.size() / 3u);
+  }
+
+  void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount)
+  {
+    const size_t triangleCount = indices.size() / 3u;
+    if (triangleCount == 0u)
+      return;
+
+    // Triangles around each vertex, the first 'live' ones are not emitted yet
+    std::vector<uint32_t> live(vertexCount, 0u);
+    for (auto index : indices)
+      ++live[index];
+
+    std::vector<uint32_t> offsets(vertexCount + 1u, 0u);
+    for (size_t v = 0; v < vertexCount; ++v)
+      offsets[v + 1u] = offsets[v] + live[v];
+
+    std::vector<uint32_t> adjacency(indices.size());
+    {
+      std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+      for (size_t i = 0; i < indices.size(); ++i)
+        adjacency[cursor[indices[i]]++] = uint32_t(i / 3u);
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+      vertexScores[v] = vertexScore(-1, live[v]);
+
+    std::vector<float> triangleScores(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t t = 0; t < triangleCount; ++t)
+      triangleScores[t] = vertexScores[indices[3*t]] + vertexScores[indices[3*t+1]] + vertexScores[indices[3*t+2]];
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+
+    std::vector<uint32_t> cache, newCache;
+    cache.reserve(kCacheSize + 3);
+    newCache.reserve(kCacheSize + 3);
+
+    size_t cursor = 0u;
+    int64_t best = std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin();
+
+    while (result.size() < indices.size())
+    {
+      // Nothing left around the cache, restart from the next triangle in input order
+      if (best < 0)
+      {
+        while (emitted[cursor]) ++cursor;
+        best = int64_t(cursor);
+      }
+
+      const uint32_t *tri = &indices[3*best];
+      emitted[best] = true;
+      result.insert(result.end(), tri, tri + 3);
+
+      for (int k = 0; k < 3; ++k)
+      {
+        // Remove the triangle from the live ones of its vertices
+        const uint32_t v = tri[k];
+        uint32_t *begin = &adjacency[offsets[v]];
+        uint32_t *end = begin + live[v];
+        std::iter_swap(std::find(begin, end, uint32_t(best)), end - 1);
+        --live[v];
+      }
+
+      // Emitted vertices move to the front of the LRU cache
+      newCache.assign(tri, tri + 3);
+      for (auto v : cache)
+        if (v != tri[0] && v != tri[1] && v != tri[2])
+          newCache.push_back(v);
+
+      best = -1;
+      float bestScore = -1.0f;
+
+      for (size_t i = 0; i < newCache.size(); ++i)
+      {
+        const uint32_t v = newCache[i];
+        cachePosition[v] = (i < size_t(kCacheSize)) ? int(i) : -1;
+
+        const float score = vertexScore(cachePosition[v], live[v]);
+        const float delta = score - vertexScores[v];
+        vertexScores[v] = score;
+
+        for (uint32_t a = offsets[v]; a < offsets[v] + live[v]; ++a)
+        {
+          const uint32_t t = adjacency[a];
+          triangleScores[t] += delta;
+
+          if (cachePosition[v] >= 0 && triangleScores[t] > bestScore)
+          {
+            bestScore = triangleScores[t];
+            best = t;
+          }
+        }
+      }
+
+      if (newCache.size() > size_t(kCacheSize))
+        newCache.resize(kCacheSize);
+      cache.swap(newCache);
+    }
+
+    indices.swap(result);
+  }
+
+  void optimizeOverdraw(std::vector<uint32_t> &indices, const glm::vec3 *positions, size_t vertexCount, float threshold)
+  {
+    const size_t triangleCount = indices.size() / 3u;
+    if (triangleCount == 0u)
+      return;
+
+    const unsigned int cacheSize = 16u;
+    const float acmr = computeACMR(indices, vertexCount, cacheSize);
+
+    // A new cluster starts where the cache was flushed : a triangle with three misses
+    std::vector<uint32_t> clusters;
+    {
+      std::vector<unsigned int> timestamps(vertexCount, 0u);
+      unsigned int time = cacheSize + 1u;
+
+      for (size_t t = 0; t < triangleCount; ++t)
+      {
+        int misses = 0;
+        for (int k = 0; k < 3; ++k)
+        {
+          const uint32_t v = indices[3*t + k];
+          if (time - timestamps[v] > cacheSize)
+          {
+            timestamps[v] = time++;
+            ++misses;
+          }
+        }
+        if (t == 0u || misses == 3)
+          clusters.push_back(uint32_t(t));
+      }
+      clusters.push_back(uint32_t(triangleCount));
+    }
+
+    const size_t clusterCount = clusters.size() - 1u;
+    if (clusterCount < 2u)
+      return;
+
+    // Area weighted centroid and normal of the mesh and of each cluster
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+
+    std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f));
+    std::vector<glm::vec3> normals(clusterCount, glm::vec3(0.0f));
+
+    for (size_t c = 0; c < clusterCount; ++c)
+    {
+      float clusterArea = 0.0f;
+      for (uint32_t t = clusters[c]; t < clusters[c + 1u]; ++t)
+      {
+        const glm::vec3 &p0 = positions[indices[3*t]];
+        const glm::vec3 &p1 = positions[indices[3*t+1]];
+        const glm::vec3 &p2 = positions[indices[3*t+2]];
+
+        const glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+        const float area = glm::length(n);
+        const glm::vec3 center = (p0 + p1 + p2) * (area / 3.0f);
+
+        centroids[c] += center;
+        normals[c] += n;
+        clusterArea += area;
+      }
+
+      meshCentroid += centroids[c];
+      meshArea += clusterArea;
+      if (clusterArea > 0.0f)
+        centroids[c] /= clusterArea;
+    }
+
+    if (meshArea > 0.0f)
+      meshCentroid /= meshArea;
+
+    // Clusters facing away from the center occlude the others, draw them first
+    std::vector<float> sortKeys(clusterCount);
+    std::vector<uint32_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; ++c)
+    {
+      const float length = glm::length(normals[c]);
+      const glm::vec3 n = (length > 0.0f) ? normals[c] / length : glm::vec3(0.0f);
+      sortKeys[c] = glm::dot(centroids[c] - meshCentroid, n);
+      order[c] = uint32_t(c);
+    }
+
+    std::stable_sort(order.begin(), order.end(), [&sortKeys](uint32_t a, uint32_t b) {
+      return sortKeys[a] > sortKeys[b];
+    });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for (auto c : order)
+      result.insert(result.end(), indices.begin() + 3*clusters[c], indices.begin() + 3*clusters[c + 1u]);
+
+    if (computeACMR(result, vertexCount, cacheSize) <= acmr * threshold)
+      indices.swap(result);
+  }
+
+  std::vector<uint32_t> optimizeVertexFetch(std::vector<uint32_t> &indices, size_t vertexCount, size_t &newVertexCount)
+  {
+    std::vector<uint32_t> remap(vertexCount, ~0u);
+    uint32_t next = 0u;
+
+    for (auto &index : indices)
+    {
+      if (remap[index] == ~0u)
+        remap[index] = next++;
+      index = remap[index];
+    }
+
+    newVertexCount = next;
+    return remap;
+  }
+
+  float simplify(
+    std::vector<uint32_t> &destination,
+    const std::vector<uint32_t> &indices,
+    const glm::vec3 *positions,
+    size_t vertexCount,
+    size_t targetIndexCount)
+  {
+    std::vector<uint32_t> triangles(indices);
+    const size_t triangleCount = triangles.size() / 3u;
+    size_t liveCount = triangleCount;
+
+    // Seams : several vertices at one position. Borders : edges of a single triangle.
+    std::vector<bool> locked(vertexCount, false);
+    {
+      std::vector<uint32_t> order(vertexCount);
+      for (size_t v = 0; v < vertexCount; ++v)
+        order[v] = uint32_t(v);
+
+      auto less = [positions](uint32_t a, uint32_t b) {
+        const glm::vec3 &pa = positions[a], &pb = positions[b];
+        return (pa.x != pb.x) ? (pa.x < pb.x) : (pa.y != pb.y) ? (pa.y < pb.y) : (pa.z < pb.z);
+      };
+      std::sort(order.begin(), order.end(), less);
+
+      for (size_t i = 1; i < vertexCount; ++i)
+        if (positions[order[i]] == positions[order[i-1]])
+          locked[order[i]] = locked[order[i-1]] = true;
+
+      std::unordered_map<uint64_t, int> edges;
+      for (size_t t = 0; t < triangleCount; ++t)
+        for (int k = 0; k < 3; ++k)
+          ++edges[edgeKey(triangles[3*t + k], triangles[3*t + (k+1)%3])];
+
+      for (auto &edge : edges)
+        if (edge.second == 1)
+          locked[uint32_t(edge.first >> 32)] = locked[uint32_t(edge.first)] = true;
+    }
+
+    std::vector<Quadric> quadrics(vertexCount);
+    std::vector<std::vector<uint32_t>> adjacency(vertexCount);
+
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+      const uint32_t *tri = &triangles[3*t];
+      const glm::dvec3 p0(positions[tri[0]]), p1(positions[tri[1]]), p2(positions[tri[2]]);
+      glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+      const double length = glm::length(n);
+      if (length > 0.0)
+        n /= length;
+
+      const Quadric plane(n, -glm::dot(n, p0));
+      for (int k = 0; k < 3; ++k)
+      {
+        quadrics[tri[k]] += plane;
+        adjacency[tri[k]].push_back(uint32_t(t));
+      }
+    }
+
+    std::vector<bool> alive(triangleCount, true);
+    std::vector<bool> collapsed(vertexCount, false);
+    std::vector<uint32_t> version(vertexCount, 0u);
+    std::priority_queue<Collapse> heap;
+
+    auto pushCollapse = [&](uint32_t from, uint32_t to) {
+      if (locked[from] || from == to)
+        return;
+      Quadric q = quadrics[from];
+      q += quadrics[to];
+      heap.push(Collapse{ q.error(positions[to]), from, to, version[from], version[to] });
+    };
+
+    for (size_t t = 0; t < triangleCount; ++t)
+      for (int k = 0; k < 3; ++k)
+      {
+        pushCollapse(triangles[3*t + k], triangles[3*t + (k+1)%3]);
+        pushCollapse(triangles[3*t + (k+1)%3], triangles[3*t + k]);
+      }
+
+    double maxError = 0.0;
+    const size_t targetCount = targetIndexCount / 3u;
+
+    while (liveCount > targetCount && !heap.empty())
+    {
+      const Collapse c = heap.top();
+      heap.pop();
+
+      const uint32_t u = c.from, v = c.to;
+      if (collapsed[u] || collapsed[v] || c.fromVersion != version[u] || c.toVersion != version[v])
+        continue;
+
+      // Moving u onto v must not fold a triangle over
+      bool bValid = false, bFlip = false;
+      for (auto t : adjacency[u])
+      {
+        if (!alive[t]) continue;
+        const uint32_t *tri = &triangles[3*t];
+        if (tri[0] == v || tri[1] == v || tri[2] == v)
+        {
+          bValid = true;
+          continue;
+        }
+
+        glm::vec3 p[3], q[3];
+        for (int k = 0; k < 3; ++k)
+        {
+          p[k] = positions[tri[k]];
+          q[k] = (tri[k] == u) ? positions[v] : p[k];
+        }
+        const glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+        const glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+        if (glm::dot(before, after) <= 0.0f)
+        {
+          bFlip = true;
+          break;
+        }
+      }
+      if (!bValid || bFlip)
+        continue;
+
+      for (auto t : adjacency[u])
+      {
+        if (!alive[t]) continue;
+        uint32_t *tri = &triangles[3*t];
+        if (tri[0] == v || tri[1] == v || tri[2] == v)
+        {
+          alive[t] = false;
+          --liveCount;
+          continue;
+        }
+        for (int k = 0; k < 3; ++k)
+          if (tri[k] == u) tri[k] = v;
+        adjacency[v].push_back(t);
+      }
+
+      collapsed[u] = true;
+      quadrics[v] += quadrics[u];
+      ++version[v];
+      maxError = std::max(maxError, c.cost);
+
+      // New costs around v
+      for (auto t : adjacency[v])
+      {
+        if (!alive[t]) continue;
+        for (int k = 0; k < 3; ++k)
+        {
+          const uint32_t w = triangles[3*t + k];
+          pushCollapse(v, w);
+          pushCollapse(w, v);
+        }
+      }
+    }
+
+    destination.clear();
+    destination.reserve(liveCount * 3u);
+    for (size_t t = 0; t < triangleCount; ++t)
+      if (alive[t])
+        destination.insert(destination.end(), &triangles[3*t], &triangles[3*t] + 3);
+
+    return float(std::sqrt(maxError));
+  }
+
+  void buildMeshlets(
+    std::vector<Meshlet> &meshlets,
+    const uint32_t *indices,
+    size_t indexCount,
+    const glm::vec3 *positions,
+    size_t vertexCount,
+    size_t maxVertices,
+    size_t maxTriangles)
+  {
+    meshlets.clear();
+
+    // meshlet that last used each vertex
+    std::vector<uint32_t> owner(vertexCount, ~0u);
+    size_t first = 0u, uniqueCount = 0u;
+
+    auto emit = [&](size_t end) {
+      Meshlet m;
+      m.firstIndex = uint32_t(first);
+      m.indexCount = uint32_t(end - first);
+
+      glm::vec3 bmin = positions[indices[first]], bmax = bmin;
+      glm::vec3 normalSum(0.0f);
+      for (size_t i = first; i < end; i += 3u)
+      {
+        const glm::vec3 &p0 = positions[indices[i]], &p1 = positions[indices[i+1]], &p2 = positions[indices[i+2]];
+        bmin = glm::min(bmin, glm::min(p0, glm::min(p1, p2)));
+        bmax = glm::max(bmax, glm::max(p0, glm::max(p1, p2)));
+
+        const glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+        const float length = glm::length(n);
+        if (length > 0.0f)
+          normalSum += n / length;
+      }
+
+      m.center = 0.5f * (bmin + bmax);
+      float radius2 = 0.0f;
+      for (size_t i = first; i < end; ++i)
+      {
+        const glm::vec3 d = positions[indices[i]] - m.center;
+        radius2 = std::max(radius2, glm::dot(d, d));
+      }
+      m.radius = std::sqrt(radius2);
+
+      // The widest angle between the mean normal and a face gives the cone
+      const float axisLength = glm::length(normalSum);
+      m.coneAxis = (axisLength > 0.0f) ? normalSum / axisLength : glm::vec3(0.0f);
+      float minDot = (axisLength > 0.0f) ? 1.0f : -1.0f;
+      for (size_t i = first; i < end && minDot > 0.0f; i += 3u)
+      {
+        const glm::vec3 &p0 = positions[indices[i]], &p1 = positions[indices[i+1]], &p2 = positions[indices[i+2]];
+        const glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+        const float length = glm::length(n);
+        if (length > 0.0f)
+          minDot = std::min(minDot, glm::dot(n / length, m.coneAxis));
+      }
+
+      if (minDot <= 0.0f)
+      {
+        m.coneAxis = glm::vec3(0.0f);
+        m.coneCutoff = 1.0f;
+      }
+      else
+        m.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+
+      meshlets.push_back(m);
+    };
+
+    for (size_t i = 0u; i + 2u < indexCount; i += 3u)
+    {
+      const uint32_t *tri = &indices[i];
+      uint32_t id = uint32_t(meshlets.size());
+
+      size_t newVertices = 0u;
+      for (int k = 0; k < 3; ++k)
+        if (owner[tri[k]] != id)
+          ++newVertices;
+
+      if (i > first && (uniqueCount + newVertices > maxVertices || (i - first) / 3u >= maxTriangles))
+      {
+        emit(i);
+        first = i;
+        uniqueCount = 0u;
+        id = uint32_t(meshlets.size());
+      }
+
+      for (int k = 0; k < 3; ++k)
+        if (owner[tri[k]] != id)
+        {
+          owner[tri[k]] = id;
+          ++uniqueCount;
+        }
+    }
+
+    if (first + 2u < indexCount)
+      emit(indexCount - indexCount % 3u);
+  }
+}
@@ -0,0 +1,107 @@
+/**
+ *
+ *        \file MeshOptimizer.hpp
+ *
+ *      Reordering of indexed triangle lists for the GPU :
+ *        # post-transform vertex cache (Forsyth, "Linear-Speed Vertex
+ *          Cache Optimisation")
+ *        # overdraw, by sorting clusters of triangles outward first
+ *          (Sander et al., "Fast Triangle Reordering for Vertex Locality
+ *          and Reduced Overdraw")
+ *        # vertex fetch, by storing vertices in their first use order
+ *      and simplification by quadric error edge collapses (Garland and
+ *      Heckbert, "Surface Simplification Using Quadric Error Metrics"),
+ *      and meshlets : small runs of triangles with culling bounds.
+ *
+ */
+
+
+#pragma once
+
+#ifndef MESHOPTIMIZER_HPP
+#define MESHOPTIMIZER_HPP
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+
+namespace mesh_optimizer
+{
+  /**
+   *  Consecutive triangles of an index buffer, with the bounds to cull them
+   *  as a whole. The cluster faces away from any eye E where
+   *    dot(center - E, coneAxis) >= coneCutoff * length(center - E) + radius
+   */
+  struct Meshlet
+  {
+    glm::vec3 center;
+    float radius;
+    glm::vec3 coneAxis;
+    float coneCutoff;     // 1 when the triangles spread over a half sphere
+    uint32_t firstIndex;
+    uint32_t indexCount;
+  };
+
+  /** Average number of vertex shader invocations per triangle with a FIFO cache */
+  float computeACMR(const std::vector<uint32_t> &indices, size_t vertexCount, unsigned int cacheSize = 16u);
+
+  /** Reorder the triangles to reuse the post-transform cache */
+  void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount);
+
+  /**
+   *  Reorder clusters of an optimized triangle list to draw outer faces first.
+   *  The new order is dropped when the ACMR grows by more than 'threshold'.
+   */
+  void optimizeOverdraw(std::vector<uint32_t> &indices, const glm::vec3 *positions, size_t vertexCount, float threshold = 1.05f);
+
+  /**
+   *  Renumber the vertices in their first use order, unreferenced ones are
+   *  removed. Returns the old to new index table (~0u for removed vertices).
+   */
+  std::vector<uint32_t> optimizeVertexFetch(std::vector<uint32_t> &indices, size_t vertexCount, size_t &newVertexCount);
+
+  /**
+   *  Collapse edges of the cheapest quadric error until 'targetIndexCount'
+   *  is reached or no edge can go. Vertices are only merged into other
+   *  vertices, so the result indexes the same vertex buffer. Borders and
+   *  attribute seams (positions shared by several vertices) are kept.
+   *  Returns the geometric error of the worst collapse, in object units.
+   */
+  float simplify(
+    std::vector<uint32_t> &destination,
+    const std::vector<uint32_t> &indices,
+    const glm::vec3 *positions,
+    size_t vertexCount,
+    size_t targetIndexCount);
+
+  /**
+   *  Split the first 'indexCount' indices into meshlets of at most
+   *  'maxVertices' distinct vertices and 'maxTriangles' triangles. The input
+   *  order is kept, it should already be optimized for the vertex cache.
+   */
+  void buildMeshlets(
+    std::vector<Meshlet> &meshlets,
+    const uint32_t *indices,
+    size_t indexCount,
+    const glm::vec3 *positions,
+    size_t vertexCount,
+    size_t maxVertices = 64u,
+    size_t maxTriangles = 124u);
+
+  /** Move the vertex attributes to the place given by optimizeVertexFetch */
+  template<typename T>
+  void remapVertices(std::vector<T> &vertices, const std::vector<uint32_t> &remap, size_t newVertexCount)
+  {
+    if (vertices.size() != remap.size())
+      return;
+
+    std::vector<T> result(newVertexCount);
+    for (size_t i = 0; i < remap.size(); ++i)
+      if (remap[i] != ~0u)
+        result[remap[i]] = vertices[i];
+    vertices.swap(result);
+  }
+}
+
+#endif //MESHOPTIMIZER_HPP
@@ -0,0 +1,52 @@
+/**
+ *
+ *        \file ParallelFor.hpp
+ *
+ *      Spread independent iterations over the cores, the calling thread
+ *      included. Iterations are handed out one by one, so uneven ones
+ *      (submeshes of different sizes, ..) still balance.
+ *
+ */
+
+
+#pragma once
+
+#ifndef PARALLELFOR_HPP
+#define PARALLELFOR_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+
+template<typename Function>
+void parallelFor(size_t count, Function func)
+{
+  const size_t threadCount = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), count);
+
+  if (threadCount <= 1u)
+  {
+    for (size_t i = 0; i < count; ++i)
+      func(i);
+    return;
+  }
+
+  std::atomic<size_t> next(0u);
+  auto worker = [&]() {
+    for (size_t i = next++; i < count; i = next++)
+      func(i);
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(threadCount - 1u);
+  for (size_t t = 1u; t < threadCount; ++t)
+    threads.emplace_back(worker);
+
+  worker();
+
+  for (auto &thread : threads)
+    thread.join();
+}
+
+#endif //PARALLELFOR_HPP
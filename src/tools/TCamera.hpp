@@ -110,6 +110,13 @@ class TCamera
     const glm::mat4& getViewMatrix() const { return m_viewMatrix; }
     const glm::mat4& getViewProjMatrix() const { return m_viewProjMatrix; }
     
+    // Inverse view projection without the translation, from clip space to
+    // the directions of 'model' space (SkyTriangle.glsl)
+    glm::mat4 getSkyMatrix(const glm::mat4& model = glm::mat4(1.0f)) const
+    {
+      return glm::inverse( m_projectionMatrix * glm::mat4(glm::mat3(m_viewMatrix)) * model );
+    }
+    
     // Or use the row of the view matrix
     const glm::vec3& getPosition() const { return m_position; }
     const glm::vec3& getTarget() const { return m_target; }
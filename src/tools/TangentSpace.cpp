@@ -0,0 +1,173 @@
+/**
+ *
+ *        \file TangentSpace.cpp
+ *
+ */
+
+
+#include <cmath>
+
+#include "TangentSpace.hpp"
+
+
+namespace
+{
+  /** Any unit vector orthogonal to 'n', for vertices without a usable mapping */
+  glm::vec3 orthogonal(const glm::vec3 &n)
+  {
+    const glm::vec3 axis = (std::fabs(n.x) < 0.9f) ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    return glm::normalize(glm::cross(axis, n));
+  }
+
+  /** Gram-Schmidt against the normal */
+  glm::vec3 orthonormalize(const glm::vec3 &n, const glm::vec3 &t)
+  {
+    const glm::vec3 projected = t - n * glm::dot(n, t);
+    const float length = glm::length(projected);
+    return (length > 1e-6f) ? projected / length : orthogonal(n);
+  }
+
+  /** Sign of the bitangent of a face at a vertex of normal 'n' */
+  float handedness(const glm::vec3 &n, const glm::vec3 &sdir, const glm::vec3 &tdir)
+  {
+    return (glm::dot(glm::cross(n, sdir), tdir) < 0.0f) ? -1.0f : 1.0f;
+  }
+
+  /** Give the left handed faces of a vertex also used by right handed ones their own copy */
+  void splitMirroredVertices(
+    std::vector<uint32_t> &indices,
+    std::vector<glm::vec3> &positions,
+    std::vector<glm::vec3> &normals,
+    std::vector<glm::vec2> &texcoords,
+    const std::vector<glm::vec3> &sdirs,
+    const std::vector<glm::vec3> &tdirs,
+    const std::vector<bool> &mapped)
+  {
+    const size_t vertexCount = positions.size();
+    const size_t cornerCount = mapped.size() * 3;
+
+    // bit 0 : used by a right handed face, bit 1 : by a left handed one
+    std::vector<uint8_t> sides(vertexCount, 0u);
+    for (size_t c = 0; c < cornerCount; ++c)
+    {
+      const size_t f = c / 3;
+      if (!mapped[f])
+        continue;
+      const uint32_t v = indices[c];
+      sides[v] |= (handedness(normals[v], sdirs[f], tdirs[f]) < 0.0f) ? 2u : 1u;
+    }
+
+    std::vector<uint32_t> copies(vertexCount, 0u);
+    for (size_t c = 0; c < cornerCount; ++c)
+    {
+      const size_t f = c / 3;
+      const uint32_t v = indices[c];
+      if (!mapped[f] || sides[v] != 3u || handedness(normals[v], sdirs[f], tdirs[f]) > 0.0f)
+        continue;
+
+      // copies are appended, index 0 is never one of them
+      if (!copies[v])
+      {
+        copies[v] = uint32_t(positions.size());
+        const glm::vec3 p = positions[v], n = normals[v];
+        const glm::vec2 uv = texcoords[v];
+        positions.push_back(p);
+        normals.push_back(n);
+        texcoords.push_back(uv);
+      }
+      indices[c] = copies[v];
+    }
+  }
+}
+
+
+namespace tangent_space
+{
+  void generateTangents(
+    std::vector<uint32_t> &indices,
+    std::vector<glm::vec3> &positions,
+    std::vector<glm::vec3> &normals,
+    std::vector<glm::vec2> &texcoords,
+    std::vector<glm::vec4> &tangents)
+  {
+    if (normals.size() != positions.size() || texcoords.size() != positions.size())
+    {
+      tangents.assign(positions.size(), glm::vec4(1.0f, 0.0f, 0.0f, 1.0f));
+      return;
+    }
+
+    // dP/du and dP/dv of every face, the ones without a usable mapping are skipped
+    const size_t faceCount = indices.size() / 3;
+    std::vector<glm::vec3> sdirs(faceCount), tdirs(faceCount);
+    std::vector<bool> mapped(faceCount, false);
+    for (size_t f = 0; f < faceCount; ++f)
+    {
+      const uint32_t face[3] = { indices[3*f], indices[3*f+1], indices[3*f+2] };
+
+      const glm::vec3 e1 = positions[face[1]] - positions[face[0]];
+      const glm::vec3 e2 = positions[face[2]] - positions[face[0]];
+      const glm::vec2 d1 = texcoords[face[1]] - texcoords[face[0]];
+      const glm::vec2 d2 = texcoords[face[2]] - texcoords[face[0]];
+
+      // the sign of the determinant is the handedness of the face
+      const float det = d1.x * d2.y - d2.x * d1.y;
+      if (std::fabs(det) < 1e-12f)
+        continue;
+
+      const float r = 1.0f / det;
+      sdirs[f] = (e1 * d2.y - e2 * d1.y) * r;
+      tdirs[f] = (e2 * d1.x - e1 * d2.x) * r;
+      mapped[f] = true;
+    }
+
+    // averaging across a mirrored seam would cancel the tangents and pick one sign for both sides
+    splitMirroredVertices(indices, positions, normals, texcoords, sdirs, tdirs, mapped);
+
+    const size_t vertexCount = positions.size();
+    std::vector<glm::vec3> tan(vertexCount, glm::vec3(0.0f));
+    std::vector<glm::vec3> bitan(vertexCount, glm::vec3(0.0f));
+
+    for (size_t f = 0; f < faceCount; ++f)
+    {
+      if (!mapped[f])
+        continue;
+
+      const uint32_t face[3] = { indices[3*f], indices[3*f+1], indices[3*f+2] };
+      const glm::vec3 &sdir = sdirs[f];
+      const glm::vec3 &tdir = tdirs[f];
+
+      for (int k = 0; k < 3; ++k)
+      {
+        const uint32_t v = face[k];
+        const glm::vec3 &p = positions[v];
+        const glm::vec3 a = positions[face[(k+1)%3]] - p;
+        const glm::vec3 b = positions[face[(k+2)%3]] - p;
+
+        // weight by the angle of the face at this corner, as MikkTSpace does
+        const float la = glm::length(a), lb = glm::length(b);
+        if (la <= 0.0f || lb <= 0.0f)
+          continue;
+        const float angle = std::acos(glm::clamp(glm::dot(a, b) / (la * lb), -1.0f, 1.0f));
+
+        tan[v] += angle * orthonormalize(normals[v], sdir);
+        bitan[v] += angle * tdir;
+      }
+    }
+
+    tangents.resize(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+      const glm::vec3 &n = normals[v];
+      const glm::vec3 t = orthonormalize(n, tan[v]);
+      const float w = (glm::dot(glm::cross(n, t), bitan[v]) < 0.0f) ? -1.0f : 1.0f;
+      tangents[v] = glm::vec4(t, w);
+    }
+  }
+
+  glm::vec4 makeTangent(const glm::vec3 &normal, const glm::vec3 &tangent, const glm::vec3 &bitangent)
+  {
+    const glm::vec3 t = orthonormalize(normal, tangent);
+    const float w = (glm::dot(glm::cross(normal, t), bitangent) < 0.0f) ? -1.0f : 1.0f;
+    return glm::vec4(t, w);
+  }
+}
@@ -0,0 +1,42 @@
+/**
+ *
+ *        \file TangentSpace.hpp
+ *
+ *      Per-vertex tangent frames for normal mapping, following the
+ *      MikkTSpace conventions : face tangents are accumulated with the
+ *      angle of the face at the vertex, then orthogonalized against the
+ *      vertex normal. The handedness of the bitangent goes in w :
+ *        bitangent = w * cross(normal, tangent.xyz)
+ *
+ *      A vertex shared by faces of opposite handedness, on a mirrored UV
+ *      seam, is split so that each side keeps its own frame.
+ *
+ */
+
+
+#pragma once
+
+#ifndef TANGENTSPACE_HPP
+#define TANGENTSPACE_HPP
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+
+namespace tangent_space
+{
+  /** Tangents of an indexed triangle list, one per vertex. The split vertices
+      are appended to positions, normals & texcoords and the indices updated */
+  void generateTangents(
+    std::vector<uint32_t> &indices,
+    std::vector<glm::vec3> &positions,
+    std::vector<glm::vec3> &normals,
+    std::vector<glm::vec2> &texcoords,
+    std::vector<glm::vec4> &tangents);
+
+  /** Tangent frame from an imported tangent / bitangent pair */
+  glm::vec4 makeTangent(const glm::vec3 &normal, const glm::vec3 &tangent, const glm::vec3 &bitangent);
+}
+
+#endif //TANGENTSPACE_HPP
@@ -14,21 +14,55 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string>
+#include <vector>
 #include <sstream>
 #include <fstream>
 #include <math.h>
+#include <time.h>
+#include <sys/stat.h>
 
 namespace nv_helpers
 {
 
-  inline std::string findFile( std::string const & infilename, std::vector<std::string> directories)
+  inline bool fileExists( std::string const & filename )
   {
-    std::ifstream stream;
+    struct stat info;
+    return stat(filename.c_str(), &info) == 0 && (info.st_mode & S_IFREG) != 0;
+  }
+
+  // Modification time in nanoseconds where the platform has them, and size :
+  // two saves within the same second still differ. Zero when the file can't be found
+  struct FileStamp
+  {
+    unsigned long long mtime = 0;
+    unsigned long long size = 0;
+
+    bool operator==( FileStamp const & other ) const { return mtime == other.mtime && size == other.size; }
+    bool operator!=( FileStamp const & other ) const { return !(*this == other); }
+  };
 
+  inline FileStamp fileStamp( std::string const & filename )
+  {
+    FileStamp stamp;
+    struct stat info;
+    if (stat(filename.c_str(), &info) != 0) return stamp;
+  #if defined(__APPLE__)
+    stamp.mtime = (unsigned long long)info.st_mtimespec.tv_sec * 1000000000ull + info.st_mtimespec.tv_nsec;
+  #elif defined(_WIN32)
+    stamp.mtime = (unsigned long long)info.st_mtime * 1000000000ull;
+  #else
+    stamp.mtime = (unsigned long long)info.st_mtim.tv_sec * 1000000000ull + info.st_mtim.tv_nsec;
+  #endif
+    stamp.size = (unsigned long long)info.st_size;
+    return stamp;
+  }
+
+  inline std::string findFile( std::string const & infilename, std::vector<std::string> const & directories)
+  {
     for (size_t i = 0; i < directories.size(); i++ ){
       std::string filename = directories[i] + "/" + infilename;
-      stream.open(filename.c_str());
-      if (stream.is_open()) return filename;
+      if (fileExists(filename)) return filename;
     }
     return infilename;
   }
@@ -0,0 +1,467 @@
+/**
+ *
+ *    \file ProbeBaker.cpp
+ *
+ *    Batch light probe bake : the HDR images are decoded on worker threads
+ *    while the GL thread bakes the previous ones, a bounded queue between
+ *    them caps the decoded images held in memory. Each probe is read back
+ *    through fenced pack buffers, mapped while the next one bakes and written
+ *    by a writer thread, so the GL thread never waits on a file. Every probe is written as
+ *    <output>/<name>_environment.dds, _irradiance.dds and _prefilter.dds,
+ *    next to one brdf_lut.dds.
+ *
+ *    usage : lightProbe-bake <hdr dir | manifest> [--output <dir>] [--size <n>]
+ *              [--irradiance-size <n>] [--quality low|medium|high] [--threads <n>]
+ *
+ *    A manifest lists one image per line, empty lines and '#' comments are skipped.
+ *
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <dirent.h>
+#endif
+
+#include <GL/glew.h>
+#include <GLType/BaseTexture.h>
+#include <GLType/HeadlessContext.h>
+#include <GLType/ProgramShader.h>
+#include <GLType/SamplerCache.h>
+#include <LightProbe.h>
+#include <gli/gli.hpp>
+#include <tools/misc.hpp>
+#include <tools/stb_image.h>
+
+namespace {
+    struct Options
+    {
+        std::string input;
+        std::string output = ".";
+        uint32_t envMapSize = 512;
+        uint32_t irradianceSize = 16;
+        uint32_t quality = 1;
+        uint32_t threadCount = 0;   // 0 : one per core, minus the GL thread
+    };
+
+    struct DecodedImage
+    {
+        std::string filename;
+        int width = 0;
+        int height = 0;
+        int components = 0;
+        float* pixels = nullptr;    // stbi_loadf result, null when the decode failed
+    };
+
+    /** Probe files written by the writer thread, the suffixes of LightProbe::save */
+    struct WriteJob
+    {
+        std::string path;
+        gli::texture images[3];
+    };
+    const char* const kProbeSuffixes[] = { "_environment.dds", "_irradiance.dds", "_prefilter.dds" };
+
+    /** Items handed between threads, push blocks while it is full */
+    template <class T>
+    class WorkQueue
+    {
+      public:
+        WorkQueue(size_t capacity, size_t producerCount) :
+            m_capacity(capacity), m_producerCount(producerCount) {}
+
+        void push(T&& item)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_notFull.wait(lock, [this] { return m_items.size() < m_capacity; });
+            m_items.push_back(std::move(item));
+            m_notEmpty.notify_one();
+        }
+
+        /** Return false once every producer is done and the queue is empty */
+        bool pop(T& item)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_notEmpty.wait(lock, [this] { return !m_items.empty() || m_producerCount == 0; });
+            if (m_items.empty())
+                return false;
+
+            item = std::move(m_items.front());
+            m_items.pop_front();
+            m_notFull.notify_one();
+            return true;
+        }
+
+        void producerDone()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_producerCount--;
+            m_notEmpty.notify_all();
+        }
+
+      private:
+        std::mutex m_mutex;
+        std::condition_variable m_notFull;
+        std::condition_variable m_notEmpty;
+        std::deque<T> m_items;
+        size_t m_capacity;
+        size_t m_producerCount;
+    };
+
+    /** Probe cubemaps copied into pack buffers by the GPU, the fence tells when they can be mapped */
+    struct Readback
+    {
+        std::string path;
+        gli::texture images[3];
+        GLuint buffers[3] = {};
+        GLsync fence = nullptr;
+    };
+
+    void startReadback(LightProbe &probe, const std::string &path, Readback &readback)
+    {
+        const BaseTexturePtr textures[] = { probe.getEnvCube(), probe.getIrradiance(), probe.getPrefilter() };
+        for (int i = 0; i < 3; ++i)
+        {
+            // the probe sizes are fixed, the buffers of the first probe are reused
+            if (!readback.buffers[i])
+            {
+                glCreateBuffers(1, &readback.buffers[i]);
+                glNamedBufferStorage(readback.buffers[i], textures[i]->getReadbackSize(), nullptr, GL_MAP_READ_BIT);
+            }
+            textures[i]->readPixels(readback.images[i], readback.buffers[i]);
+        }
+        readback.path = path;
+        readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    /** Wait for the copy, usually done while the next probe was baking, and move the pixels to 'job' */
+    bool finishReadback(Readback &readback, WriteJob &job)
+    {
+        GLenum status;
+        while ((status = glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull)) == GL_TIMEOUT_EXPIRED) {}
+        glDeleteSync(readback.fence);
+        readback.fence = nullptr;
+        if (status == GL_WAIT_FAILED)
+            return false;
+
+        for (int i = 0; i < 3; ++i)
+        {
+            gli::texture &image = readback.images[i];
+            const void* pixels = glMapNamedBufferRange(readback.buffers[i], 0, GLsizeiptr(image.size()), GL_MAP_READ_BIT);
+            if (!pixels)
+                return false;
+            memcpy(image.data(), pixels, image.size());
+            glUnmapNamedBuffer(readback.buffers[i]);
+            job.images[i] = image;
+        }
+        job.path = readback.path;
+        return true;
+    }
+
+    bool endsWith(const std::string &str, const std::string &suffix)
+    {
+        return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    /** Every .hdr of 'directory', false when it is not a directory */
+    bool listImages(const std::string &directory, std::vector<std::string> &files)
+    {
+    #ifdef _WIN32
+        WIN32_FIND_DATAA data;
+        DWORD attributes = GetFileAttributesA(directory.c_str());
+        if (attributes == INVALID_FILE_ATTRIBUTES || !(attributes & FILE_ATTRIBUTE_DIRECTORY))
+            return false;
+        HANDLE handle = FindFirstFileA((directory + "/*.hdr").c_str(), &data);
+        if (handle != INVALID_HANDLE_VALUE)
+        {
+            do {
+                files.push_back(directory + "/" + data.cFileName);
+            } while (FindNextFileA(handle, &data));
+            FindClose(handle);
+        }
+    #else
+        DIR* dir = opendir(directory.c_str());
+        if (!dir)
+            return false;
+        while (struct dirent* entry = readdir(dir))
+        {
+            std::string name = entry->d_name;
+            if (endsWith(name, ".hdr") || endsWith(name, ".HDR"))
+                files.push_back(directory + "/" + name);
+        }
+        closedir(dir);
+    #endif
+        std::sort(files.begin(), files.end());
+        return true;
+    }
+
+    bool readManifest(const std::string &filename, std::vector<std::string> &files)
+    {
+        std::ifstream manifest(filename);
+        if (!manifest.is_open())
+            return false;
+
+        std::string line;
+        while (std::getline(manifest, line))
+        {
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            if (!line.empty() && line[0] != '#')
+                files.push_back(line);
+        }
+        return true;
+    }
+
+    std::string probeName(const std::string &filename)
+    {
+        std::string name = nv_helpers::getFileName(filename);
+        return name.substr(0, name.find_last_of('.'));
+    }
+
+    /** Images of different directories with the same name would overwrite each other's probe */
+    bool checkProbeNames(const std::vector<std::string> &files)
+    {
+        std::unordered_map<std::string, const std::string*> names;
+        bool bUnique = true;
+        for (auto &file : files)
+        {
+            auto inserted = names.emplace(probeName(file), &file);
+            if (!inserted.second)
+            {
+                fprintf(stderr, "\"%s\" and \"%s\" both bake to %s_*.dds\n",
+                    inserted.first->second->c_str(), file.c_str(), inserted.first->first.c_str());
+                bUnique = false;
+            }
+        }
+        return bUnique;
+    }
+
+    bool parseOptions(int argc, char** argv, Options &options)
+    {
+        if (argc < 2)
+            return false;
+
+        options.input = argv[1];
+        for (int i = 2; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            const bool bHasValue = (i + 1 < argc);
+            if (arg == "--output" && bHasValue)
+                options.output = argv[++i];
+            else if (arg == "--size" && bHasValue)
+                options.envMapSize = uint32_t(atoi(argv[++i]));
+            else if (arg == "--irradiance-size" && bHasValue)
+                options.irradianceSize = uint32_t(atoi(argv[++i]));
+            else if (arg == "--quality" && bHasValue)
+            {
+                std::string quality = argv[++i];
+                options.quality = (quality == "low") ? 0 : (quality == "high") ? 2 : 1;
+            }
+            else if (arg == "--threads" && bHasValue)
+                options.threadCount = uint32_t(atoi(argv[++i]));
+            else
+                return false;
+        }
+
+        auto isPowerOfTwo = [](uint32_t x) { return x != 0 && (x & (x - 1)) == 0; };
+        if (options.envMapSize < 2 || !isPowerOfTwo(options.envMapSize) || !isPowerOfTwo(options.irradianceSize))
+        {
+            fprintf(stderr, "Bake sizes must be powers of two\n");
+            return false;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        fprintf(stderr, "usage : %s <hdr dir | manifest> [--output <dir>] [--size <n>] [--irradiance-size <n>] "
+                        "[--quality low|medium|high] [--threads <n>]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::string> files;
+    if (!listImages(options.input, files) && !readManifest(options.input, files))
+    {
+        fprintf(stderr, "Cannot read \"%s\"\n", options.input.c_str());
+        return EXIT_FAILURE;
+    }
+    if (files.empty())
+    {
+        fprintf(stderr, "No image to bake in \"%s\"\n", options.input.c_str());
+        return EXIT_FAILURE;
+    }
+    if (!checkProbeNames(files))
+        return EXIT_FAILURE;
+
+    HeadlessContext context;
+    if (!context.create(4, 3))
+        return EXIT_FAILURE;
+
+    glewExperimental = GL_TRUE;
+    GLenum result = glewInit();
+    if (result != GLEW_OK)
+    {
+        fprintf(stderr, "Error: %s\n", glewGetErrorString(result));
+        return EXIT_FAILURE;
+    }
+    // glewInit may leave an error behind
+    while (glGetError() != GL_NO_ERROR) {}
+    printf("%s\n%s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+
+    // Keep in sync with the runtime setup in main.cpp
+    ShaderLibrary& library = ProgramShader::getShaderLibrary();
+    library.addDirectiveToken("*", "#version 440 core");
+    light_probe::addQualityDirectives(library, options.quality);
+    if (!library.load("./shaders", ".glsl"))
+        return EXIT_FAILURE;
+
+    GLuint vertexArray = 0;
+    glGenVertexArrays(1, &vertexArray);
+    glBindVertexArray(vertexArray);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LEQUAL);
+    // the probe prefilter samples across cube faces, it stays on like in initGL
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+    light_probe::initialize("");
+    if (!light_probe::getBrdfLut()->save(options.output + "/brdf_lut.dds"))
+        return EXIT_FAILURE;
+
+    const size_t threadCount = std::min<size_t>(files.size(),
+        options.threadCount ? options.threadCount : std::max(2u, std::thread::hardware_concurrency()) - 1u);
+
+    // stb keeps the flip in a global, set it before the workers start
+    stbi_set_flip_vertically_on_load(true);
+
+    WorkQueue<DecodedImage> queue(threadCount, threadCount);
+    std::atomic<size_t> next(0u);
+    auto decode = [&]() {
+        for (size_t i = next++; i < files.size(); i = next++)
+        {
+            DecodedImage image;
+            image.filename = files[i];
+            image.pixels = stbi_loadf(files[i].c_str(), &image.width, &image.height, &image.components, 0);
+            queue.push(std::move(image));
+        }
+        queue.producerDone();
+    };
+
+    const auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threadCount; ++t)
+        workers.emplace_back(decode);
+
+    std::atomic<size_t> baked(0u), failed(0u);
+
+    // two probes in flight at most, the queue bounds the images waiting for the disk
+    WorkQueue<WriteJob> writes(2, 1);
+    std::thread writer([&]() {
+        WriteJob job;
+        while (writes.pop(job))
+        {
+            bool bSaved = true;
+            for (int i = 0; i < 3; ++i)
+            {
+                const std::string filename = job.path + kProbeSuffixes[i];
+                if (!gli::save(job.images[i], filename))
+                {
+                    fprintf(stderr, "Failed to write %s\n", filename.c_str());
+                    bSaved = false;
+                }
+            }
+            if (bSaved)
+                baked++;
+            else
+                failed++;
+        }
+    });
+
+    Readback readbacks[2];
+    auto finish = [&](Readback &readback) {
+        WriteJob job;
+        if (finishReadback(readback, job))
+            writes.push(std::move(job));
+        else
+            failed++;
+    };
+
+    LightProbe probe;
+    if (probe.initialize(options.envMapSize, options.irradianceSize))
+    {
+        size_t current = 0;
+        DecodedImage image;
+        while (queue.pop(image))
+        {
+            if (!image.pixels)
+            {
+                fprintf(stderr, "Failed to decode %s\n", image.filename.c_str());
+                failed++;
+                continue;
+            }
+
+            auto environment = std::make_shared<BaseTexture>();
+            const bool bUploaded = environment->createFromMemory(image.width, image.height, image.components, GL_FLOAT, image.pixels);
+            stbi_image_free(image.pixels);
+            if (!bUploaded)
+            {
+                fprintf(stderr, "Failed to upload %s\n", image.filename.c_str());
+                failed++;
+                continue;
+            }
+
+            light_probe::setEnvironment(environment);
+            probe.update();
+
+            // the GPU bakes this probe while the previous one is mapped and handed to the writer
+            startReadback(probe, options.output + "/" + probeName(image.filename), readbacks[current]);
+            current ^= 1;
+            if (readbacks[current].fence)
+                finish(readbacks[current]);
+        }
+        if (readbacks[current ^ 1].fence)
+            finish(readbacks[current ^ 1]);
+    }
+    else
+    {
+        // drain the queue so the workers can finish
+        DecodedImage image;
+        while (queue.pop(image))
+            stbi_image_free(image.pixels);
+        failed = files.size();
+    }
+
+    for (auto &worker : workers)
+        worker.join();
+    writes.producerDone();
+    writer.join();
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("Baked %zu probes (%zu failed) in %.2f s with %zu decode threads : %.1f probes per minute\n",
+        baked.load(), failed.load(), seconds, threadCount, seconds > 0.0 ? baked * 60.0 / seconds : 0.0);
+
+    light_probe::shutdown();
+    SamplerCache::getInstance().destroy();
+    library.clear();
+    for (auto &readback : readbacks)
+        glDeleteBuffers(3, readback.buffers);
+    glDeleteVertexArrays(1, &vertexArray);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,133 @@
+/**
+ *
+ *    \file ShaderCompiler.cpp
+ *
+ *    Offline shader check : expand every section of the effect files the
+ *    same way ProgramShader does (ShaderLibrary + manualInclude), write the
+ *    result and, when a validator is given, compile it to SPIR-V for ARB_gl_spirv.
+ *
+ *    usage : lightProbe-shaders <output dir> [--validator glslangValidator] [shader dir]
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <GLType/ShaderLibrary.h>
+#include <GLType/ProgramManager.h>
+#include <tools/misc.hpp>
+
+namespace {
+    // glslangValidator picks the stage from the file extension
+    const char* stageExtension(const std::string &tag)
+    {
+        std::string stage = tag.substr(tag.find_last_of('.') + 1);
+        if (stage == "Vertex") return "vert";
+        if (stage == "Fragment") return "frag";
+        if (stage == "Geometry") return "geom";
+        if (stage == "Compute") return "comp";
+        return nullptr;
+    }
+
+    bool writeFile(const std::string &filename, const std::string &content)
+    {
+        FILE *fp = fopen(filename.c_str(), "wb");
+        if (!fp)
+        {
+            fprintf(stderr, "Cannot open \"%s\" for write!\n", filename.c_str());
+            return false;
+        }
+        fwrite(content.data(), 1, content.size(), fp);
+        fclose(fp);
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage : %s <output dir> [--validator <glslangValidator>] [shader dir]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const std::string outputDir = argv[1];
+    std::string validator;
+    std::string shaderDir = "./shaders";
+    for (int i = 2; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--validator" && i + 1 < argc)
+            validator = argv[++i];
+        else
+            shaderDir = arg;
+    }
+
+    // Includes resolve against the shader directory first, like the runtime does with ./shaders
+    const std::vector<std::string> directories = { shaderDir, "." };
+    nv_helpers_gl::IncludeRegistry includes;
+    nv_helpers_gl::IncludeCache cache;
+
+    // Keep in sync with the runtime setup in main.cpp
+    ShaderLibrary library;
+    library.addDirectiveToken("*", "#version 440 core");
+    if (!library.load(shaderDir, ".glsl"))
+        return EXIT_FAILURE;
+
+    int errors = 0;
+    for (auto& effect : library.getEffects())
+    {
+        for (auto& tag : library.getTags(effect))
+        {
+            const char* ext = stageExtension(tag);
+            if (!ext) continue;
+
+            ShaderSource source;
+            if (!library.getShader(tag, source))
+            {
+                fprintf(stderr, "%s : shader not found.\n", tag.c_str());
+                errors++;
+                continue;
+            }
+
+            std::string preprocessed = nv_helpers_gl::manualInclude(tag, source.data, source.length, source.line,
+                source.directives, directories, includes, cache);
+
+            bool bMissing = false;
+            for (auto& dependency : cache.getDependencies(tag))
+            {
+                if (nv_helpers::fileExists(dependency)) continue;
+                fprintf(stderr, "%s : can't find include \"%s\".\n", tag.c_str(), dependency.c_str());
+                bMissing = true;
+            }
+            if (bMissing)
+            {
+                errors++;
+                continue;
+            }
+
+            const std::string output = outputDir + "/" + tag + "." + ext;
+            if (!writeFile(output, preprocessed))
+            {
+                errors++;
+                continue;
+            }
+
+            if (validator.empty())
+                continue;
+
+            // -G : SPIR-V for OpenGL, loose uniforms and samplers get automatic locations
+            std::string command = "\"" + validator + "\" -G --aml --amb -o \"" + output + ".spv\" \"" + output + "\"";
+            if (std::system(command.c_str()) != 0)
+            {
+                fprintf(stderr, "%s compilation failed.\n", tag.c_str());
+                errors++;
+            }
+        }
+    }
+
+    fprintf(stderr, "%d shader error(s).\n", errors);
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}